@@ -1,606 +1,615 @@
-#include <SFML/Graphics.hpp>
-#include <iostream>
-#include <string>
-#include <cctype>
-#include <cmath>
-
-using namespace std;
-using namespace sf;
-const int SIZE = 8;
-char board[SIZE][SIZE];
-bool whiteTurn = true;
-bool gameOver = false;
-
-void initializeBoard();
-void printBoard();
-bool isValidMove(int sx, int sy, int dx, int dy);
-bool isValidPawnMove(int sx, int sy, int dx, int dy, char piece);
-bool isValidBishopMove(int sx, int sy, int dx, int dy, char piece);
-bool isValidRookMove(int sx, int sy, int dx, int dy, char piece);
-bool isValidKnightMove(int sx, int sy, int dx, int dy, char piece);
-bool isValidQueenMove(int sx, int sy, int dx, int dy, char piece);
-bool isValidKingMove(int sx, int sy, int dx, int dy, char piece);
-void makeMove(int sx, int sy, int dx, int dy);
-
-//pawn promotion
-void handlePawnPromotion(int r, int c);
-
-//stalemate
-bool isStalemate(bool whiteKing);
-
-bool isInsideBoard(int r, int c) { return r >= 0 && r < SIZE && c >= 0 && c < SIZE; }
-
-//check and checkmate
-bool canPieceAttackSquare(int sx, int sy, int dx, int dy); // low-level attack test
-bool isSquareAttacked(int r, int c, bool byWhite);
-bool isKingInCheck(bool whiteKing);
-bool wouldBeInCheckAfterMove(int sx, int sy, int dx, int dy);
-bool canAnyMoveSaveKing(bool whiteKing);
-bool isCheckmate(bool whiteKing);
-
-const int tilesize = 100;
-const int boardsize = 8;
-const float PIECE_SCALE = 0.78f;
-Font aerial;
-Texture whiteRookTexture, whiteKnightTexture, whiteBishopTexture,
-whiteQueenTexture, whiteKingTexture, whitePawnTexture;
-Texture blackRookTexture, blackKnightTexture, blackBishopTexture,
-blackQueenTexture, blackKingTexture, blackPawnTexture;
-
-Sprite pieceSprites[SIZE][SIZE];//represents drwable image on the screen
-
-Texture& textureForPiece(char p) //for texture of piece which is required
-{
-    switch (p) {
-    case 'R': return whiteRookTexture;
-    case 'N': return whiteKnightTexture;
-    case 'B': return whiteBishopTexture;
-    case 'Q': return whiteQueenTexture;
-    case 'K': return whiteKingTexture;
-    case 'P': return whitePawnTexture;
-    case 'r': return blackRookTexture;
-    case 'n': return blackKnightTexture;
-    case 'b': return blackBishopTexture;
-    case 'q': return blackQueenTexture;
-    case 'k': return blackKingTexture;
-    case 'p': return blackPawnTexture;
-    default:
-        return blackPawnTexture; //if none of the case matches then return black pawn 
-    }
-}
-
-void updateSpritesFromBoard() {
-    for (int r = 0; r < SIZE; ++r) 
-    {
-        for (int c = 0; c < SIZE; ++c) 
-        {
-            if (board[r][c] != ' ') 
-            {
-                pieceSprites[r][c].setTexture(textureForPiece(board[r][c]));
-                FloatRect bounds = pieceSprites[r][c].getLocalBounds();//gets width and height of piece in bounds
-                pieceSprites[r][c].setOrigin(bounds.width / 2.f, bounds.height / 2.f);// center origin for nicer dragging and placement
-                pieceSprites[r][c].setPosition(c * tilesize + tilesize / 2.f, r * tilesize + tilesize / 2.f);//position in center 
-                pieceSprites[r][c].setScale(PIECE_SCALE, PIECE_SCALE);//shrinks piece upto 78% of original
-            }
-            else 
-            {
-                //for moving unused sprite off_screen
-                pieceSprites[r][c].setPosition(-1000.f, -1000.f);
-            }
-        }
-    }
-}
-int main()
-{
-    //initialize chess board logical state
-    initializeBoard();
-
-    //for loading textures
-    if (!whiteRookTexture.loadFromFile("pieces/white-rook.png")) cout << "Failed loading white-rook\n";
-    if (!whiteKnightTexture.loadFromFile("pieces/white-knight.png")) cout << "Failed loading white-knight\n";
-    if (!whiteBishopTexture.loadFromFile("pieces/white-bishop.png")) cout << "Failed loading white-bishop\n";
-    if (!whiteQueenTexture.loadFromFile("pieces/white-queen.png")) cout << "Failed loading white-queen\n";
-    if (!whiteKingTexture.loadFromFile("pieces/white-king.png")) cout << "Failed loading white-king\n";
-    if (!whitePawnTexture.loadFromFile("pieces/white-pawn.png")) cout << "Failed loading white-pawn\n";
-
-    if (!blackRookTexture.loadFromFile("pieces/black-rook.png")) cout << "Failed loading black-rook\n";
-    if (!blackKnightTexture.loadFromFile("pieces/black-knight.png")) cout << "Failed loading black-knight\n";
-    if (!blackBishopTexture.loadFromFile("pieces/black-bishop.png")) cout << "Failed loading black-bishop\n";
-    if (!blackQueenTexture.loadFromFile("pieces/black-queen.png")) cout << "Failed loading black-queen\n";
-    if (!blackKingTexture.loadFromFile("pieces/black-king.png")) cout << "Failed loading black-king\n";
-    if (!blackPawnTexture.loadFromFile("pieces/black-pawn.png")) cout << "Failed loading black-pawn\n";
-
-    //create window
-    RenderWindow window(VideoMode(tilesize * boardsize, tilesize * boardsize), "Chess board - Drag & Drop");
-
-    initializeBoard();
-    updateSpritesFromBoard();
-
-    //dragging state
-    bool isDragging = false;
-    int dragFromR = -1, dragFromC = -1;
-    Vector2f dragOffset(0.f, 0.f); // offset of mouse inside sprite to keep cursor relative
-    Sprite draggingSprite;         // a copy of sprite while dragging
-
-    while (window.isOpen())
-    {
-        Event event;
-        while (window.pollEvent(event))
-        {
-            if (event.type == Event::Closed)
-                window.close();
-
-            if (gameOver) continue;
-
-            // Start dragging
-            if (event.type == Event::MouseButtonPressed && event.mouseButton.button == Mouse::Left)
-            {
-                int mouseX = event.mouseButton.x;
-                int mouseY = event.mouseButton.y;
-                int col = mouseX / tilesize;
-                int row = mouseY / tilesize;
-                cout << "From Square: " << char('A' + col) << 8 - row << " (Row " << (row + 1) << ", Col " << (col + 1) << ")" << endl;
-
-                if (isInsideBoard(row, col) && board[row][col] != ' ')
-                {
-                    bool pieceIsWhite = isupper(board[row][col]);
-                    if ((pieceIsWhite && whiteTurn) || (!pieceIsWhite && !whiteTurn))
-                    {
-                        isDragging = true;
-                        dragFromR = row;
-                        dragFromC = col;
-                        draggingSprite = pieceSprites[row][col];
-                        Vector2f spritePos = draggingSprite.getPosition();
-                        dragOffset.x = (float)mouseX - spritePos.x;
-                        dragOffset.y = (float)mouseY - spritePos.y;
-                    }
-                }
-            }
-
-            // Release dragging
-            if (event.type == Event::MouseButtonReleased && event.mouseButton.button == Mouse::Left)
-            {
-                if (isDragging)
-                {
-                    int mouseX = event.mouseButton.x;
-                    int mouseY = event.mouseButton.y;
-                    int toCol = mouseX / tilesize;
-                    int toRow = mouseY / tilesize;
-                    cout << "TO Square: " << char('A' + toCol) << 8 - toRow << " (Row " << (toRow + 1) << ", Col " << (toCol + 1) << ")" << endl;
-
-                    if (isInsideBoard(toRow, toCol) && isValidMove(dragFromR, dragFromC, toRow, toCol))
-                    {
-                        makeMove(dragFromR, dragFromC, toRow, toCol);
-                        handlePawnPromotion(toRow, toCol);
-
-                        bool opponentIsWhite = !whiteTurn;
-                        bool opponentInCheck = isKingInCheck(opponentIsWhite);
-                        bool mate = isCheckmate(opponentIsWhite);
-                        bool stalemate = isStalemate(opponentIsWhite);
-
-                        updateSpritesFromBoard();
-
-                        if (mate)
-                        {
-                            cout << (opponentIsWhite ? "White" : "Black") << " is CHECKMATED!\n";
-                            gameOver = true;
-                        }
-                        else if (stalemate)
-                        {
-                            cout << "STALEMATE! Game is a draw.\n";
-                            gameOver = true;
-                        }
-                        else if (opponentInCheck)
-                        {
-                            cout << (opponentIsWhite ? "White" : "Black") << " is in CHECK!\n";
-                        }
-
-                        whiteTurn = !whiteTurn;
-                    }
-
-                    isDragging = false;
-                }
-            }
-        }
-
-        // drawing
-        window.clear();
-
-        Color lightSquare(238, 238, 210);
-        Color darkSquare(118, 150, 86);
-
-        //highlighting modification: determine tile hover color
-        int hoverRow = -1, hoverCol = -1;
-        if (isDragging)
-        {
-            Vector2i mousePos = Mouse::getPosition(window);
-            hoverCol = mousePos.x / tilesize;
-            hoverRow = mousePos.y / tilesize;
-        }
-
-        for (int row = 0; row < boardsize; ++row)
-        {
-            for (int col = 0; col < boardsize; ++col)
-            {
-                RectangleShape square(Vector2f(tilesize, tilesize));
-                square.setPosition(col * tilesize, row * tilesize);
-                if ((row + col) % 2 == 0) square.setFillColor(lightSquare);
-                else square.setFillColor(darkSquare);
-
-                // Highlight the hovered tile green/red
-                if (isDragging && row == hoverRow && col == hoverCol)
-                {
-                    if (isInsideBoard(row, col) && isValidMove(dragFromR, dragFromC, row, col))
-                        square.setFillColor(Color(100, 255, 100)); // green for valid
-                    else
-                        square.setFillColor(Color(255, 100, 100)); // red for invalid
-                }
-
-                window.draw(square);
-            }
-        }
-
-        // draw pieces
-        for (int r = 0; r < SIZE; ++r)
-        {
-            for (int c = 0; c < SIZE; ++c)
-            {
-                if (board[r][c] != ' ')
-                {
-                    if (isDragging && r == dragFromR && c == dragFromC) continue;
-                    pieceSprites[r][c].setPosition((float)(c * tilesize + tilesize / 2.f), (float)(r * tilesize + tilesize / 2.f));
-                    window.draw(pieceSprites[r][c]);
-                }
-            }
-        }
-
-        // draw dragging sprite
-        if (isDragging)
-        {
-            Vector2i mpos = Mouse::getPosition(window);
-            draggingSprite.setPosition((float)mpos.x - dragOffset.x, (float)mpos.y - dragOffset.y);
-            window.draw(draggingSprite);
-        }
-
-        window.display();
-    }
-
-    return 0;
-}
-
-
-void initializeBoard()
-{
-    for (int i = 0; i < SIZE; i++)
-    {
-        for (int j = 0; j < SIZE; j++)
-        {
-            board[i][j] = ' ';
-        }
-    }
-    // for white pieces (uppercase)
-    for (int i = 0; i < SIZE; i++)
-    {
-        board[6][i] = 'P';
-    }
-    board[7][0] = 'R'; board[7][1] = 'N'; board[7][2] = 'B'; board[7][3] = 'Q';
-    board[7][4] = 'K'; board[7][5] = 'B'; board[7][6] = 'N'; board[7][7] = 'R';
-    // for black pieces (lowercase)
-    for (int i = 0; i < SIZE; i++)
-    {
-        board[1][i] = 'p';
-    }
-    board[0][0] = 'r'; board[0][1] = 'n'; board[0][2] = 'b'; board[0][3] = 'q';
-    board[0][4] = 'k'; board[0][5] = 'b'; board[0][6] = 'n'; board[0][7] = 'r';
-}
-
-
-bool isValidMove(int sx, int sy, int dx, int dy)
-{
-    if (!isInsideBoard(sx, sy) || !isInsideBoard(dx, dy)) return false;
-    if (sx == dx && sy == dy) return false; // no movement
-
-    char piece = board[sx][sy];
-    if (piece == ' ') return false; // no piece selected
-
-    // destination cannot be occupied by same-color piece
-    if (board[dx][dy] != ' ' && (isupper(piece) == isupper(board[dx][dy]))) return false;
-
-    char lower = tolower(piece);
-    bool valid = false;
-    switch (lower) {
-    case 'p': valid = isValidPawnMove(sx, sy, dx, dy, piece); break;
-    case 'r': valid = isValidRookMove(sx, sy, dx, dy, piece); break;
-    case 'n': valid = isValidKnightMove(sx, sy, dx, dy, piece); break;
-    case 'b': valid = isValidBishopMove(sx, sy, dx, dy, piece); break;
-    case 'q': valid = isValidQueenMove(sx, sy, dx, dy, piece); break;
-    case 'k': valid = isValidKingMove(sx, sy, dx, dy, piece); break;
-    default: return false;
-    }
-
-    if (!valid) return false;
-
-    //prevent moves that leave your own king in check
-    if (wouldBeInCheckAfterMove(sx, sy, dx, dy)) return false;
-
-    return true;
-}
-
-bool isValidPawnMove(int sx, int sy, int dx, int dy, char piece)
-{
-    int direction = (isupper(piece) ? -1 : +1);  // White moves up (row--), black moves down (row++)
-
-    // Simple 1-step forward
-    if (dx == sx + direction && dy == sy && board[dx][dy] == ' ')
-        return true;
-
-    // Initial 2-step forward
-    bool isInitialWhite = (piece == 'P' && sx == 6);
-    bool isInitialBlack = (piece == 'p' && sx == 1);
-    if ((isInitialWhite || isInitialBlack) &&
-        dx == sx + 2 * direction &&
-        dy == sy &&
-        board[sx + direction][sy] == ' ' &&
-        board[dx][dy] == ' ')
-    {
-        return true;
-    }
-
-    //one step diagonally captures only if target occupied by opponent
-    if (dx == sx + direction && abs(dy - sy) == 1) 
-    {
-        if (board[dx][dy] != ' ' && isupper(piece) != isupper(board[dx][dy]))
-            return true;
-    }
-
-    return false;
-}
-
-bool isValidRookMove(int sx, int sy, int dx, int dy, char piece)
-{
-    // must move in same row or same column
-    if (sx != dx && sy != dy) return false;
-
-    int stepX = (dx > sx) ? 1 : (dx < sx) ? -1 : 0;
-    int stepY = (dy > sy) ? 1 : (dy < sy) ? -1 : 0;
-
-    int x = sx + stepX;
-    int y = sy + stepY;
-    while (x != dx || y != dy) {
-        if (board[x][y] != ' ') return false; // blocked
-        x += stepX;
-        y += stepY;
-    }
-
-    // destination handled in outer check (cannot capture same color)
-    return true;
-}
-
-bool isValidKnightMove(int sx, int sy, int dx, int dy, char piece)
-{
-    int dxAbs = abs(dx - sx);
-    int dyAbs = abs(dy - sy);
-    if ((dxAbs == 2 && dyAbs == 1) || (dxAbs == 1 && dyAbs == 2)) {
-        // destination color check done earlier
-        return true;
-    }
-    return false;
-}
-
-bool isValidBishopMove(int sx, int sy, int dx, int dy, char piece) {
-    if (abs(dx - sx) != abs(dy - sy)) return false;
-
-    int stepX = (dx > sx) ? 1 : -1;
-    int stepY = (dy > sy) ? 1 : -1;
-    int x = sx + stepX;
-    int y = sy + stepY;
-    while (x != dx && y != dy) {
-        if (board[x][y] != ' ') return false;
-        x += stepX;
-        y += stepY;
-    }
-
-    return true;
-}
-
-bool isValidQueenMove(int sx, int sy, int dx, int dy, char piece)
-{
-    // queen = rook OR bishop
-    if (sx == dx || sy == dy) return isValidRookMove(sx, sy, dx, dy, piece);
-    if (abs(dx - sx) == abs(dy - sy)) return isValidBishopMove(sx, sy, dx, dy, piece);
-    return false;
-}
-
-bool isValidKingMove(int sx, int sy, int dx, int dy, char piece)
-{
-    int dxAbs = abs(dx - sx);
-    int dyAbs = abs(dy - sy);
-    if (dxAbs <= 1 && dyAbs <= 1) {
-        // cannot capture same color (already checked)
-        return true;
-    }
-    return false;
-}
-
-void makeMove(int sx, int sy, int dx, int dy)
-{
-    // Basic move: move piece, capture implicitly handled by overwrite
-    board[dx][dy] = board[sx][sy];
-    board[sx][sy] = ' ';
-}
-
-
-// low-level: determines whether piece at (sx,sy) could move to (dx,dy)
-// using piece-specific movement rules (bypasses king-in-check prevention).
-bool canPieceAttackSquare(int sx, int sy, int dx, int dy)
-{
-    if (!isInsideBoard(sx, sy) || !isInsideBoard(dx, dy)) return false;
-    if (sx == dx && sy == dy) return false;
-    char piece = board[sx][sy];
-    if (piece == ' ') return false;
-
-    // For pawns, use attack-only logic (pawns attack diagonally regardless of target occupancy)
-    char lower = tolower(piece);
-    switch (lower) {
-    case 'p': {
-        int direction = (isupper(piece) ? -1 : +1);
-        if (dx == sx + direction && abs(dy - sy) == 1) return true;
-        return false;
-    }
-    case 'r': return isValidRookMove(sx, sy, dx, dy, piece);
-    case 'n': return isValidKnightMove(sx, sy, dx, dy, piece);
-    case 'b': return isValidBishopMove(sx, sy, dx, dy, piece);
-    case 'q': return isValidQueenMove(sx, sy, dx, dy, piece);
-    case 'k': return isValidKingMove(sx, sy, dx, dy, piece);
-    default: return false;
-    }
-}
-
-// Is square (r,c) attacked by any piece of color byWhite?
-bool isSquareAttacked(int r, int c, bool byWhite)
-{
-    for (int i = 0; i < SIZE; ++i) {
-        for (int j = 0; j < SIZE; ++j) {
-            char p = board[i][j];
-            if (p == ' ') continue;
-            if (isupper(p) != byWhite) continue; // only consider pieces of color 'byWhite'
-            // Use piece-specific attack test (won't recurse into check-testing)
-            if (canPieceAttackSquare(i, j, r, c)) return true;
-        }
-    }
-    return false;
-}
-
-// Is the given color's king currently in check?
-bool isKingInCheck(bool whiteKing)
-{
-    // find the king
-    for (int r = 0; r < SIZE; ++r) {
-        for (int c = 0; c < SIZE; ++c) {
-            char p = board[r][c];
-            if (whiteKing && p == 'K') {
-                // is (r,c) attacked by BLACK?
-                return isSquareAttacked(r, c, false);
-            }
-            if (!whiteKing && p == 'k') {
-                // is (r,c) attacked by WHITE?
-                return isSquareAttacked(r, c, true);
-            }
-        }
-    }
-    // king not found (shouldn't happen in normal play) treat as not in check
-    return false;
-}
-
-// Simulate the move and test whether the mover's king would be in check afterwards
-bool wouldBeInCheckAfterMove(int sx, int sy, int dx, int dy)
-{
-    char savedFrom = board[sx][sy];
-    char savedTo = board[dx][dy];
-
-    // perform move
-    board[dx][dy] = savedFrom;
-    board[sx][sy] = ' ';
-
-    // which color's king are we checking? same color as savedFrom
-    bool moverIsWhite = isupper(savedFrom);
-    bool stillInCheck = isKingInCheck(moverIsWhite);
-
-    // revert
-    board[sx][sy] = savedFrom;
-    board[dx][dy] = savedTo;
-
-    return stillInCheck;
-}
-
-// Try all legal moves for 'whiteKing' color; if any move avoids check, return true
-// Note: despite the name, this function simply returns true if there exists any legal move
-// for the given color (i.e., any move that is valid and doesn't leave own king in check).
-bool canAnyMoveSaveKing(bool whiteKing)
-{
-    for (int sx = 0; sx < SIZE; ++sx) {
-        for (int sy = 0; sy < SIZE; ++sy) {
-            char p = board[sx][sy];
-            if (p == ' ') continue;
-            if (isupper(p) != whiteKing) continue; // only this color's pieces
-
-            for (int dx = 0; dx < SIZE; ++dx) {
-                for (int dy = 0; dy < SIZE; ++dy) {
-                    // We must test legal moves that don't leave own king in check
-                    if (!isValidMove(sx, sy, dx, dy)) continue;
-                    // If move is valid, and would not leave king in check, then we can save
-                    // (isValidMove already checks wouldBeInCheckAfterMove, so if valid -> safe)
-                    return true;
-                }
-            }
-        }
-    }
-    return false;
-}
-
-bool isCheckmate(bool whiteKing)
-{
-    if (!isKingInCheck(whiteKing)) return false;
-    if (canAnyMoveSaveKing(whiteKing)) return false;
-    return true;
-}
-// Console-menu based promotion: if pawn has reached last rank, ask user and replace pawn.
-void handlePawnPromotion(int r, int c)
-{
-    if (!isInsideBoard(r, c)) return;
-    char p = board[r][c];
-    if (p != 'P' && p != 'p') return; // not a pawn
-
-    // White pawn promotes when reaching row 0
-    if (p == 'P' && r != 0) return;
-    // Black pawn promotes when reaching row 7
-    if (p == 'p' && r != 7) return;
-
-    // Prompt user in console
-    cout << "\nPawn Promotion! (console menu)\n";
-    cout << "Choose piece:\n";
-    cout << "1. Queen\n";
-    cout << "2. Rook\n";
-    cout << "3. Bishop\n";
-    cout << "4. Knight\n";
-    cout << "Enter choice (1-4): ";
-
-    int choice = 0;
-    while (true) {
-        if (!(cin >> choice)) {
-            // clear error and ignore rest of line
-            cin.clear();
-            string skip;
-            getline(cin, skip);
-            cout << "Invalid input. Enter a number 1-4: ";
-            continue;
-        }
-        if (choice >= 1 && choice <= 4) break;
-        cout << "Please enter a valid choice (1-4): ";
-    }
-
-    bool isWhite = (p == 'P');
-    char newPiece = 'Q';
-    switch (choice) {
-    case 1: newPiece = (isWhite ? 'Q' : 'q'); break;
-    case 2: newPiece = (isWhite ? 'R' : 'r'); break;
-    case 3: newPiece = (isWhite ? 'B' : 'b'); break;
-    case 4: newPiece = (isWhite ? 'K' : 'k'); break;
-    default: newPiece = (isWhite ? 'Q' : 'q'); break;
-    }
-
-    board[r][c] = newPiece;
-    cout << "Pawn promoted to " << newPiece << "\n";
-}
-// Stalemate: side to move is NOT in check, but has no legal moves.
-bool isStalemate(bool whiteKing)
-{
-    // If side is in check, it's not stalemate
-    if (isKingInCheck(whiteKing)) return false;
-
-    // If there's any legal move for that side, it's not stalemate
-    if (canAnyMoveSaveKing(whiteKing)) return false;
-
-    // Not in check and no legal moves => stalemate
-    return true;
-}
\ No newline at end of file
+#include <SFML/Graphics.hpp>
+#include <chrono>
+#include <csignal>
+#include <future>
+#include <iostream>
+#include <string>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include "atlas.h"
+#include "book.h"
+#include "engine.h"
+#include "gamefile.h"
+#include "instrument.h"
+#include "movegen.h"
+#include "pgn.h"
+#include "rules.h"
+#include "search.h"
+#include "syzygy.h"
+#include "uci.h"
+
+using namespace std;
+using namespace sf;
+
+// the window's game; the rules themselves live in the chessrules library
+Position game;
+bool gameOver = false;
+GameRecord gameRecord; // moves played so far, for saving
+//the archive game the board was last saved as (or loaded from), so S on an unchanged game adds nothing
+int savedGameIndex = -1;
+GameRecord savedRecord;
+
+//endgame tablebases: Syzygy files from $SYZYGY_PATH (dirs separated by ':') or ./syzygy
+Tablebases tablebases;
+
+void printTablebaseVerdict()
+{
+    if (!tablebases.covers(game)) return;
+    int wdl, dtz;
+    if (!tablebases.probeWdl(game, wdl) || !tablebases.probeDtz(game, dtz)) return;
+    const char* mover = game.whiteToMove ? "White" : "Black";
+    const char* other = game.whiteToMove ? "Black" : "White";
+    if (wdl == WDL_WIN) cout << "Tablebase: " << mover << " wins (" << dtz << " plies to the next capture or pawn move)\n";
+    else if (wdl == WDL_LOSS) cout << "Tablebase: " << other << " wins (" << -dtz << " plies to the next capture or pawn move)\n";
+    else if (wdl == WDL_DRAW) cout << "Tablebase: draw\n";
+    else cout << "Tablebase: " << (wdl > 0 ? mover : other) << " wins, but the 50-move rule saves the draw\n";
+}
+
+//opening book hints: H lists the book moves for the side to move, from $POLYGLOT_BOOK or ./book.bin
+OpeningBook openingBook;
+
+void printBookHint()
+{
+    vector<BookMove> moves = openingBook.probe(game);
+    if (moves.empty())
+    {
+        cout << (openingBook.isOpen() ? "Hint: position not in the book\n" : "Hint: no opening book loaded\n");
+        return;
+    }
+    int total = 0;
+    for (const BookMove& m : moves) total += m.weight;
+    cout << "Hint:";
+    for (const BookMove& m : moves) cout << " " << moveToSan(game, m.move) << " (" << 100 * m.weight / max(1, total) << "%)";
+    cout << "\n";
+}
+
+//engine: E lets the engine play the side to move (E again takes it back), A toggles analysis.
+//Searches run on a background thread and stream their results into the window title, so the
+//board keeps drawing while the engine thinks; moving a piece restarts (or cancels) them.
+const int ENGINE_MOVETIME_MS = 1000;
+const char* const WINDOW_TITLE = "Chess board - Drag & Drop";
+unique_ptr<EngineService> engine;
+int engineSide = -1;           // WHITE or BLACK while the engine plays that side
+bool analysing = false;
+uint64_t engineSearchId = 0;   // the search whose updates are current, 0 for none
+bool engineMoveSearch = false; // its best move gets played
+string engineStatus, shownStatus; // what the title should show, and what it shows
+
+void restartEngine()
+{
+    int toMove = game.whiteToMove ? WHITE : BLACK;
+    engineMoveSearch = !gameOver && engineSide == toMove;
+    engineStatus.clear();
+    if (gameOver || (!engineMoveSearch && !analysing))
+    {
+        engine->cancel();
+        engineSearchId = 0;
+        return;
+    }
+    SearchLimits limits; // no limit: analysis runs until the next restart
+    if (engineMoveSearch) limits.movetimeMs = ENGINE_MOVETIME_MS;
+    engineSearchId = engine->start(game, limits);
+}
+
+//score from White's side, in pawns or moves to mate
+string engineScoreText(int score)
+{
+    if (!game.whiteToMove) score = -score;
+    if (score >= MATE_BOUND) return "#" + to_string((MATE_SCORE - score + 1) / 2);
+    if (score <= -MATE_BOUND) return "#-" + to_string((MATE_SCORE + score) / 2);
+    char text[16];
+    snprintf(text, sizeof(text), "%+.2f", score / 100.0);
+    return text;
+}
+
+
+const char* const GAME_ARCHIVE = "games.cgf";
+
+bool sameGame(const GameRecord& a, const GameRecord& b)
+{
+    return a.startFen == b.startFen && a.moves == b.moves && a.result == b.result;
+}
+
+void saveGame()
+{
+    if (savedGameIndex >= 0 && sameGame(gameRecord, savedRecord))
+    {
+        cout << "Game already saved to " << GAME_ARCHIVE << " (game " << savedGameIndex << ")\n";
+        return;
+    }
+    GameWriter writer;
+    if (writer.open(GAME_ARCHIVE, true) && writer.add(gameRecord) && writer.close())
+    {
+        savedGameIndex = int(writer.gameCount()) - 1;
+        savedRecord = gameRecord;
+        cout << "Game saved to " << GAME_ARCHIVE << " (game " << savedGameIndex << ")\n";
+    }
+    else
+        cout << "Failed saving to " << GAME_ARCHIVE << "\n";
+}
+
+void loadLastGame()
+{
+    GameReader reader;
+    GameRecord loaded;
+    unique_ptr<Position> replay(new Position());
+    if (!reader.open(GAME_ARCHIVE) || reader.gameCount() == 0
+        || !reader.readGame(reader.gameCount() - 1, loaded) || !startPosition(loaded, *replay))
+    {
+        cout << "No saved game in " << GAME_ARCHIVE << "\n";
+        return;
+    }
+    //replayed off the board, so a damaged game leaves the current one as it is
+    for (size_t ply = 0; ply < loaded.moves.size(); ++ply)
+        if (!replayMove(*replay, loaded.moves[ply]))
+        {
+            cout << "Game " << reader.gameCount() - 1 << " in " << GAME_ARCHIVE << " is damaged (illegal move at ply "
+                 << ply + 1 << "), not loaded\n";
+            return;
+        }
+    game = *replay;
+    gameRecord = loaded;
+    savedGameIndex = int(reader.gameCount()) - 1;
+    savedRecord = loaded;
+    gameOver = isCheckmate(game, game.whiteToMove) || isStalemate(game, game.whiteToMove);
+    cout << "Loaded game " << reader.gameCount() - 1 << " (" << loaded.moves.size() << " plies, "
+         << resultText(loaded.result) << ")\n";
+    if (!gameOver) printTablebaseVerdict();
+    restartEngine();
+}
+
+//plays a move for whoever is to move and reports check, mate and stalemate
+void playMove(Move move)
+{
+    makeMove(game, move);
+    gameRecord.moves.push_back(move);
+
+    // makeMove already handed the turn over
+    bool opponentIsWhite = game.whiteToMove;
+    bool opponentInCheck = isKingInCheck(game, opponentIsWhite);
+    bool mate = isCheckmate(game, opponentIsWhite);
+    bool stalemate = isStalemate(game, opponentIsWhite);
+
+    if (mate)
+    {
+        cout << (opponentIsWhite ? "White" : "Black") << " is CHECKMATED!\n";
+        gameOver = true;
+        gameRecord.result = opponentIsWhite ? RESULT_BLACK_WINS : RESULT_WHITE_WINS;
+    }
+    else if (stalemate)
+    {
+        cout << "STALEMATE! Game is a draw.\n";
+        gameOver = true;
+        gameRecord.result = RESULT_DRAW;
+    }
+    else if (opponentInCheck)
+    {
+        cout << (opponentIsWhite ? "White" : "Black") << " is in CHECK!\n";
+    }
+    if (!gameOver) printTablebaseVerdict();
+    restartEngine();
+}
+
+//takes what the engine thread has sent since the last frame; true if the picture changed
+bool pollEngine(RenderWindow& window)
+{
+    bool changed = false;
+    EngineUpdate update;
+    while (engine->poll(update))
+    {
+        if (update.searchId != engineSearchId) continue; // overtaken by a later move or restart
+        if (update.kind == UPDATE_BESTMOVE && engineMoveSearch)
+        {
+            engineSearchId = 0;
+            if (update.bestMove == NO_MOVE) continue;
+            cout << "Engine plays " << moveToSan(game, update.bestMove) << "\n";
+            playMove(update.bestMove);
+            changed = true;
+            continue;
+        }
+        engineStatus = "depth " + to_string(update.depth) + "  " + engineScoreText(update.score) + "  ";
+        for (int i = 0; i < update.pvLength; ++i) engineStatus += " " + moveToUci(update.pv[i]);
+    }
+    if (engineMoveSearch && engineSearchId && engineStatus.empty()) engineStatus = "engine thinking";
+    if (engineStatus != shownStatus)
+    {
+        shownStatus = engineStatus;
+        window.setTitle(engineStatus.empty() ? string(WINDOW_TITLE) : string(WINDOW_TITLE) + " | " + engineStatus);
+    }
+    return changed;
+}
+
+//promotion: a pawn dropped on the last rank opens a chooser over the target file (queen, rook,
+//bishop, knight from the edge inwards); a click picks, Esc or a click elsewhere takes it back
+struct PromotionChoice
+{
+    bool open = false;
+    int fromR = -1, fromC = -1, toR = -1, toC = -1;
+};
+PromotionChoice promotionChoice;
+const char promotionPieces[] = "qrbn";
+
+bool isPromotionDrop(int fromR, int fromC, int toR)
+{
+    char p = pieceAt(game, fromR, fromC);
+    return (p == 'P' && toR == 0) || (p == 'p' && toR == 7);
+}
+
+int promotionRow(int i)
+{
+    return promotionChoice.toR == 0 ? i : 7 - i;
+}
+
+const int tilesize = 100;
+const int boardsize = 8;
+const float PIECE_SCALE = 0.78f;
+
+// every piece draws from one texture; see atlas.h for the layout
+Texture pieceAtlas;
+IntRect atlasRects[2][PIECE_TYPE_NB];
+bool piecesReady = false;
+
+// where the pack-atlas build step leaves its output (the build directory), unless the
+// files have been copied next to where the window is started from
+#ifndef PIECE_ATLAS_DIR
+#define PIECE_ATLAS_DIR "."
+#endif
+
+// Runs off the main thread: the PNG decode is the slow part of startup. Prefers the
+// prebaked atlas (one decode) and falls back to packing the twelve pieces/*.png itself.
+PieceAtlasImage loadPieceImages()
+{
+    PieceAtlasImage atlas;
+    if (!loadAtlas("pieces-atlas.png", "pieces-atlas.txt", atlas)
+        && !loadAtlas(PIECE_ATLAS_DIR "/pieces-atlas.png", PIECE_ATLAS_DIR "/pieces-atlas.txt", atlas))
+        packPieceImages("pieces", atlas);
+    return atlas;
+}
+
+// the texture upload needs the window's GL context, so it happens back on the main thread
+void uploadPieceAtlas(const PieceAtlasImage& atlas)
+{
+    pieceAtlas.loadFromImage(atlas.image);
+    pieceAtlas.setSmooth(true);
+    for (int color = WHITE; color <= BLACK; ++color)
+        for (int type = PAWN; type <= KING; ++type)
+            atlasRects[color][type] = atlas.rects[color][type];
+    piecesReady = true;
+}
+
+// the 64 board squares as one prebuilt quad array; only vertex colours change afterwards
+VertexArray boardVertices(Quads, SIZE * SIZE * 4);
+// every visible piece as textured quads into the atlas, rebuilt when the picture changes
+VertexArray pieceVertices(Quads);
+
+const Color lightSquare(238, 238, 210);
+const Color darkSquare(118, 150, 86);
+
+// the promotion chooser: a dimmed board, four light squares and their pieces
+VertexArray overlayVertices(Quads);
+VertexArray choiceVertices(Quads);
+
+void appendQuad(VertexArray& target, float x, float y, float w, float h, const Color& color)
+{
+    target.append(Vertex(Vector2f(x, y), color));
+    target.append(Vertex(Vector2f(x + w, y), color));
+    target.append(Vertex(Vector2f(x + w, y + h), color));
+    target.append(Vertex(Vector2f(x, y + h), color));
+}
+
+void buildBoardVertices()
+{
+    for (int row = 0; row < boardsize; ++row)
+    {
+        for (int col = 0; col < boardsize; ++col)
+        {
+            Vertex* quad = &boardVertices[(row * boardsize + col) * 4];
+            float x = (float)(col * tilesize), y = (float)(row * tilesize);
+            quad[0].position = Vector2f(x, y);
+            quad[1].position = Vector2f(x + tilesize, y);
+            quad[2].position = Vector2f(x + tilesize, y + tilesize);
+            quad[3].position = Vector2f(x, y + tilesize);
+        }
+    }
+}
+
+void setSquareColor(int row, int col, const Color& color)
+{
+    Vertex* quad = &boardVertices[(row * boardsize + col) * 4];
+    for (int i = 0; i < 4; ++i) quad[i].color = color;
+}
+
+// one quad centred on (cx, cy), scaled like the old sprites were
+void appendPiece(char piece, float cx, float cy, VertexArray& target = pieceVertices)
+{
+    const IntRect& rect = atlasRects[isupper(piece) ? WHITE : BLACK][pieceTypeOf(piece)];
+    float halfW = rect.width * PIECE_SCALE / 2.f, halfH = rect.height * PIECE_SCALE / 2.f;
+    float left = (float)rect.left, top = (float)rect.top;
+    float right = left + rect.width, bottom = top + rect.height;
+    target.append(Vertex(Vector2f(cx - halfW, cy - halfH), Vector2f(left, top)));
+    target.append(Vertex(Vector2f(cx + halfW, cy - halfH), Vector2f(right, top)));
+    target.append(Vertex(Vector2f(cx + halfW, cy + halfH), Vector2f(right, bottom)));
+    target.append(Vertex(Vector2f(cx - halfW, cy + halfH), Vector2f(left, bottom)));
+}
+
+// legal destinations of the dragged piece as a bitboard, filled once per drag start.
+// Keyed by the position's Zobrist key so it is only recomputed after a move.
+struct DestinationCache
+{
+    uint64_t key = 0;
+    int from = -1;
+    Bitboard targets = 0;
+};
+DestinationCache dragTargets;
+
+Bitboard legalTargetsFrom(int row, int col)
+{
+    int from = squareOf(row, col);
+    if (dragTargets.from != from || dragTargets.key != game.key)
+    {
+        dragTargets.key = game.key;
+        dragTargets.from = from;
+        dragTargets.targets = legalDestinations(game, from);
+    }
+    return dragTargets.targets;
+}
+
+bool isDragTarget(int row, int col)
+{
+    return isInsideBoard(row, col) && (dragTargets.targets & squareBB(squareOf(row, col)));
+}
+
+int main(int argc, char** argv)
+{
+    //headless engine mode for GUIs, tournament managers and servers without a display
+    if (argc > 1 && string(argv[1]) == "--uci") return runUci(cin, cout);
+
+    //--startup-time: print how long each startup stage took, then exit after the first full frame
+    auto startTime = chrono::steady_clock::now();
+    bool measureStartup = argc > 1 && string(argv[1]) == "--startup-time";
+    auto stage = [&](const char* name) {
+        if (measureStartup)
+            cout << name << ": " << chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count() << " ms\n";
+    };
+
+    //initialize chess board logical state
+    initializeBoard(game);
+
+    //decode the piece images in the background while the window and board come up
+    future<PieceAtlasImage> pendingPieces = async(launch::async, loadPieceImages);
+
+    //create window; the board only changes on input, so there is no point drawing faster than the screen
+    RenderWindow window(VideoMode(tilesize * boardsize, tilesize * boardsize), WINDOW_TITLE);
+    window.setFramerateLimit(60);
+    buildBoardVertices();
+    stage("window open");
+
+    //tablebase scan, engine threads and book only after the window is up, so they do not hold it back
+    const char* syzygyPath = getenv("SYZYGY_PATH");
+    if (tablebases.init(syzygyPath ? syzygyPath : "syzygy"))
+        cout << tablebases.tableCount() << " Syzygy tables found, up to " << tablebases.maxPieces() << " pieces\n";
+    engine.reset(new EngineService(16, &tablebases));
+    cout << "E: engine plays the side to move, A: analysis\n";
+    //instrumented builds: P prints call counts and latencies (Shift+P as JSON), so do SIGUSR1 / SIGUSR2
+    if (installInstrumentDump(SIGUSR1, SIGUSR2)) cout << "P: hot-path timings\n";
+    const char* bookPath = getenv("POLYGLOT_BOOK");
+    if (openingBook.open(bookPath ? bookPath : "book.bin"))
+        cout << "Opening book: " << openingBook.entryCount() << " entries (H for a hint)\n";
+    stage("engine ready");
+    bool boardShown = false;
+
+    //dragging state
+    bool isDragging = false;
+    int dragFromR = -1, dragFromC = -1;
+    Vector2f dragOffset(0.f, 0.f); // offset of mouse inside the piece to keep cursor relative
+    bool needsRedraw = true;       // idle until an event changes what is on screen
+
+    while (window.isOpen())
+    {
+        if (!piecesReady && pendingPieces.wait_for(chrono::milliseconds(needsRedraw ? 0 : 5)) == future_status::ready)
+        {
+            uploadPieceAtlas(pendingPieces.get());
+            stage("pieces loaded");
+            needsRedraw = true;
+        }
+
+        // the engine cannot wake waitEvent either: while it thinks, look at its queue every
+        // few ms. busy() is read first, so a best move queued just before it went idle is seen.
+        bool engineIdle = !engine->busy();
+        if (pollEngine(window)) needsRedraw = true;
+
+        Event event;
+        // block in waitEvent while idle instead of spinning (but keep polling until the pieces
+        // arrive, since their loader cannot wake waitEvent); drain whatever else is queued
+        bool idle = !needsRedraw && piecesReady && engineIdle;
+        if (!idle && !needsRedraw && piecesReady) sleep(milliseconds(5));
+        for (bool have = idle ? window.waitEvent(event) : window.pollEvent(event); have; have = window.pollEvent(event))
+        {
+            if (event.type == Event::Closed)
+                window.close();
+
+            if (event.type == Event::KeyPressed && event.key.code == Keyboard::S) saveGame();
+            if (event.type == Event::KeyPressed && event.key.code == Keyboard::L && !isDragging && !promotionChoice.open) loadLastGame();
+            if (event.type == Event::KeyPressed && event.key.code == Keyboard::H && !gameOver) printBookHint();
+            if (event.type == Event::KeyPressed && event.key.code == Keyboard::E && !isDragging && !promotionChoice.open)
+            {
+                int toMove = game.whiteToMove ? WHITE : BLACK;
+                engineSide = engineSide == toMove ? -1 : toMove;
+                cout << (engineSide < 0 ? string("Engine off") : string("Engine plays ") + (toMove == WHITE ? "White" : "Black")) << "\n";
+                restartEngine();
+            }
+            if (event.type == Event::KeyPressed && event.key.code == Keyboard::P)
+            {
+                InstrumentSnapshot snapshot;
+                takeSnapshot(snapshot);
+                cout << (event.key.shift ? snapshotJson(snapshot) : snapshotText(snapshot));
+            }
+            if (event.type == Event::KeyPressed && event.key.code == Keyboard::A)
+            {
+                analysing = !analysing;
+                restartEngine();
+            }
+
+            // plain mouse movement only matters while a piece follows the cursor
+            if (event.type != Event::MouseMoved || isDragging) needsRedraw = true;
+
+            if (gameOver) continue;
+
+            // while the chooser is open it takes every click
+            if (promotionChoice.open)
+            {
+                bool pick = event.type == Event::MouseButtonPressed && event.mouseButton.button == Mouse::Left;
+                bool escape = event.type == Event::KeyPressed && event.key.code == Keyboard::Escape;
+                if (pick || escape)
+                {
+                    PromotionChoice choice = promotionChoice;
+                    promotionChoice.open = false;
+                    int row = pick ? event.mouseButton.y / tilesize : -1;
+                    int col = pick ? event.mouseButton.x / tilesize : -1;
+                    for (int i = 0; i < 4 && col == choice.toC; ++i)
+                    {
+                        if (promotionRow(i) != row) continue;
+                        cout << "Pawn promoted to " << char(choice.toR == 0 ? toupper(promotionPieces[i]) : promotionPieces[i]) << "\n";
+                        playMove(moveFromSquares(game, squareOf(choice.fromR, choice.fromC),
+                                                 squareOf(choice.toR, choice.toC), promotionPieces[i]));
+                    }
+                }
+                continue;
+            }
+
+            // Start dragging
+            if (event.type == Event::MouseButtonPressed && event.mouseButton.button == Mouse::Left)
+            {
+                int mouseX = event.mouseButton.x;
+                int mouseY = event.mouseButton.y;
+                int col = mouseX / tilesize;
+                int row = mouseY / tilesize;
+                cout << "From Square: " << char('A' + col) << 8 - row << " (Row " << (row + 1) << ", Col " << (col + 1) << ")" << endl;
+
+                // on the engine's turn the board is read-only
+                bool engineToMove = engineSide == (game.whiteToMove ? WHITE : BLACK);
+                if (isInsideBoard(row, col) && pieceAt(game, row, col) != ' ' && !engineToMove)
+                {
+                    bool pieceIsWhite = isupper(pieceAt(game, row, col));
+                    if ((pieceIsWhite && game.whiteToMove) || (!pieceIsWhite && !game.whiteToMove))
+                    {
+                        isDragging = true;
+                        dragFromR = row;
+                        dragFromC = col;
+                        legalTargetsFrom(row, col);
+                        dragOffset.x = (float)mouseX - (col * tilesize + tilesize / 2.f);
+                        dragOffset.y = (float)mouseY - (row * tilesize + tilesize / 2.f);
+                    }
+                }
+            }
+
+            // Release dragging
+            if (event.type == Event::MouseButtonReleased && event.mouseButton.button == Mouse::Left)
+            {
+                if (isDragging)
+                {
+                    int mouseX = event.mouseButton.x;
+                    int mouseY = event.mouseButton.y;
+                    int toCol = mouseX / tilesize;
+                    int toRow = mouseY / tilesize;
+                    cout << "TO Square: " << char('A' + toCol) << 8 - toRow << " (Row " << (toRow + 1) << ", Col " << (toCol + 1) << ")" << endl;
+
+                    if (isDragTarget(toRow, toCol) && isPromotionDrop(dragFromR, dragFromC, toRow))
+                        promotionChoice = { true, dragFromR, dragFromC, toRow, toCol };
+                    else if (isDragTarget(toRow, toCol))
+                        playMove(moveFromSquares(game, squareOf(dragFromR, dragFromC), squareOf(toRow, toCol)));
+
+                    isDragging = false;
+                }
+            }
+        }
+
+        if (!needsRedraw || !window.isOpen()) continue;
+        needsRedraw = false;
+        INSTRUMENT(HOT_FRAME); // building and drawing the frame, not the frame-limit wait in display()
+
+        //highlighting modification: determine tile hover color
+        int hoverRow = -1, hoverCol = -1;
+        Vector2i mousePos = Mouse::getPosition(window);
+        if (isDragging)
+        {
+            hoverCol = mousePos.x / tilesize;
+            hoverRow = mousePos.y / tilesize;
+        }
+
+        for (int row = 0; row < boardsize; ++row)
+        {
+            for (int col = 0; col < boardsize; ++col)
+            {
+                Color color = (row + col) % 2 == 0 ? lightSquare : darkSquare;
+
+                // tint every legal target, and the hovered tile green/red (read from the cached mask)
+                bool target = isDragging && isDragTarget(row, col);
+                if (target)
+                    color = (row + col) % 2 == 0 ? Color(200, 235, 150) : Color(150, 200, 90);
+                if (isDragging && row == hoverRow && col == hoverCol)
+                    color = target ? Color(100, 255, 100) : Color(255, 100, 100); // green valid, red invalid
+
+                setSquareColor(row, col, color);
+            }
+        }
+
+        // pieces, with the dragged one last so it stays on top
+        pieceVertices.clear();
+        for (int r = 0; r < SIZE; ++r)
+        {
+            for (int c = 0; c < SIZE; ++c)
+            {
+                if (pieceAt(game, r, c) == ' ') continue;
+                if (isDragging && r == dragFromR && c == dragFromC) continue;
+                appendPiece(pieceAt(game, r, c), c * tilesize + tilesize / 2.f, r * tilesize + tilesize / 2.f);
+            }
+        }
+        if (isDragging)
+            appendPiece(pieceAt(game, dragFromR, dragFromC), mousePos.x - dragOffset.x, mousePos.y - dragOffset.y);
+
+        overlayVertices.clear();
+        choiceVertices.clear();
+        if (promotionChoice.open)
+        {
+            bool white = promotionChoice.toR == 0;
+            float x = (float)(promotionChoice.toC * tilesize);
+            appendQuad(overlayVertices, 0.f, 0.f, (float)(tilesize * boardsize), (float)(tilesize * boardsize), Color(0, 0, 0, 110));
+            for (int i = 0; i < 4; ++i)
+            {
+                float y = (float)(promotionRow(i) * tilesize);
+                appendQuad(overlayVertices, x, y, (float)tilesize, (float)tilesize, Color(245, 245, 245));
+                char piece = white ? (char)toupper(promotionPieces[i]) : promotionPieces[i];
+                appendPiece(piece, x + tilesize / 2.f, y + tilesize / 2.f, choiceVertices);
+            }
+        }
+
+        // two draw calls for the whole position
+        window.clear();
+        window.draw(boardVertices);
+        if (piecesReady) window.draw(pieceVertices, RenderStates(&pieceAtlas));
+        if (promotionChoice.open)
+        {
+            window.draw(overlayVertices);
+            if (piecesReady) window.draw(choiceVertices, RenderStates(&pieceAtlas));
+        }
+        INSTRUMENT_END();
+        window.display();
+
+        if (!boardShown)
+        {
+            stage("first frame");
+            boardShown = true;
+        }
+        if (piecesReady && measureStartup)
+        {
+            stage("first frame with pieces");
+            window.close();
+        }
+    }
+
+    return 0;
+}
+
@@ -0,0 +1,87 @@
+#include "atlas.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+using namespace sf;
+
+static const char* const pieceNames[PIECE_TYPE_NB] = { "pawn", "knight", "bishop", "rook", "queen", "king" };
+
+string pieceImageName(int color, int type)
+{
+    return string(color == WHITE ? "white-" : "black-") + pieceNames[type];
+}
+
+bool packPieceImages(const string& dir, PieceAtlasImage& atlas)
+{
+    Image images[2][PIECE_TYPE_NB];
+    unsigned cellW = 1, cellH = 1;
+    bool ok = true;
+    for (int color = WHITE; color <= BLACK; ++color)
+    {
+        for (int type = PAWN; type <= KING; ++type)
+        {
+            string name = pieceImageName(color, type);
+            if (!images[color][type].loadFromFile(dir + "/" + name + ".png"))
+            {
+                cerr << "Failed loading " << name << "\n";
+                ok = false;
+            }
+            cellW = max(cellW, images[color][type].getSize().x);
+            cellH = max(cellH, images[color][type].getSize().y);
+        }
+    }
+
+    atlas.image.create(cellW * PIECE_TYPE_NB, cellH * 2, Color::Transparent);
+    for (int color = WHITE; color <= BLACK; ++color)
+    {
+        for (int type = PAWN; type <= KING; ++type)
+        {
+            Vector2u size = images[color][type].getSize();
+            atlas.image.copy(images[color][type], type * cellW, color * cellH);
+            atlas.rects[color][type] = IntRect(type * cellW, color * cellH, size.x, size.y);
+        }
+    }
+    return ok;
+}
+
+bool saveAtlas(const PieceAtlasImage& atlas, const string& imagePath, const string& metadataPath)
+{
+    if (!atlas.image.saveToFile(imagePath)) return false;
+    ofstream meta(metadataPath);
+    for (int color = WHITE; color <= BLACK; ++color)
+    {
+        for (int type = PAWN; type <= KING; ++type)
+        {
+            const IntRect& r = atlas.rects[color][type];
+            meta << pieceImageName(color, type) << ' ' << r.left << ' ' << r.top << ' ' << r.width << ' '
+                 << r.height << '\n';
+        }
+    }
+    return bool(meta);
+}
+
+bool loadAtlas(const string& imagePath, const string& metadataPath, PieceAtlasImage& atlas)
+{
+    ifstream meta(metadataPath);
+    if (!meta) return false;
+
+    int found = 0;
+    string name;
+    IntRect r;
+    while (meta >> name >> r.left >> r.top >> r.width >> r.height)
+    {
+        for (int color = WHITE; color <= BLACK; ++color)
+        {
+            for (int type = PAWN; type <= KING; ++type)
+            {
+                if (name != pieceImageName(color, type)) continue;
+                atlas.rects[color][type] = r;
+                ++found;
+            }
+        }
+    }
+    // a stale or truncated table is treated as no prebaked atlas at all
+    return found == 2 * PIECE_TYPE_NB && atlas.image.loadFromFile(imagePath);
+}
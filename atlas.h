@@ -0,0 +1,24 @@
+#pragma once
+#include <SFML/Graphics.hpp>
+#include <string>
+#include "position.h"
+
+// Piece texture atlas shared by the pack-atlas build step and the window.
+//
+// The twelve pieces/<color>-<piece>.png images sit in one image, white on the top
+// row and black on the bottom, in PNBRQK order. The metadata file is one line per
+// piece: "<color>-<piece> x y width height", so the window can start from a single
+// PNG decode instead of twelve.
+struct PieceAtlasImage
+{
+    sf::Image image;
+    sf::IntRect rects[2][PIECE_TYPE_NB]; // [Side][PieceType]
+};
+
+// the file stem of a piece image, e.g. "white-knight"
+std::string pieceImageName(int color, int type);
+
+// decodes and packs the twelve images from dir; missing ones leave an empty cell
+bool packPieceImages(const std::string& dir, PieceAtlasImage& atlas);
+bool saveAtlas(const PieceAtlasImage& atlas, const std::string& imagePath, const std::string& metadataPath);
+bool loadAtlas(const std::string& imagePath, const std::string& metadataPath, PieceAtlasImage& atlas);
@@ -0,0 +1,328 @@
+// Rules-engine benchmark over a fixed position corpus, with a regression gate.
+//
+//   chess-bench <corpus.fen> [--warmup n] [--rounds n] [--reps n] [--baseline file] [--threshold pct]
+//               [--save file]
+//
+// Each kernel (a rules query, move generation or make/unmake) runs over every corpus
+// position. A sample times enough passes to last about 1 ms and divides by the calls made.
+// After the warm-up passes the kernels are measured in many short rounds, taking turns, so
+// a busy spell on the machine slows a round of every kernel rather than every round of
+// one. A kernel's time is the lowest of its round medians (noise only ever adds time); p99
+// is over all its samples. Against a baseline, a kernel more than the threshold slower is
+// measured for up to as many rounds again before it counts as a regression; one that is
+// still slower, or whose results no longer match the baseline's checksum, fails the run
+// (exit code 1), as does a missing baseline file. Only --save records a baseline. The
+// bench / bench-baseline build targets run this over bench.fen.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "movegen.h"
+#include "rules.h"
+
+using namespace std;
+
+struct CorpusEntry
+{
+    unique_ptr<Position> pos;
+    MoveList moves; // legal moves, generated once for the make/unmake kernel
+};
+
+typedef vector<CorpusEntry> Corpus;
+
+const double SAMPLE_NS = 1e6;
+
+// ---- kernels: one pass over the corpus, returning a checksum of the answers ----
+
+static uint64_t benchValidMove(Corpus& corpus, uint64_t& calls)
+{
+    uint64_t sum = 0;
+    for (CorpusEntry& e : corpus)
+        for (int from = 0; from < 64; ++from)
+            for (int to = 0; to < 64; ++to)
+                sum += isValidMove(*e.pos, from / 8, from % 8, to / 8, to % 8);
+    calls = corpus.size() * 64 * 64;
+    return sum;
+}
+
+static uint64_t benchKingInCheck(Corpus& corpus, uint64_t& calls)
+{
+    uint64_t sum = 0;
+    for (CorpusEntry& e : corpus) sum += isKingInCheck(*e.pos, true) * 2 + isKingInCheck(*e.pos, false);
+    calls = corpus.size() * 2;
+    return sum;
+}
+
+static uint64_t benchCheckmate(Corpus& corpus, uint64_t& calls)
+{
+    uint64_t sum = 0;
+    for (CorpusEntry& e : corpus) sum += isCheckmate(*e.pos, e.pos->whiteToMove);
+    calls = corpus.size();
+    return sum;
+}
+
+static uint64_t benchStalemate(Corpus& corpus, uint64_t& calls)
+{
+    uint64_t sum = 0;
+    for (CorpusEntry& e : corpus) sum += isStalemate(*e.pos, e.pos->whiteToMove);
+    calls = corpus.size();
+    return sum;
+}
+
+static uint64_t benchMoveGen(Corpus& corpus, uint64_t& calls)
+{
+    uint64_t sum = 0;
+    MoveList list;
+    for (CorpusEntry& e : corpus)
+    {
+        generateLegalMoves(*e.pos, list);
+        sum += list.count;
+    }
+    calls = corpus.size();
+    return sum;
+}
+
+static uint64_t benchMakeUnmake(Corpus& corpus, uint64_t& calls)
+{
+    uint64_t sum = 0;
+    calls = 0;
+    for (CorpusEntry& e : corpus)
+    {
+        for (int i = 0; i < e.moves.count; ++i)
+        {
+            makeMove(*e.pos, e.moves.moves[i]);
+            sum += e.pos->key >> 48;
+            unmakeMove(*e.pos);
+        }
+        calls += e.moves.count;
+    }
+    return sum;
+}
+
+struct Kernel
+{
+    const char* name;
+    uint64_t (*run)(Corpus& corpus, uint64_t& calls);
+};
+
+static const Kernel kernels[] = {
+    { "isValidMove", benchValidMove },
+    { "isKingInCheck", benchKingInCheck },
+    { "isCheckmate", benchCheckmate },
+    { "isStalemate", benchStalemate },
+    { "generateLegalMoves", benchMoveGen },
+    { "makeMove+unmakeMove", benchMakeUnmake },
+};
+
+// ---- baseline file: "<kernel> <median ns> <p99 ns> <checksum>" per line ----
+
+struct Timing
+{
+    double median = 0, p99 = 0;
+    uint64_t checksum = 0;
+};
+
+static bool readBaseline(const string& path, map<string, Timing>& baseline)
+{
+    ifstream in(path);
+    if (!in) return false;
+    string line;
+    while (getline(in, line))
+    {
+        if (line.empty() || line[0] == '#') continue;
+        istringstream fields(line);
+        string name;
+        Timing t;
+        if (fields >> name >> t.median >> t.p99 >> t.checksum) baseline[name] = t;
+    }
+    return true;
+}
+
+static bool writeBaseline(const string& path, const vector<pair<string, Timing>>& results)
+{
+    ofstream out(path);
+    out << "# chess-bench baseline: kernel, median ns/call, p99 ns/call, result checksum\n";
+    char line[160];
+    for (const auto& r : results)
+    {
+        snprintf(line, sizeof(line), "%s %.3f %.3f %llu\n", r.first.c_str(), r.second.median, r.second.p99,
+                 (unsigned long long)r.second.checksum);
+        out << line;
+    }
+    return bool(out);
+}
+
+static int usage()
+{
+    cout << "usage: chess-bench <corpus.fen> [--warmup n] [--rounds n] [--reps n] [--baseline file] [--threshold pct]\n"
+         << "                   [--save file]\n"
+         << "  times the rules queries over every corpus position (lowest round median / p99 ns per call); with a\n"
+         << "  baseline, exits 1 when a kernel is still more than threshold percent (default 15) slower after being\n"
+         << "  re-measured, when its results differ or when the baseline file is missing (record one with --save)\n";
+    return 1;
+}
+
+struct Measurement
+{
+    const Kernel* kernel;
+    int passes = 1; // per sample
+    uint64_t calls = 0, checksum = 0;
+    double best = 0; // lowest round median
+    vector<double> samples;
+};
+
+// one round: reps samples, each timing m.passes passes; returns their median
+static double measureRound(Corpus& corpus, Measurement& m, int reps)
+{
+    vector<double> round;
+    for (int i = 0; i < reps; ++i)
+    {
+        auto start = chrono::steady_clock::now();
+        for (int p = 0; p < m.passes; ++p) m.checksum = m.kernel->run(corpus, m.calls);
+        double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+        round.push_back(ns / (double(m.calls) * m.passes));
+    }
+    m.samples.insert(m.samples.end(), round.begin(), round.end());
+    sort(round.begin(), round.end());
+    double median = round[round.size() / 2];
+    if (m.best == 0 || median < m.best) m.best = median;
+    return median;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) return usage();
+    string corpusPath = argv[1], baselinePath, savePath;
+    int warmup = 10, rounds = 20, reps = 5;
+    double threshold = 15;
+    for (int i = 2; i < argc; ++i)
+    {
+        string option = argv[i];
+        if (option == "--warmup" && i + 1 < argc) warmup = max(0, atoi(argv[++i]));
+        else if (option == "--rounds" && i + 1 < argc) rounds = max(1, atoi(argv[++i]));
+        else if (option == "--reps" && i + 1 < argc) reps = max(1, atoi(argv[++i]));
+        else if (option == "--baseline" && i + 1 < argc) baselinePath = argv[++i];
+        else if (option == "--threshold" && i + 1 < argc) threshold = atof(argv[++i]);
+        else if (option == "--save" && i + 1 < argc) savePath = argv[++i];
+        else return usage();
+    }
+
+    Corpus corpus;
+    ifstream in(corpusPath);
+    if (!in)
+    {
+        cerr << "cannot read " << corpusPath << "\n";
+        return 1;
+    }
+    string line;
+    for (int number = 1; getline(in, line); ++number)
+    {
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == string::npos || line[first] == '#') continue;
+        CorpusEntry e;
+        e.pos.reset(new Position());
+        if (!setFromFen(*e.pos, line))
+        {
+            cerr << corpusPath << ":" << number << ": invalid FEN\n";
+            return 1;
+        }
+        generateLegalMoves(*e.pos, e.moves);
+        corpus.push_back(move(e));
+    }
+    if (corpus.empty())
+    {
+        cerr << "no positions in " << corpusPath << "\n";
+        return 1;
+    }
+
+    map<string, Timing> baseline;
+    bool haveBaseline = !baselinePath.empty();
+    if (haveBaseline && !readBaseline(baselinePath, baseline))
+    {
+        cerr << "no baseline at " << baselinePath << ": record one with --save (the bench-baseline target)\n";
+        return 1;
+    }
+
+    cout << "Corpus:    " << corpus.size() << " positions from " << corpusPath << ", " << warmup << " warm-up passes + "
+         << rounds << " rounds of " << reps << " samples per kernel\n";
+    if (haveBaseline) cout << "Baseline:  " << baselinePath << ", failing above +" << threshold << "%\n";
+    fflush(stdout);
+
+    // short kernels are repeated so the clock's resolution and overhead do not count
+    vector<Measurement> measurements;
+    for (const Kernel& k : kernels)
+    {
+        Measurement m;
+        m.kernel = &k;
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < max(warmup, 1); ++i) m.checksum = k.run(corpus, m.calls);
+        double passNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / max(warmup, 1);
+        m.passes = max(1, int(SAMPLE_NS / max(passNs, 1.0)));
+        measurements.push_back(move(m));
+    }
+    for (int round = 0; round < rounds; ++round)
+        for (Measurement& m : measurements) measureRound(corpus, m, reps);
+
+    printf("%-22s %10s %10s %10s %10s %8s\n", "kernel", "calls/pass", "median", "p99", "baseline", "change");
+    vector<pair<string, Timing>> results;
+    int regressions = 0;
+    for (Measurement& m : measurements)
+    {
+        auto base = baseline.find(m.kernel->name);
+        bool known = base != baseline.end();
+        int rechecks = 0;
+        // a slow reading is measured again before it counts
+        while (known && base->second.checksum == m.checksum && rechecks < rounds &&
+               100 * (m.best / base->second.median - 1) > threshold)
+        {
+            measureRound(corpus, m, reps);
+            rechecks++;
+        }
+
+        sort(m.samples.begin(), m.samples.end());
+        Timing t;
+        t.median = m.best;
+        t.p99 = m.samples[min(m.samples.size() - 1, size_t(ceil(0.99 * m.samples.size())) - 1)];
+        t.checksum = m.checksum;
+        results.push_back({ m.kernel->name, t });
+
+        char medianText[32], p99Text[32], baseText[32] = "-", change[32] = "";
+        snprintf(medianText, sizeof(medianText), "%.2f ns", t.median);
+        snprintf(p99Text, sizeof(p99Text), "%.2f ns", t.p99);
+        string verdict = haveBaseline ? "new" : "";
+        if (known)
+        {
+            double percent = 100 * (t.median / base->second.median - 1);
+            snprintf(baseText, sizeof(baseText), "%.2f ns", base->second.median);
+            snprintf(change, sizeof(change), "%+.1f%%", percent);
+            verdict = "ok";
+            if (base->second.checksum != t.checksum) verdict = "RESULTS DIFFER";
+            else if (percent > threshold) verdict = "REGRESSION";
+            if (base->second.checksum != t.checksum || percent > threshold) regressions++;
+            if (rechecks) verdict += " (" + to_string(rechecks) + " more round" + (rechecks == 1 ? ")" : "s)");
+        }
+        printf("%-22s %10llu %10s %10s %10s %8s  %s\n", m.kernel->name, (unsigned long long)m.calls, medianText,
+               p99Text, baseText, change, verdict.c_str());
+        fflush(stdout);
+    }
+
+    if (!savePath.empty())
+    {
+        if (!writeBaseline(savePath, results))
+        {
+            cerr << "cannot write " << savePath << "\n";
+            return 1;
+        }
+        cout << "saved baseline to " << savePath << "\n";
+    }
+    if (regressions) cout << regressions << " kernel" << (regressions == 1 ? "" : "s") << " regressed\n";
+    return regressions ? 1 : 0;
+}
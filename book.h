@@ -0,0 +1,79 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "mappedfile.h"
+#include "position.h"
+
+// Polyglot opening books (".bin"): 16-byte big-endian entries (key u64, move u16,
+// weight u16, learn u32) sorted by key. The key is Polyglot's own position hash, an
+// XOR of 781 published random numbers (one per piece kind and square, four castling
+// rights, eight en passant files and the side to move). Those numbers are built in; a
+// text file of 781 hex values, in order, can replace them, but is only accepted if it
+// reproduces the published keys of the Polyglot test positions, so a mistyped or
+// misordered one cannot silently miss every book entry.
+//
+// The book is memory-mapped and searched in place, so a lookup reads a handful of
+// pages (log2(entries) probes, then the run of entries for the position).
+
+struct BookMove
+{
+    Move move;
+    int weight;
+};
+
+enum BookPick { BOOK_BEST, BOOK_WEIGHTED };
+
+class PolyglotKeys
+{
+public:
+    // the built-in table
+    PolyglotKeys();
+    // replaces the table; false (table unchanged) if the file does not hold 781 values
+    // or they fail verify()
+    bool load(const std::string& path);
+    uint64_t key(const Position& pos) const;
+    // the table gives the start position 463b96181691fc9c, 1.e4 823c9b50fd114196 and the
+    // other keys of the Polyglot documentation's test sequences (castling, en passant,
+    // king moves, captures)
+    bool verify() const;
+
+private:
+    uint64_t random64[781];
+};
+
+class OpeningBook
+{
+public:
+    // keysPath: a key table to use instead of the built-in one (see PolyglotKeys::load)
+    bool open(const std::string& path, const std::string& keysPath = "");
+    void close() { file.close(); }
+    bool isOpen() const { return file.isOpen(); }
+    size_t entryCount() const { return file.size() / 16; }
+    const PolyglotKeys& polyglotKeys() const { return keys; }
+
+    // the legal book moves for the position, heaviest first
+    std::vector<BookMove> probe(const Position& pos) const;
+    // BOOK_BEST: the heaviest move; BOOK_WEIGHTED: chosen with probability proportional
+    // to weight, using random (any 64-bit value, e.g. from the caller's generator).
+    // NO_MOVE when the position is not in the book.
+    Move pick(const Position& pos, BookPick how, uint64_t random) const;
+
+private:
+    MappedFile file;
+    PolyglotKeys keys;
+};
+
+struct BookBuildStats
+{
+    size_t games = 0;
+    size_t positions = 0;
+    size_t entries = 0;
+    size_t damagedGames = 0; // used only up to their first illegal move
+};
+
+// Writes a Polyglot book of the first maxPlies plies of every game of a .cgf archive.
+// A move's weight is 2 per win and 1 per draw for the side that played it; moves that
+// only ever lost are left out.
+bool buildBook(const std::string& archivePath, const std::string& bookPath, const PolyglotKeys& keys,
+               int maxPlies, BookBuildStats* stats = nullptr);
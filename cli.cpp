@@ -0,0 +1,1021 @@
+// Headless front end for the chessrules library.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "book.h"
+#include "evaluate.h"
+#include "gamefile.h"
+#include "instrument.h"
+#include "mappedfile.h"
+#include "movegen.h"
+#include "nnue.h"
+#include "pgn.h"
+#include "posindex.h"
+#include "rules.h"
+#include "search.h"
+#include "server.h"
+#include "syzygy.h"
+#include "tournament.h"
+#include "tt.h"
+#include "uci.h"
+
+using namespace std;
+
+static void printUsage()
+{
+    cout << "usage: chess-cli <command> [args]\n"
+         << "  --uci                 speak UCI on stdin/stdout (for GUIs, tournament managers, batch jobs)\n"
+         << "  perft <depth> [fen]   count leaf nodes with a per-move divide and nodes/sec\n"
+         << "  search <depth> [--movetime ms] [--nodes n] [--hash mb] [--hugepages 1] [--threads n] [--syzygy dirs]\n"
+         << "         [--nnue file] [fen]\n"
+         << "                        iterative-deepening search; depth 0 = until another limit hits\n"
+         << "  tablebase <dirs> [fen]\n"
+         << "                        Syzygy WDL / DTZ of a position and of each of its moves\n"
+         << "  attacks [millions]    micro-benchmark: ray-walk / delta checks vs attack tables (magic, PEXT)\n"
+         << "  makennue <out.nnue>   write the network equivalent of the piece-square evaluation\n"
+         << "  evalbench <file.nnue> [thousands] [fen]\n"
+         << "                        evals/sec and accumulator updates/sec per kernel (scalar, SSE4.1, AVX2)\n"
+         << "  validate <file.pgn|file.epd> [--threads n] [--errors]\n"
+         << "                        replay every game / record, one verdict line each, plus games/sec and MB/sec\n"
+         << "  archive <in.pgn> <out.cgf> [--append]\n"
+         << "                        store the legal games of a PGN file in the binary game format\n"
+         << "  games <file.cgf> [n]  archive summary, or game n (from 0) as SAN movetext\n"
+         << "  find <file.cgf> [fen] every game and ply reaching a position\n"
+         << "  index <file.cgf> <file.cpi> [--threads n] [--compact]\n"
+         << "                        build the position index of an archive, or add the games appended since\n"
+         << "  lookup <file.cpi> [fen]\n"
+         << "                        every game and ply reaching a position, through the index\n"
+         << "  book <file.bin> [--keys file] [fen]\n"
+         << "                        Polyglot book moves with weights for a position, and the lookup time\n"
+         << "  makebook <file.cgf> <out.bin> [--keys file] [--plies n]\n"
+         << "                        Polyglot book of the openings of an archive (weight 2 per win, 1 per draw)\n"
+         << "  serve [socket] [--workers n] [--sessions n]\n"
+         << "                        host many games over a Unix socket (stdin/stdout without one)\n"
+         << "  loadgen <socket> [--connections n] [--sessions n] [--games n] [--plies n] [--interval s]\n"
+         << "                        random games against a server: throughput, latency percentiles, capacity\n"
+         << "  selfplay [--games n] [--depth n] [--nodes n] [--movetime ms] [--nnue file] [--depth-b n] [--nodes-b n]\n"
+         << "         [--movetime-b ms] [--nnue-b file] [--openings file.epd] [--random-plies n] [--workers n]\n"
+         << "         [--hash mb] [--plies n] [--cgf out.cgf | --pgn out.pgn] [--sprt elo0 elo1] [--alpha a] [--beta b]\n"
+         << "         [--report n]\n"
+         << "                        engine A vs engine B over all cores (limits set both, -b forms override B):\n"
+         << "                        score, Elo, SPRT, games/hour per core and scheduler idle time\n"
+         << "  smp <depth> [threads] [fen]\n"
+         << "                        fixed-depth search at 1, 2, 4, ... threads: nodes/sec and time-to-depth speedup\n";
+}
+
+// joins argv[first..] back into one FEN string; defaults to the start position
+static string fenFromArgs(int argc, char** argv, int first)
+{
+    string fen;
+    for (int i = first; i < argc; ++i) fen += (fen.empty() ? "" : " ") + string(argv[i]);
+    return fen.empty() ? string(START_FEN) : fen;
+}
+
+static int runPerft(int argc, char** argv)
+{
+    if (argc < 3) { printUsage(); return 1; }
+    int depth = atoi(argv[2]);
+    Position pos;
+    string fen = fenFromArgs(argc, argv, 3);
+    if (depth < 1 || !setFromFen(pos, fen))
+    {
+        cerr << "invalid depth or FEN: " << fen << "\n";
+        return 1;
+    }
+
+    auto start = chrono::steady_clock::now();
+
+    // divide: subtree size under each root move, handy for diffing against a reference engine
+    MoveList list;
+    generateLegalMoves(pos, list);
+    uint64_t total = 0;
+    for (int i = 0; i < list.count; ++i)
+    {
+        makeMove(pos, list.moves[i]);
+        uint64_t nodes = perft(pos, depth - 1);
+        unmakeMove(pos);
+        cout << moveToUci(list.moves[i]) << ": " << nodes << "\n";
+        total += nodes;
+    }
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "\nMoves: " << list.count << "\n"
+         << "Nodes: " << total << "\n"
+         << "Time:  " << (uint64_t)(seconds * 1000) << " ms\n"
+         << "NPS:   " << (uint64_t)(seconds > 0 ? total / seconds : 0) << "\n";
+    return 0;
+}
+
+static string pvToString(const vector<Move>& pv)
+{
+    string s;
+    for (Move m : pv) s += (s.empty() ? "" : " ") + moveToUci(m);
+    return s;
+}
+
+static int runSearch(int argc, char** argv)
+{
+    if (argc < 3) { printUsage(); return 1; }
+    SearchLimits limits;
+    limits.depth = atoi(argv[2]);
+    size_t hashMb = 16;
+    bool hugePages = false;
+    int threads = 1;
+    string syzygyPath, nnuePath;
+
+    int next = 3;
+    for (; next + 1 < argc && string(argv[next]).rfind("--", 0) == 0; next += 2)
+    {
+        string option = argv[next];
+        if (option == "--movetime") limits.movetimeMs = atoll(argv[next + 1]);
+        else if (option == "--nodes") limits.nodes = strtoull(argv[next + 1], nullptr, 10);
+        else if (option == "--hash") hashMb = strtoull(argv[next + 1], nullptr, 10);
+        else if (option == "--hugepages") hugePages = atoi(argv[next + 1]) != 0;
+        else if (option == "--threads") threads = atoi(argv[next + 1]);
+        else if (option == "--syzygy") syzygyPath = argv[next + 1];
+        else if (option == "--nnue") nnuePath = argv[next + 1];
+        else { printUsage(); return 1; }
+    }
+    if (limits.depth <= 0 && !limits.movetimeMs && !limits.nodes)
+    {
+        cerr << "search needs a depth, --movetime or --nodes limit\n";
+        return 1;
+    }
+
+    Position pos;
+    string fen = fenFromArgs(argc, argv, next);
+    if (!setFromFen(pos, fen))
+    {
+        cerr << "invalid FEN: " << fen << "\n";
+        return 1;
+    }
+
+    TranspositionTable tt;
+    if (hashMb && !tt.resize(hashMb, hugePages))
+    {
+        cerr << "cannot allocate " << hashMb << " MB hash\n";
+        return 1;
+    }
+    Tablebases tablebases;
+    if (!syzygyPath.empty() && !tablebases.init(syzygyPath))
+        cerr << "no Syzygy tables in " << syzygyPath << "\n";
+    NnueNetwork network;
+    if (!nnuePath.empty())
+    {
+        if (!network.load(nnuePath))
+        {
+            cerr << "cannot load network " << nnuePath << "\n";
+            return 1;
+        }
+        attachNetwork(pos, &network);
+    }
+
+    // one line per completed depth; time-to-depth and nps are the numbers to track
+    SearchResult result = search(pos, limits, [&tt](const SearchReport& r) {
+        cout << "info depth " << r.depth << " score " << formatScore(r.score)
+             << " nodes " << r.nodes << " time " << r.timeMs
+             << " nps " << (r.timeMs > 0 ? r.nodes * 1000 / r.timeMs : r.nodes)
+             << " hashfull " << tt.hashfull()
+             << " pv " << pvToString(r.pv) << endl;
+    }, nullptr, hashMb ? &tt : nullptr, threads, tablebases.tableCount() ? &tablebases : nullptr);
+
+    cout << "bestmove " << (result.bestMove ? moveToUci(result.bestMove) : string("(none)")) << "\n"
+         << "Depth: " << result.depth << "\n"
+         << "Nodes: " << result.nodes << "\n"
+         << "Time:  " << result.timeMs << " ms\n"
+         << "NPS:   " << (result.timeMs > 0 ? result.nodes * 1000 / result.timeMs : result.nodes) << "\n";
+    if (hashMb)
+        cout << "Hash:  " << tt.sizeMb() << " MB" << (tt.usingHugePages() ? " (huge pages)" : "")
+             << ", probes " << tt.probes() << ", hits " << tt.hits()
+             << " (" << int(tt.hitRate() * 1000) / 10.0 << "%), stores " << tt.stores()
+             << ", hashfull " << tt.hashfull() << "\n";
+    if (pos.network)
+        cout << "Eval:  " << nnuePath << " (" << nnueKernelName(activeNnueKernel()) << ")\n";
+    if (tablebases.tableCount())
+        cout << "TB:    " << tablebases.tableCount() << " tables (up to " << tablebases.maxPieces()
+             << " pieces), probes " << tablebases.probes() << ", hits " << tablebases.hits()
+             << " (" << int(tablebases.hitRate() * 1000) / 10.0 << "%)\n";
+    return 0;
+}
+
+static string wdlText(int wdl)
+{
+    static const char* names[] = { "loss", "blessed loss", "draw", "cursed win", "win" };
+    return names[wdl + 2];
+}
+
+static int runTablebase(int argc, char** argv)
+{
+    if (argc < 3) { printUsage(); return 1; }
+    Tablebases tablebases;
+    if (!tablebases.init(argv[2]))
+    {
+        cerr << "no Syzygy tables in " << argv[2] << "\n";
+        return 1;
+    }
+    unique_ptr<Position> pos(new Position());
+    string fen = fenFromArgs(argc, argv, 3);
+    if (!setFromFen(*pos, fen))
+    {
+        cerr << "invalid FEN: " << fen << "\n";
+        return 1;
+    }
+
+    int wdl, dtz;
+    auto start = chrono::steady_clock::now();
+    if (!tablebases.probeWdl(*pos, wdl) || !tablebases.probeDtz(*pos, dtz))
+    {
+        cerr << "position not in the tables (" << tablebases.tableCount() << " tables, up to "
+             << tablebases.maxPieces() << " pieces)\n";
+        return 1;
+    }
+    double us = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+    cout << "WDL:   " << wdlText(wdl) << "\n"
+         << "DTZ:   " << dtz << "\n"
+         << "Time:  " << fixed << setprecision(1) << us << " us (tables mapped on first probe)\n";
+
+    MoveList list, best;
+    generateLegalMoves(*pos, list);
+    best = list;
+    int rootWdl;
+    bool filtered = tablebases.filterRootMoves(*pos, best, rootWdl);
+    for (int i = 0; i < list.count; ++i)
+    {
+        Move m = list.moves[i];
+        makeMove(*pos, m);
+        bool ok = tablebases.probeWdl(*pos, wdl) && tablebases.probeDtz(*pos, dtz);
+        unmakeMove(*pos);
+        bool kept = filtered && find(best.moves, best.moves + best.count, m) != best.moves + best.count;
+        cout << setw(6) << moveToUci(m) << "  ";
+        if (ok) cout << setw(12) << wdlText(-wdl) << "  dtz " << setw(4) << -dtz << (kept ? "  best" : "") << "\n";
+        else cout << "not in the tables\n";
+    }
+    return 0;
+}
+
+// The pre-table attack checks (step along the ray with a branch per cell, abs() deltas
+// for the leapers), kept only as the benchmark baseline.
+static bool walkSliderAttack(bool rook, int from, int to, Bitboard occupied)
+{
+    int dr = to / 8 - from / 8, df = to % 8 - from % 8;
+    if (rook ? (dr != 0 && df != 0) : (dr == 0 || abs(dr) != abs(df))) return false;
+    int sr = (dr > 0) - (dr < 0), sf = (df > 0) - (df < 0);
+    for (int r = from / 8 + sr, f = from % 8 + sf; r * 8 + f != to; r += sr, f += sf)
+        if (occupied & squareBB(r * 8 + f)) return false;
+    return true;
+}
+
+static bool deltaKnightAttack(int from, int to)
+{
+    int dr = abs(to / 8 - from / 8), df = abs(to % 8 - from % 8);
+    return (dr == 1 && df == 2) || (dr == 2 && df == 1);
+}
+
+static bool deltaKingAttack(int from, int to)
+{
+    return max(abs(to / 8 - from / 8), abs(to % 8 - from % 8)) == 1;
+}
+
+struct AttackQuery
+{
+    int from, to;
+    Bitboard occupied;
+};
+
+// runs one canPieceAttackSquare-style check over every query; the hit count doubles as a
+// cross-check that all implementations agree
+template <class Check>
+static void timeAttackCheck(const char* name, const vector<AttackQuery>& queries, int rounds, Check check)
+{
+    uint64_t hits = 0;
+    auto start = chrono::steady_clock::now();
+    for (int round = 0; round < rounds; ++round)
+        for (const AttackQuery& q : queries) hits += check(q);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    double queriesRun = double(queries.size()) * rounds;
+    printf("%-22s %8.2f ns/query  %8.1f M/s  hits %llu\n", name, seconds * 1e9 / queriesRun,
+           queriesRun / seconds / 1e6, (unsigned long long)hits);
+}
+
+static int runAttackBench(int argc, char** argv)
+{
+    int millions = argc > 2 ? atoi(argv[2]) : 20;
+    if (millions < 1) millions = 1;
+
+    // random boards at roughly middlegame density, from != to
+    vector<AttackQuery> queries(1 << 16);
+    uint64_t seed = 2546;
+    auto next = [&seed]() {
+        seed ^= seed >> 12; seed ^= seed << 25; seed ^= seed >> 27;
+        return seed * 2685821657736338717ULL;
+    };
+    for (AttackQuery& q : queries)
+    {
+        q.from = next() % 64;
+        do q.to = next() % 64; while (q.to == q.from);
+        q.occupied = (next() & next()) | squareBB(q.from);
+    }
+    int rounds = int(millions * 1000000LL / queries.size()) + 1;
+
+    bool hasPext = initSliderTables(LOOKUP_PEXT);
+    initSliderTables(LOOKUP_MAGIC);
+    auto tableRook = [](const AttackQuery& q) { return (rookAttacks(q.from, q.occupied) >> q.to) & 1; };
+    auto tableBishop = [](const AttackQuery& q) { return (bishopAttacks(q.from, q.occupied) >> q.to) & 1; };
+
+    timeAttackCheck("knight delta", queries, rounds, [](const AttackQuery& q) { return deltaKnightAttack(q.from, q.to); });
+    timeAttackCheck("knight table", queries, rounds, [](const AttackQuery& q) { return (knightAttackTable[q.from] >> q.to) & 1; });
+    timeAttackCheck("king delta", queries, rounds, [](const AttackQuery& q) { return deltaKingAttack(q.from, q.to); });
+    timeAttackCheck("king table", queries, rounds, [](const AttackQuery& q) { return (kingAttackTable[q.from] >> q.to) & 1; });
+    timeAttackCheck("rook ray-walk", queries, rounds, [](const AttackQuery& q) { return walkSliderAttack(true, q.from, q.to, q.occupied); });
+    timeAttackCheck("rook magic", queries, rounds, tableRook);
+    timeAttackCheck("bishop ray-walk", queries, rounds, [](const AttackQuery& q) { return walkSliderAttack(false, q.from, q.to, q.occupied); });
+    timeAttackCheck("bishop magic", queries, rounds, tableBishop);
+    if (hasPext)
+    {
+        initSliderTables(LOOKUP_PEXT);
+        timeAttackCheck("rook pext", queries, rounds, tableRook);
+        timeAttackCheck("bishop pext", queries, rounds, tableBishop);
+    }
+    else
+        cout << "pext: not supported by this CPU\n";
+
+    initSliderTables(cpuHasFastPext() ? LOOKUP_PEXT : LOOKUP_MAGIC);
+    cout << "default slider lookup: " << (pextLookups ? "pext" : "magic") << "\n";
+    return 0;
+}
+
+static int runMakeNnue(int argc, char** argv)
+{
+    if (argc < 3) { printUsage(); return 1; }
+    if (!writePieceSquareNetwork(argv[2]))
+    {
+        cerr << "cannot write " << argv[2] << "\n";
+        return 1;
+    }
+    cout << "wrote " << argv[2] << "\n";
+    return 0;
+}
+
+template <class Step>
+static void timeEvalStep(const char* name, const vector<unique_ptr<Position>>& positions, int rounds, Step step)
+{
+    int64_t sum = 0;
+    uint64_t count = 0;
+    auto start = chrono::steady_clock::now();
+    for (int round = 0; round < rounds; ++round)
+        for (const auto& pos : positions) count += step(*pos, sum);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    printf("%-22s %8.2f ns/op  %8.2f M/s  checksum %lld\n", name, seconds * 1e9 / count, count / seconds / 1e6,
+           (long long)sum);
+}
+
+// Positions from a fixed-seed random game; each kernel evaluates them all, plays and takes
+// back every legal move (two accumulator updates each) and rebuilds the accumulators from
+// scratch. The checksums must match across kernels.
+static int runEvalBench(int argc, char** argv)
+{
+    if (argc < 3) { printUsage(); return 1; }
+    NnueNetwork network;
+    if (!network.load(argv[2]))
+    {
+        cerr << "cannot load network " << argv[2] << "\n";
+        return 1;
+    }
+    int thousands = argc > 3 ? atoi(argv[3]) : 1000;
+    if (thousands < 1) thousands = 1;
+    unique_ptr<Position> start(new Position());
+    string fen = fenFromArgs(argc, argv, 4);
+    if (!setFromFen(*start, fen))
+    {
+        cerr << "invalid FEN: " << fen << "\n";
+        return 1;
+    }
+
+    vector<unique_ptr<Position>> positions;
+    uint64_t seed = 2546;
+    unique_ptr<Position> game(new Position(*start));
+    while (positions.size() < 64)
+    {
+        MoveList list;
+        generateLegalMoves(*game, list);
+        if (list.count == 0 || game->halfmoveClock >= 100 || game->historySize >= 200)
+        {
+            *game = *start;
+            continue;
+        }
+        positions.emplace_back(new Position(*game));
+        seed ^= seed >> 12; seed ^= seed << 25; seed ^= seed >> 27;
+        makeMove(*game, list.moves[(seed * 2685821657736338717ULL >> 32) % list.count]);
+    }
+    int rounds = int(thousands * 1000LL / positions.size()) + 1;
+    int moveRounds = rounds / 32 + 1;
+
+    auto evaluateOne = [](Position& pos, int64_t& sum) { sum += evaluate(pos); return 1; };
+    auto playAll = [](Position& pos, int64_t& sum) {
+        MoveList list;
+        generateLegalMoves(pos, list);
+        for (int i = 0; i < list.count; ++i)
+        {
+            makeMove(pos, list.moves[i]);
+            sum += pos.accumulator[WHITE][0];
+            unmakeMove(pos);
+        }
+        return 2 * list.count;
+    };
+    auto refresh = [](Position& pos, int64_t& sum) {
+        refreshAccumulators(pos);
+        sum += pos.accumulator[BLACK][0];
+        return 1;
+    };
+
+    timeEvalStep("piece-square eval", positions, rounds, evaluateOne);
+    timeEvalStep("make/unmake, no net", positions, moveRounds, playAll);
+    NnueKernel best = activeNnueKernel();
+    for (int k = NNUE_SCALAR; k <= NNUE_AVX2; ++k)
+    {
+        string name = nnueKernelName(NnueKernel(k));
+        if (!selectNnueKernel(NnueKernel(k)))
+        {
+            cout << name << ": not supported by this CPU\n";
+            continue;
+        }
+        for (auto& pos : positions) attachNetwork(*pos, &network);
+        timeEvalStep((name + " eval").c_str(), positions, rounds, evaluateOne);
+        timeEvalStep((name + " make/unmake").c_str(), positions, moveRounds, playAll);
+        timeEvalStep((name + " refresh").c_str(), positions, rounds / 8 + 1, refresh);
+    }
+    selectNnueKernel(best);
+    cout << "default kernel: " << nnueKernelName(best) << "\n";
+    return 0;
+}
+
+// Lazy SMP scaling: the same fixed-depth search with a fresh table at each thread count.
+// Speedup is time-to-depth against one thread; helpers also widen the tree, so nps grows
+// faster than the speedup does.
+static int runSmpBench(int argc, char** argv)
+{
+    if (argc < 3) { printUsage(); return 1; }
+    SearchLimits limits;
+    limits.depth = atoi(argv[2]);
+    int maxThreads = argc > 3 ? atoi(argv[3]) : (int)thread::hardware_concurrency();
+    if (maxThreads < 1) maxThreads = 1;
+    Position pos;
+    string fen = fenFromArgs(argc, argv, 4);
+    if (limits.depth < 1 || !setFromFen(pos, fen))
+    {
+        cerr << "invalid depth or FEN: " << fen << "\n";
+        return 1;
+    }
+
+    int64_t baseTime = 0;
+    vector<int> counts;
+    for (int n = 1; n < maxThreads; n *= 2) counts.push_back(n);
+    counts.push_back(maxThreads);
+
+    cout << "threads  depth  bestmove        nodes   time(ms)         nps  speedup\n";
+    for (int n : counts)
+    {
+        TranspositionTable tt;
+        tt.resize(64);
+        SearchResult result = search(pos, limits, nullptr, nullptr, &tt, n);
+        int64_t ms = result.timeMs > 0 ? result.timeMs : 1;
+        if (n == 1) baseTime = ms;
+        printf("%7d  %5d  %8s  %11llu  %9lld  %10llu  %6.2fx\n", n, result.depth,
+               moveToUci(result.bestMove).c_str(), (unsigned long long)result.nodes, (long long)ms,
+               (unsigned long long)(result.nodes * 1000 / ms), double(baseTime) / ms);
+    }
+    return 0;
+}
+
+// Validation walks the mapped file in fixed-size batches. Batch boundaries are snapped to
+// game starts independently by whichever worker takes the batch, so no one has to scan
+// ahead. Finished batches are printed in order; at most `window` are in flight, which
+// keeps memory constant however large the archive is.
+const size_t VALIDATE_BATCH_BYTES = 1 << 20;
+
+struct ValidateBatch
+{
+    string verdicts; // one line per game, without the game number
+    uint64_t games = 0;
+    uint64_t failed = 0;
+    bool done = false;
+};
+
+static int runValidate(int argc, char** argv)
+{
+    if (argc < 3) { printUsage(); return 1; }
+    string path = argv[2];
+    int threads = (int)thread::hardware_concurrency();
+    bool errorsOnly = false;
+    for (int i = 3; i < argc; ++i)
+    {
+        string option = argv[i];
+        if (option == "--threads" && i + 1 < argc) threads = atoi(argv[++i]);
+        else if (option == "--errors") errorsOnly = true;
+        else { printUsage(); return 1; }
+    }
+    if (threads < 1) threads = 1;
+
+    MappedFile file;
+    if (!file.open(path, true))
+    {
+        cerr << "cannot open " << path << "\n";
+        return 1;
+    }
+    string_view text(file.data(), file.size());
+    string extension = path.size() >= 4 ? path.substr(path.size() - 4) : "";
+    bool epd = extension == ".epd" || extension == ".fen";
+
+    // a record starts at a line start for EPD, at a tag section for PGN
+    auto boundary = [&](size_t offset) -> size_t {
+        if (offset == 0 || offset >= text.size()) return min(offset, text.size());
+        if (epd) return text[offset - 1] == '\n' ? offset : nextLine(text, offset);
+        return nextPgnGame(text, offset);
+    };
+
+    size_t batchCount = (text.size() + VALIDATE_BATCH_BYTES - 1) / VALIDATE_BATCH_BYTES;
+    size_t window = size_t(threads) * 2;
+    vector<ValidateBatch> slots(window);
+    atomic<size_t> nextBatch{0};
+    size_t written = 0;
+    mutex slotMutex;
+    condition_variable slotChanged;
+
+    auto worker = [&]() {
+        unique_ptr<Position> pos(new Position());
+        for (size_t b = nextBatch++; b < batchCount; b = nextBatch++)
+        {
+            {
+                unique_lock<mutex> lock(slotMutex);
+                slotChanged.wait(lock, [&]() { return b < written + window; });
+            }
+            ValidateBatch& batch = slots[b % window];
+            size_t end = boundary((b + 1) * VALIDATE_BATCH_BYTES);
+            for (size_t start = boundary(b * VALIDATE_BATCH_BYTES); start < end;)
+            {
+                size_t next = epd ? nextLine(text, start) : nextPgnGame(text, start + 1);
+                string_view record = text.substr(start, next - start);
+                start = next;
+                if (epd && record.find_first_not_of(" \t\r\n") == string_view::npos) continue;
+
+                GameVerdict v = epd ? checkEpdRecord(record, *pos) : replayPgnGame(record, *pos);
+                batch.games++;
+                if (v.ok) batch.verdicts += "ok " + to_string(v.plies) + " " + v.result + "\n";
+                else
+                {
+                    batch.failed++;
+                    batch.verdicts += "error " + v.error + "\n";
+                }
+            }
+            lock_guard<mutex> lock(slotMutex);
+            batch.done = true;
+            slotChanged.notify_all();
+        }
+    };
+
+    auto start = chrono::steady_clock::now();
+    vector<thread> pool;
+    for (int i = 0; i < threads; ++i) pool.emplace_back(worker);
+
+    // the main thread prints finished batches in file order, numbering the games
+    uint64_t games = 0, failed = 0;
+    for (; written < batchCount;)
+    {
+        ValidateBatch& batch = slots[written % window];
+        {
+            unique_lock<mutex> lock(slotMutex);
+            slotChanged.wait(lock, [&]() { return batch.done; });
+        }
+        size_t lineStart = 0;
+        for (size_t lineEnd; (lineEnd = batch.verdicts.find('\n', lineStart)) != string::npos; lineStart = lineEnd + 1)
+        {
+            ++games;
+            if (errorsOnly && batch.verdicts.compare(lineStart, 3, "ok ") == 0) continue;
+            cout << games << ' ';
+            cout.write(batch.verdicts.data() + lineStart, lineEnd - lineStart + 1);
+        }
+        failed += batch.failed;
+
+        lock_guard<mutex> lock(slotMutex);
+        batch = ValidateBatch();
+        ++written;
+        slotChanged.notify_all();
+    }
+    for (thread& t : pool) t.join();
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    double mb = text.size() / 1048576.0;
+    cout << "\n" << (epd ? "Records: " : "Games:   ") << games << " (" << failed << " failed)\n"
+         << "Size:    " << fixed << setprecision(1) << mb << " MB\n"
+         << "Time:    " << (uint64_t)(seconds * 1000) << " ms with " << threads << " threads\n"
+         << "Rate:    " << (uint64_t)(seconds > 0 ? games / seconds : 0) << (epd ? " records/sec, " : " games/sec, ")
+         << (seconds > 0 ? mb / seconds : 0) << " MB/sec\n";
+    return failed ? 2 : 0;
+}
+
+static int runArchive(int argc, char** argv)
+{
+    if (argc < 4) { printUsage(); return 1; }
+    bool append = argc > 4 && string(argv[4]) == "--append";
+    MappedFile input;
+    if (!input.open(argv[2], true))
+    {
+        cerr << "cannot open " << argv[2] << "\n";
+        return 1;
+    }
+    GameWriter writer;
+    if (!writer.open(argv[3], append))
+    {
+        cerr << "cannot write " << argv[3] << (append ? " (or it is not a readable archive)" : "") << "\n";
+        return 1;
+    }
+
+    string_view text(input.data(), input.size());
+    unique_ptr<Position> pos(new Position());
+    GameRecord record;
+    uint64_t stored = 0, skipped = 0, plies = 0;
+    for (size_t start = nextPgnGame(text, 0); start < text.size();)
+    {
+        size_t next = nextPgnGame(text, start + 1);
+        GameVerdict v = replayPgnGame(text.substr(start, next - start), *pos, &record);
+        if (v.ok && writer.add(record)) { ++stored; plies += record.moves.size(); }
+        else ++skipped;
+        start = next;
+    }
+    if (!writer.close())
+    {
+        cerr << "error writing " << argv[3] << "\n";
+        return 1;
+    }
+
+    MappedFile output;
+    output.open(argv[3]);
+    GameReader archive;
+    archive.open(argv[3]);
+    uint64_t archivePlies = 0;
+    for (size_t n = 0; n < archive.gameCount(); ++n) archivePlies += archive.gamePlies(n);
+    cout << "Stored:  " << stored << " games, " << plies << " plies (" << skipped << " invalid skipped) from "
+         << input.size() << " bytes of PGN\n"
+         << "Archive: " << archive.gameCount() << " games, " << output.size() << " bytes ("
+         << fixed << setprecision(2) << (archivePlies ? double(output.size()) / archivePlies : 0) << " bytes/ply)\n";
+    return 0;
+}
+
+static int runGames(int argc, char** argv)
+{
+    if (argc < 3) { printUsage(); return 1; }
+    GameReader reader;
+    if (!reader.open(argv[2]))
+    {
+        cerr << "cannot read " << argv[2] << "\n";
+        return 1;
+    }
+    if (argc < 4)
+    {
+        uint64_t plies = 0, results[4] = { 0, 0, 0, 0 };
+        for (size_t n = 0; n < reader.gameCount(); ++n)
+        {
+            plies += reader.gamePlies(n);
+            results[reader.gameResult(n) & 3]++;
+        }
+        cout << "Games:   " << reader.gameCount() << ", " << plies << " plies\n"
+             << "Results: " << results[RESULT_WHITE_WINS] << " 1-0, " << results[RESULT_BLACK_WINS] << " 0-1, "
+             << results[RESULT_DRAW] << " 1/2-1/2, " << results[RESULT_UNKNOWN] << " *\n";
+        return 0;
+    }
+
+    GameRecord game;
+    unique_ptr<Position> pos(new Position());
+    if (!reader.readGame(strtoull(argv[3], nullptr, 10), game) || !startPosition(game, *pos))
+    {
+        cerr << "no game " << argv[3] << "\n";
+        return 1;
+    }
+    // SAN is only defined for legal moves: check the whole game before printing any of it
+    unique_ptr<Position> replay(new Position());
+    startPosition(game, *replay);
+    for (size_t ply = 0; ply < game.moves.size(); ++ply)
+        if (!replayMove(*replay, game.moves[ply]))
+        {
+            cerr << "game " << argv[3] << " is damaged: illegal move at ply " << ply + 1 << "\n";
+            return 1;
+        }
+    if (!game.startFen.empty()) cout << "[FEN \"" << game.startFen << "\"]\n\n";
+    string line;
+    for (Move m : game.moves)
+    {
+        if (pos->whiteToMove) line += to_string(pos->fullmoveNumber) + ". ";
+        else if (line.empty()) line += to_string(pos->fullmoveNumber) + "... ";
+        line += moveToSan(*pos, m) + " ";
+        makeMove(*pos, m);
+    }
+    cout << line << resultText(game.result) << "\n";
+    return 0;
+}
+
+static int runFind(int argc, char** argv)
+{
+    if (argc < 3) { printUsage(); return 1; }
+    GameReader reader;
+    if (!reader.open(argv[2]))
+    {
+        cerr << "cannot read " << argv[2] << "\n";
+        return 1;
+    }
+    Position pos;
+    string fen = fenFromArgs(argc, argv, 3);
+    if (!setFromFen(pos, fen))
+    {
+        cerr << "invalid FEN: " << fen << "\n";
+        return 1;
+    }
+
+    auto start = chrono::steady_clock::now();
+    vector<size_t> damaged;
+    vector<pair<size_t, int>> hits = reader.findPosition(pos.key, &damaged);
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    for (const auto& hit : hits) cout << "game " << hit.first << " ply " << hit.second << "\n";
+    for (size_t n : damaged) cerr << "game " << n << " is damaged: searched up to its first illegal move\n";
+    cout << hits.size() << " occurrences in " << reader.gameCount() << " games, " << fixed << setprecision(1)
+         << ms << " ms\n";
+    return 0;
+}
+
+static int runIndex(int argc, char** argv)
+{
+    if (argc < 4) { printUsage(); return 1; }
+    int threads = (int)thread::hardware_concurrency();
+    bool compact = false;
+    for (int i = 4; i < argc; ++i)
+    {
+        string option = argv[i];
+        if (option == "--threads" && i + 1 < argc) threads = atoi(argv[++i]);
+        else if (option == "--compact") compact = true;
+        else { printUsage(); return 1; }
+    }
+    if (threads < 1) threads = 1;
+
+    auto start = chrono::steady_clock::now();
+    IndexBuildStats stats;
+    if (!updatePositionIndex(argv[2], argv[3], threads, &stats) || (compact && !compactPositionIndex(argv[3])))
+    {
+        cerr << "cannot index " << argv[2] << " into " << argv[3] << "\n";
+        return 1;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    PositionIndex index;
+    MappedFile output;
+    if (!index.open(argv[3]) || !output.open(argv[3]))
+    {
+        cerr << "cannot read " << argv[3] << "\n";
+        return 1;
+    }
+    cout << "Added:   " << stats.gamesAdded << " games, " << stats.entriesAdded << " positions"
+         << (stats.compacted ? " (segments merged)" : "") << "\n";
+    if (stats.damagedGames)
+        cout << "Damaged: " << stats.damagedGames << " game" << (stats.damagedGames == 1 ? "" : "s")
+             << ", indexed up to the first illegal move\n";
+    cout << "Index:   " << index.gamesIndexed() << " games, " << index.entryCount() << " positions, "
+         << index.segmentCount() << " segment" << (index.segmentCount() == 1 ? "" : "s") << ", "
+         << output.size() << " bytes\n"
+         << "Time:    " << (uint64_t)(seconds * 1000) << " ms with " << threads << " threads\n";
+    return 0;
+}
+
+static int runLookup(int argc, char** argv)
+{
+    if (argc < 3) { printUsage(); return 1; }
+    PositionIndex index;
+    if (!index.open(argv[2]))
+    {
+        cerr << "cannot read " << argv[2] << "\n";
+        return 1;
+    }
+    Position pos;
+    string fen = fenFromArgs(argc, argv, 3);
+    if (!setFromFen(pos, fen))
+    {
+        cerr << "invalid FEN: " << fen << "\n";
+        return 1;
+    }
+
+    auto start = chrono::steady_clock::now();
+    vector<PositionPosting> hits = index.find(pos.key);
+    double us = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+    for (const PositionPosting& hit : hits) cout << "game " << hit.game << " ply " << hit.ply << "\n";
+    cout << hits.size() << " occurrences in " << index.gamesIndexed() << " games (" << index.entryCount()
+         << " positions), " << fixed << setprecision(1) << us << " us\n";
+    return 0;
+}
+
+static int runBook(int argc, char** argv)
+{
+    if (argc < 3) { printUsage(); return 1; }
+    string keysPath;
+    int next = 3;
+    if (argc > 4 && string(argv[3]) == "--keys")
+    {
+        keysPath = argv[4];
+        next = 5;
+    }
+    OpeningBook book;
+    if (!book.open(argv[2], keysPath))
+    {
+        cerr << "cannot open " << argv[2];
+        if (!keysPath.empty()) cerr << " with the keys of " << keysPath << " (781 values giving the published test keys)";
+        cerr << "\n";
+        return 1;
+    }
+    unique_ptr<Position> pos(new Position());
+    string fen = fenFromArgs(argc, argv, next);
+    if (!setFromFen(*pos, fen))
+    {
+        cerr << "invalid FEN: " << fen << "\n";
+        return 1;
+    }
+
+    auto start = chrono::steady_clock::now();
+    vector<BookMove> moves = book.probe(*pos);
+    double us = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+    int total = 0;
+    for (const BookMove& m : moves) total += m.weight;
+    for (const BookMove& m : moves)
+        cout << setw(8) << moveToSan(*pos, m.move) << "  " << setw(5) << m.weight << "  " << fixed << setprecision(1)
+             << setw(5) << 100.0 * m.weight / total << "%\n";
+    cout << moves.size() << " book moves (" << book.entryCount() << " entries), " << fixed << setprecision(1) << us
+         << " us\n";
+    return 0;
+}
+
+static int runMakeBook(int argc, char** argv)
+{
+    if (argc < 4) { printUsage(); return 1; }
+    string keysPath;
+    int plies = 20;
+    for (int i = 4; i < argc; ++i)
+    {
+        string option = argv[i];
+        if (option == "--keys" && i + 1 < argc) keysPath = argv[++i];
+        else if (option == "--plies" && i + 1 < argc) plies = atoi(argv[++i]);
+        else { printUsage(); return 1; }
+    }
+    PolyglotKeys keys;
+    if (!keysPath.empty() && !keys.load(keysPath))
+    {
+        cerr << "cannot read 781 Polyglot keys from " << keysPath << " that give the published test keys\n";
+        return 1;
+    }
+    BookBuildStats stats;
+    if (!buildBook(argv[2], argv[3], keys, plies, &stats))
+    {
+        cerr << "cannot build " << argv[3] << " from " << argv[2] << "\n";
+        return 1;
+    }
+    cout << "Games:   " << stats.games << " with a result, first " << plies << " plies\n";
+    if (stats.damagedGames)
+        cout << "Damaged: " << stats.damagedGames << " game" << (stats.damagedGames == 1 ? "" : "s")
+             << ", used up to the first illegal move\n";
+    cout << "Book:    " << stats.positions << " positions, " << stats.entries << " entries\n";
+    return 0;
+}
+
+static int runServe(int argc, char** argv)
+{
+    ServerOptions options;
+    for (int i = 2; i < argc; ++i)
+    {
+        string option = argv[i];
+        if (option == "--workers" && i + 1 < argc) options.workers = atoi(argv[++i]);
+        else if (option == "--sessions" && i + 1 < argc) options.maxSessions = strtoull(argv[++i], nullptr, 10);
+        else if (option.rfind("--", 0) != 0 && options.socketPath.empty()) options.socketPath = option == "-" ? "" : option;
+        else { printUsage(); return 1; }
+    }
+    // in pipe mode stdout carries the protocol, so the summary goes to stderr
+    return runServer(options, options.socketPath.empty() ? cerr : cout);
+}
+
+static int runLoadGen(int argc, char** argv)
+{
+    if (argc < 3) { printUsage(); return 1; }
+    LoadOptions options;
+    options.socketPath = argv[2];
+    for (int i = 3; i < argc; ++i)
+    {
+        string option = argv[i];
+        if (option == "--connections" && i + 1 < argc) options.connections = atoi(argv[++i]);
+        else if (option == "--sessions" && i + 1 < argc) options.sessions = atoi(argv[++i]);
+        else if (option == "--games" && i + 1 < argc) options.games = strtoull(argv[++i], nullptr, 10);
+        else if (option == "--plies" && i + 1 < argc) options.maxPlies = atoi(argv[++i]);
+        else if (option == "--interval" && i + 1 < argc) options.moveIntervalSec = atof(argv[++i]);
+        else { printUsage(); return 1; }
+    }
+    return runLoadGenerator(options, cout);
+}
+
+static int runSelfPlay(int argc, char** argv)
+{
+    TournamentOptions options;
+    options.workers = max(1, (int)thread::hardware_concurrency());
+    SearchLimits limits, limitsB;
+    bool depthB = false, nodesB = false, movetimeB = false;
+    string openingsPath;
+    for (int i = 2; i < argc; ++i)
+    {
+        string option = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (option == "--games" && hasValue) options.games = strtoull(argv[++i], nullptr, 10);
+        else if (option == "--depth" && hasValue) limits.depth = atoi(argv[++i]);
+        else if (option == "--nodes" && hasValue) limits.nodes = strtoull(argv[++i], nullptr, 10);
+        else if (option == "--movetime" && hasValue) limits.movetimeMs = atoll(argv[++i]);
+        else if (option == "--nnue" && hasValue) options.first.nnuePath = argv[++i];
+        else if (option == "--depth-b" && hasValue) { limitsB.depth = atoi(argv[++i]); depthB = true; }
+        else if (option == "--nodes-b" && hasValue) { limitsB.nodes = strtoull(argv[++i], nullptr, 10); nodesB = true; }
+        else if (option == "--movetime-b" && hasValue) { limitsB.movetimeMs = atoll(argv[++i]); movetimeB = true; }
+        else if (option == "--nnue-b" && hasValue) options.second.nnuePath = argv[++i];
+        else if (option == "--openings" && hasValue) openingsPath = argv[++i];
+        else if (option == "--random-plies" && hasValue) options.randomPlies = atoi(argv[++i]);
+        else if (option == "--workers" && hasValue) options.workers = atoi(argv[++i]);
+        else if (option == "--hash" && hasValue) options.hashMb = strtoull(argv[++i], nullptr, 10);
+        else if (option == "--plies" && hasValue) options.maxPlies = atoi(argv[++i]);
+        else if (option == "--cgf" && hasValue) { options.outputFormat = MATCH_OUTPUT_CGF; options.outputPath = argv[++i]; }
+        else if (option == "--pgn" && hasValue) { options.outputFormat = MATCH_OUTPUT_PGN; options.outputPath = argv[++i]; }
+        else if (option == "--sprt" && i + 2 < argc)
+        {
+            options.sprt = true;
+            options.elo0 = atof(argv[++i]);
+            options.elo1 = atof(argv[++i]);
+        }
+        else if (option == "--alpha" && hasValue) options.alpha = atof(argv[++i]);
+        else if (option == "--beta" && hasValue) options.beta = atof(argv[++i]);
+        else if (option == "--report" && hasValue) options.reportEvery = strtoull(argv[++i], nullptr, 10);
+        else { printUsage(); return 1; }
+    }
+    // a quick default: 10k nodes a move keeps games well under a second
+    if (!limits.depth && !limits.nodes && !limits.movetimeMs) limits.nodes = 10000;
+    options.first.limits = limits;
+    options.second.limits = limits;
+    if (depthB) options.second.limits.depth = limitsB.depth;
+    if (nodesB) options.second.limits.nodes = limitsB.nodes;
+    if (movetimeB) options.second.limits.movetimeMs = limitsB.movetimeMs;
+
+    if (!openingsPath.empty())
+    {
+        int rejected = 0;
+        if (!readOpeningSuite(openingsPath, options.openings, &rejected))
+        {
+            cerr << "cannot read " << openingsPath << "\n";
+            return 1;
+        }
+        if (rejected) cerr << rejected << " invalid lines skipped in " << openingsPath << "\n";
+        if (options.openings.empty())
+        {
+            cerr << "no openings in " << openingsPath << "\n";
+            return 1;
+        }
+    }
+    return runTournament(options, cout);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) { printUsage(); return 1; }
+    string command = argv[1];
+    // instrumented builds: kill -USR1 prints the hot-path table to stderr, -USR2 the JSON
+    installInstrumentDump(SIGUSR1, SIGUSR2);
+
+    if (command == "--uci" || command == "uci") return runUci(cin, cout);
+    if (command == "perft") return runPerft(argc, argv);
+    if (command == "search") return runSearch(argc, argv);
+    if (command == "tablebase") return runTablebase(argc, argv);
+    if (command == "attacks") return runAttackBench(argc, argv);
+    if (command == "makennue") return runMakeNnue(argc, argv);
+    if (command == "evalbench") return runEvalBench(argc, argv);
+    if (command == "validate") return runValidate(argc, argv);
+    if (command == "archive") return runArchive(argc, argv);
+    if (command == "games") return runGames(argc, argv);
+    if (command == "find") return runFind(argc, argv);
+    if (command == "index") return runIndex(argc, argv);
+    if (command == "lookup") return runLookup(argc, argv);
+    if (command == "book") return runBook(argc, argv);
+    if (command == "makebook") return runMakeBook(argc, argv);
+    if (command == "serve") return runServe(argc, argv);
+    if (command == "loadgen") return runLoadGen(argc, argv);
+    if (command == "selfplay") return runSelfPlay(argc, argv);
+    if (command == "smp") return runSmpBench(argc, argv);
+
+    printUsage();
+    return 1;
+}
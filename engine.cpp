@@ -0,0 +1,90 @@
+#include "engine.h"
+#include <algorithm>
+#include <chrono>
+
+using namespace std;
+
+EngineService::EngineService(size_t hashMb, Tablebases* tablebases) : tablebases(tablebases)
+{
+    tt.resize(hashMb);
+    worker = thread(&EngineService::run, this);
+}
+
+EngineService::~EngineService()
+{
+    {
+        lock_guard<mutex> lock(requestMutex);
+        quitting = true;
+        stop = true;
+    }
+    requestReady.notify_one();
+    worker.join();
+}
+
+uint64_t EngineService::start(const Position& pos, const SearchLimits& limits)
+{
+    unique_ptr<Position> next(new Position(pos)); // the 17 KB copy happens outside the lock
+    lock_guard<mutex> lock(requestMutex);
+    request = move(next);
+    requestLimits = limits;
+    searching = true;
+    stop = true; // the running search, if any, ends at its next check
+    requestReady.notify_one();
+    return ++lastId;
+}
+
+void EngineService::cancel()
+{
+    lock_guard<mutex> lock(requestMutex);
+    request.reset();
+    stop = true;
+    if (!running) searching = false;
+}
+
+void EngineService::run()
+{
+    for (;;)
+    {
+        unique_ptr<Position> pos;
+        SearchLimits limits;
+        uint64_t id;
+        {
+            unique_lock<mutex> lock(requestMutex);
+            running = false;
+            if (!request) searching = false;
+            requestReady.wait(lock, [this]() { return quitting || request; });
+            if (quitting) return;
+            pos = move(request);
+            limits = requestLimits;
+            id = lastId;
+            stop = false;
+            running = true;
+        }
+
+        // iterations are dropped when the queue is full; the consumer only needs the latest
+        SearchResult result = search(*pos, limits, [this, id](const SearchReport& r) {
+            EngineUpdate info;
+            info.searchId = id;
+            info.depth = r.depth;
+            info.score = r.score;
+            info.nodes = r.nodes;
+            info.timeMs = r.timeMs;
+            info.bestMove = r.pv.empty() ? NO_MOVE : r.pv[0];
+            info.pvLength = min<int>(int(r.pv.size()), UPDATE_PV_LENGTH);
+            copy(r.pv.begin(), r.pv.begin() + info.pvLength, info.pv);
+            updates.push(info);
+        }, &stop, &tt, 1, tablebases);
+
+        EngineUpdate done;
+        done.searchId = id;
+        done.kind = UPDATE_BESTMOVE;
+        done.depth = result.depth;
+        done.score = result.score;
+        done.nodes = result.nodes;
+        done.timeMs = result.timeMs;
+        done.bestMove = result.bestMove;
+        done.pvLength = min<int>(int(result.pv.size()), UPDATE_PV_LENGTH);
+        copy(result.pv.begin(), result.pv.begin() + done.pvLength, done.pv);
+        while (!updates.push(done) && !quitting) this_thread::sleep_for(chrono::milliseconds(1));
+    }
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "position.h"
+#include "search.h"
+#include "tt.h"
+
+// Single-producer / single-consumer ring buffer: one thread pushes, another pops, and
+// neither ever waits on a lock. Capacity must be a power of two.
+template <class T, size_t Capacity>
+class SpscQueue
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+    // false when full
+    bool push(const T& item)
+    {
+        size_t tail = writeIndex.load(std::memory_order_relaxed);
+        if (tail - readIndex.load(std::memory_order_acquire) == Capacity) return false;
+        slots[tail & (Capacity - 1)] = item;
+        writeIndex.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+    // false when empty
+    bool pop(T& item)
+    {
+        size_t head = readIndex.load(std::memory_order_relaxed);
+        if (head == writeIndex.load(std::memory_order_acquire)) return false;
+        item = slots[head & (Capacity - 1)];
+        readIndex.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    T slots[Capacity];
+    // on separate cache lines so producer and consumer do not bounce one line between cores
+    alignas(64) std::atomic<size_t> writeIndex{0};
+    alignas(64) std::atomic<size_t> readIndex{0};
+};
+
+enum EngineUpdateKind { UPDATE_INFO, UPDATE_BESTMOVE };
+
+const int UPDATE_PV_LENGTH = 8;
+
+// one message from the engine thread: a finished iteration, or the final move of a search
+struct EngineUpdate
+{
+    uint64_t searchId = 0; // as returned by EngineService::start; older ids are stale
+    EngineUpdateKind kind = UPDATE_INFO;
+    int depth = 0;
+    int score = 0;
+    uint64_t nodes = 0;
+    int64_t timeMs = 0;
+    Move bestMove = NO_MOVE;
+    int pvLength = 0;
+    Move pv[UPDATE_PV_LENGTH] = {};
+};
+
+// Searches on a background thread so the caller (a render loop) never blocks: start()
+// hands over a copy of the position and a budget and returns at once, stopping any
+// search still running. Results stream back through a lock-free queue that the caller
+// drains with poll(), e.g. once per frame; it must keep draining, since a best move
+// waits for room. Every search that gets to run ends with one UPDATE_BESTMOVE, stopped
+// ones included; a request replaced or cancelled before it began sends nothing.
+class EngineService
+{
+public:
+    explicit EngineService(size_t hashMb = 16, Tablebases* tablebases = nullptr);
+    ~EngineService();
+    EngineService(const EngineService&) = delete;
+    EngineService& operator=(const EngineService&) = delete;
+
+    // replaces whatever is running or pending; returns the new search's id
+    uint64_t start(const Position& pos, const SearchLimits& limits);
+    // stops the running search (it still reports its best move) and drops a pending one
+    void cancel();
+    // a search is pending or running, or its best move is not queued yet
+    bool busy() const { return searching.load(); }
+    // consumer side: never blocks
+    bool poll(EngineUpdate& update) { return updates.pop(update); }
+
+private:
+    void run();
+
+    TranspositionTable tt;
+    Tablebases* tablebases;
+    SpscQueue<EngineUpdate, 256> updates;
+    std::atomic<bool> stop{false};
+    std::atomic<bool> searching{false};
+    std::atomic<bool> quitting{false};
+
+    // the request handed to the worker; a newer one overwrites one not started yet
+    std::mutex requestMutex;
+    std::condition_variable requestReady;
+    std::unique_ptr<Position> request;
+    SearchLimits requestLimits;
+    uint64_t lastId = 0;
+    bool running = false;
+
+    std::thread worker;
+};
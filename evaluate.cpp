@@ -0,0 +1,131 @@
+#include "evaluate.h"
+#include "nnue.h"
+
+const int pieceValue[PIECE_TYPE_NB] = { 100, 320, 330, 500, 900, 2000 };
+
+// piece-square tables from White's side, written rank 8 first so they read like a board
+static const int pawnTable[64] = {
+     0,  0,  0,  0,  0,  0,  0,  0,
+    50, 50, 50, 50, 50, 50, 50, 50,
+    10, 10, 20, 30, 30, 20, 10, 10,
+     5,  5, 10, 25, 25, 10,  5,  5,
+     0,  0,  0, 20, 20,  0,  0,  0,
+     5, -5,-10,  0,  0,-10, -5,  5,
+     5, 10, 10,-20,-20, 10, 10,  5,
+     0,  0,  0,  0,  0,  0,  0,  0,
+};
+
+static const int knightTable[64] = {
+   -50,-40,-30,-30,-30,-30,-40,-50,
+   -40,-20,  0,  0,  0,  0,-20,-40,
+   -30,  0, 10, 15, 15, 10,  0,-30,
+   -30,  5, 15, 20, 20, 15,  5,-30,
+   -30,  0, 15, 20, 20, 15,  0,-30,
+   -30,  5, 10, 15, 15, 10,  5,-30,
+   -40,-20,  0,  5,  5,  0,-20,-40,
+   -50,-40,-30,-30,-30,-30,-40,-50,
+};
+
+static const int bishopTable[64] = {
+   -20,-10,-10,-10,-10,-10,-10,-20,
+   -10,  0,  0,  0,  0,  0,  0,-10,
+   -10,  0,  5, 10, 10,  5,  0,-10,
+   -10,  5,  5, 10, 10,  5,  5,-10,
+   -10,  0, 10, 10, 10, 10,  0,-10,
+   -10, 10, 10, 10, 10, 10, 10,-10,
+   -10,  5,  0,  0,  0,  0,  5,-10,
+   -20,-10,-10,-10,-10,-10,-10,-20,
+};
+
+static const int rookTable[64] = {
+     0,  0,  0,  0,  0,  0,  0,  0,
+     5, 10, 10, 10, 10, 10, 10,  5,
+    -5,  0,  0,  0,  0,  0,  0, -5,
+    -5,  0,  0,  0,  0,  0,  0, -5,
+    -5,  0,  0,  0,  0,  0,  0, -5,
+    -5,  0,  0,  0,  0,  0,  0, -5,
+    -5,  0,  0,  0,  0,  0,  0, -5,
+     0,  0,  0,  5,  5,  0,  0,  0,
+};
+
+static const int queenTable[64] = {
+   -20,-10,-10, -5, -5,-10,-10,-20,
+   -10,  0,  0,  0,  0,  0,  0,-10,
+   -10,  0,  5,  5,  5,  5,  0,-10,
+    -5,  0,  5,  5,  5,  5,  0, -5,
+     0,  0,  5,  5,  5,  5,  0, -5,
+   -10,  5,  5,  5,  5,  5,  0,-10,
+   -10,  0,  5,  0,  0,  0,  0,-10,
+   -20,-10,-10, -5, -5,-10,-10,-20,
+};
+
+static const int kingMiddleTable[64] = {
+   -30,-40,-40,-50,-50,-40,-40,-30,
+   -30,-40,-40,-50,-50,-40,-40,-30,
+   -30,-40,-40,-50,-50,-40,-40,-30,
+   -30,-40,-40,-50,-50,-40,-40,-30,
+   -20,-30,-30,-40,-40,-30,-30,-20,
+   -10,-20,-20,-20,-20,-20,-20,-10,
+    20, 20,  0,  0,  0,  0, 20, 20,
+    20, 30, 10,  0,  0, 10, 30, 20,
+};
+
+static const int kingEndTable[64] = {
+   -50,-40,-30,-20,-20,-30,-40,-50,
+   -30,-20,-10,  0,  0,-10,-20,-30,
+   -30,-10, 20, 30, 30, 20,-10,-30,
+   -30,-10, 30, 40, 40, 30,-10,-30,
+   -30,-10, 30, 40, 40, 30,-10,-30,
+   -30,-10, 20, 30, 30, 20,-10,-30,
+   -30,-30,  0,  0,  0,  0,-30,-30,
+   -50,-30,-30,-30,-30,-30,-30,-50,
+};
+
+static const int* const pieceTables[KING] = { pawnTable, knightTable, bishopTable, rookTable, queenTable };
+
+// game phase: 24 with all minor/major pieces on the board, 0 with none
+static const int phaseWeight[PIECE_TYPE_NB] = { 0, 1, 1, 2, 4, 0 };
+
+int pieceSquareValue(int type, int sq, bool endgame)
+{
+    int index = (7 - sq / 8) * 8 + sq % 8;
+    if (type == KING) return endgame ? kingEndTable[index] : kingMiddleTable[index];
+    return pieceValue[type] + pieceTables[type][index];
+}
+
+int evaluate(const Position& pos)
+{
+    if (pos.network) return nnueEvaluate(pos);
+
+    int middle = 0, end = 0, phase = 0;
+    for (int color = WHITE; color <= BLACK; ++color)
+    {
+        int sign = color == WHITE ? 1 : -1;
+        for (int type = PAWN; type <= KING; ++type)
+        {
+            Bitboard b = pos.pieces[color][type];
+            while (b)
+            {
+                int sq = popLsb(b);
+                // tables are stored rank 8 first from White's side; mirror ranks for Black
+                int index = color == WHITE ? (7 - sq / 8) * 8 + sq % 8 : sq;
+                phase += phaseWeight[type];
+                if (type == KING)
+                {
+                    middle += sign * kingMiddleTable[index];
+                    end += sign * kingEndTable[index];
+                }
+                else
+                {
+                    int value = pieceValue[type] + pieceTables[type][index];
+                    middle += sign * value;
+                    end += sign * value;
+                }
+            }
+        }
+    }
+
+    if (phase > 24) phase = 24;
+    int score = (middle * phase + end * (24 - phase)) / 24;
+    return pos.whiteToMove ? score : -score;
+}
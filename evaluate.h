@@ -0,0 +1,14 @@
+#pragma once
+#include "position.h"
+
+// centipawn values indexed by PieceType (king gets a nominal value for MVV-LVA)
+extern const int pieceValue[PIECE_TYPE_NB];
+
+// material + piece-square value of a white piece on sq (a1 = 0); mirror the rank for
+// Black. Kings have no material value and use the middlegame or endgame table.
+int pieceSquareValue(int type, int sq, bool endgame = false);
+
+// Score from the side to move's point of view: the attached network's output when
+// pos.network is set (see nnue.h), otherwise material + piece-square tables, tapered
+// between middlegame and endgame king tables by remaining material.
+int evaluate(const Position& pos);
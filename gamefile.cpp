@@ -0,0 +1,299 @@
+#include "gamefile.h"
+#include <cstring>
+#include <memory>
+#include <unistd.h>
+#include "movegen.h"
+#include "rules.h"
+
+using namespace std;
+
+static const char fileMagic[4] = { 'C', 'G', 'F', '1' };
+static const char trailerMagic[4] = { 'C', 'G', 'F', 'I' };
+const size_t INDEX_ENTRY_BYTES = 24;
+const size_t TRAILER_BYTES = 16;
+const int FLAG_FEN = 1;
+
+static void put16(vector<uint8_t>& out, uint16_t v)
+{
+    out.push_back(uint8_t(v));
+    out.push_back(uint8_t(v >> 8));
+}
+
+static void put32(vector<uint8_t>& out, uint32_t v)
+{
+    for (int i = 0; i < 4; ++i) out.push_back(uint8_t(v >> (8 * i)));
+}
+
+static void put64(vector<uint8_t>& out, uint64_t v)
+{
+    for (int i = 0; i < 8; ++i) out.push_back(uint8_t(v >> (8 * i)));
+}
+
+static uint16_t get16(const uint8_t* p) { return uint16_t(p[0] | p[1] << 8); }
+static uint32_t get32(const uint8_t* p) { return uint32_t(get16(p)) | uint32_t(get16(p + 2)) << 16; }
+static uint64_t get64(const uint8_t* p) { return uint64_t(get32(p)) | uint64_t(get32(p + 4)) << 32; }
+
+// one byte (eight bits) per position, three bits per key taken from different parts of it:
+// about a 3% false positive rate, weeded out by replaying the candidate game
+static size_t filterBytes(int plies) { return size_t(plies + 1 + 7) / 8 * 8; }
+
+static void filterAdd(uint8_t* filter, size_t bytes, uint64_t key)
+{
+    size_t bits = bytes * 8;
+    for (int i = 0; i < 3; ++i)
+    {
+        size_t bit = size_t(key >> (21 * i)) % bits;
+        filter[bit / 8] |= uint8_t(1 << (bit % 8));
+    }
+}
+
+static bool filterMayContain(const uint8_t* filter, size_t bytes, uint64_t key)
+{
+    size_t bits = bytes * 8;
+    for (int i = 0; i < 3; ++i)
+    {
+        size_t bit = size_t(key >> (21 * i)) % bits;
+        if (!(filter[bit / 8] & (1 << (bit % 8)))) return false;
+    }
+    return true;
+}
+
+const char* resultText(int result)
+{
+    switch (result) {
+    case RESULT_WHITE_WINS: return "1-0";
+    case RESULT_BLACK_WINS: return "0-1";
+    case RESULT_DRAW: return "1/2-1/2";
+    default: return "*";
+    }
+}
+
+int resultFromText(const string& text)
+{
+    if (text == "1-0") return RESULT_WHITE_WINS;
+    if (text == "0-1") return RESULT_BLACK_WINS;
+    if (text == "1/2-1/2") return RESULT_DRAW;
+    return RESULT_UNKNOWN;
+}
+
+bool startPosition(const GameRecord& game, Position& pos)
+{
+    if (game.startFen.empty())
+    {
+        initializeBoard(pos);
+        return true;
+    }
+    return setFromFen(pos, game.startFen);
+}
+
+bool replayMove(Position& pos, Move m)
+{
+    MoveList list;
+    generateLegalMoves(pos, list);
+    bool legal = false;
+    for (int i = 0; i < list.count && !legal; ++i) legal = list.moves[i] == m;
+    if (legal) makeMove(pos, m);
+    return legal;
+}
+
+bool GameWriter::open(const string& path, bool append)
+{
+    close();
+    index.clear();
+    filters.clear();
+    targetPath = path;
+    tempPath = path + ".tmp";
+    failed = false;
+
+    GameReader existing;
+    bool keep = append && access(path.c_str(), F_OK) == 0;
+    // never replace a file that is there but does not parse: it may still hold games
+    if (keep && !existing.open(path)) return false;
+
+    file = fopen(tempPath.c_str(), "wb");
+    if (!file) return false;
+    if (!keep)
+    {
+        writeOffset = 4;
+        failed = fwrite(fileMagic, 1, 4, file) != 4;
+        return !failed;
+    }
+
+    // the old games are copied as they are; their index and filters are kept in memory and
+    // written again, after the new games, by close()
+    const uint8_t* base = (const uint8_t*)existing.file.data();
+    for (size_t n = 0; n < existing.gameCount(); ++n)
+    {
+        const uint8_t* e = existing.entry(n);
+        IndexEntry entry = { get64(e), get64(e + 8), uint32_t(filters.size()), get16(e + 20), e[22] };
+        const uint8_t* filter = base + existing.filtersOffset + get32(e + 16);
+        filters.insert(filters.end(), filter, filter + filterBytes(entry.plies));
+        index.push_back(entry);
+    }
+    writeOffset = existing.indexOffset;
+    failed = fwrite(base, 1, writeOffset, file) != writeOffset;
+    return !failed;
+}
+
+bool GameWriter::add(const GameRecord& game)
+{
+    if (!file || game.moves.size() > 0xFFFF || game.startFen.size() > 0xFF) return false;
+    unique_ptr<Position> pos(new Position());
+    if (!startPosition(game, *pos)) return false;
+
+    // replay first: nothing reaches the file unless every move is legal
+    size_t bytes = filterBytes(int(game.moves.size()));
+    vector<uint8_t> filter(bytes, 0);
+    filterAdd(filter.data(), bytes, pos->key);
+    for (Move m : game.moves)
+    {
+        if (!replayMove(*pos, m)) return false;
+        filterAdd(filter.data(), bytes, pos->key);
+    }
+
+    vector<uint8_t> record;
+    record.push_back(uint8_t(game.result));
+    record.push_back(game.startFen.empty() ? 0 : FLAG_FEN);
+    put16(record, uint16_t(game.moves.size()));
+    if (!game.startFen.empty())
+    {
+        record.push_back(uint8_t(game.startFen.size()));
+        record.insert(record.end(), game.startFen.begin(), game.startFen.end());
+    }
+    for (Move m : game.moves) put16(record, m);
+    if (fwrite(record.data(), 1, record.size(), file) != record.size())
+    {
+        failed = true;
+        return false;
+    }
+
+    index.push_back({ writeOffset, pos->key, uint32_t(filters.size()), uint16_t(game.moves.size()),
+                      uint8_t(game.result) });
+    filters.insert(filters.end(), filter.begin(), filter.end());
+    writeOffset += record.size();
+    return true;
+}
+
+bool GameWriter::close()
+{
+    if (!file) return true;
+    vector<uint8_t> tail;
+    for (const IndexEntry& e : index)
+    {
+        put64(tail, e.offset);
+        put64(tail, e.finalKey);
+        put32(tail, e.filterOffset);
+        put16(tail, e.plies);
+        tail.push_back(e.result);
+        tail.push_back(0);
+    }
+    tail.insert(tail.end(), filters.begin(), filters.end());
+    put64(tail, writeOffset);
+    put32(tail, uint32_t(index.size()));
+    tail.insert(tail.end(), trailerMagic, trailerMagic + 4);
+
+    bool ok = !failed && fwrite(tail.data(), 1, tail.size(), file) == tail.size();
+    ok = fflush(file) == 0 && ok;
+    // the complete file reaches the disk before it replaces the archive, so a crash at any
+    // point leaves either the old archive or the new one
+    ok = fsync(fileno(file)) == 0 && ok;
+    ok = fclose(file) == 0 && ok;
+    file = nullptr;
+    ok = ok && rename(tempPath.c_str(), targetPath.c_str()) == 0;
+    if (!ok) remove(tempPath.c_str());
+    return ok;
+}
+
+bool GameReader::open(const string& path)
+{
+    count = 0;
+    if (!file.open(path)) return false;
+    const uint8_t* base = (const uint8_t*)file.data();
+    size_t size = file.size();
+    if (size < 4 + TRAILER_BYTES || memcmp(base, fileMagic, 4) != 0) return false;
+
+    const uint8_t* trailer = base + size - TRAILER_BYTES;
+    if (memcmp(trailer + 12, trailerMagic, 4) != 0) return false;
+    indexOffset = get64(trailer);
+    size_t games = get32(trailer + 8);
+    if (indexOffset < 4 || indexOffset > size - TRAILER_BYTES) return false;
+    filtersOffset = indexOffset + games * INDEX_ENTRY_BYTES;
+    if (filtersOffset > size - TRAILER_BYTES) return false;
+
+    // every game header and filter must lie in its section, so no lookup reads past the file
+    uint64_t filtersSize = size - TRAILER_BYTES - filtersOffset;
+    for (size_t n = 0; n < games; ++n)
+    {
+        const uint8_t* e = base + indexOffset + n * INDEX_ENTRY_BYTES;
+        uint64_t offset = get64(e), filterOffset = get32(e + 16);
+        if (offset < 4 || offset > indexOffset - 4) return false;
+        if (filterOffset > filtersSize || filterBytes(get16(e + 20)) > filtersSize - filterOffset) return false;
+    }
+    count = games;
+    return true;
+}
+
+const uint8_t* GameReader::entry(size_t n) const
+{
+    return (const uint8_t*)file.data() + indexOffset + n * INDEX_ENTRY_BYTES;
+}
+
+int GameReader::gamePlies(size_t n) const { return get16(entry(n) + 20); }
+int GameReader::gameResult(size_t n) const { return entry(n)[22]; }
+uint64_t GameReader::finalKey(size_t n) const { return get64(entry(n) + 8); }
+
+bool GameReader::readGame(size_t n, GameRecord& game) const
+{
+    if (n >= count) return false;
+    const uint8_t* p = (const uint8_t*)file.data() + get64(entry(n));
+    const uint8_t* end = (const uint8_t*)file.data() + indexOffset;
+    if (p + 4 > end) return false;
+
+    game.result = p[0];
+    int flags = p[1];
+    size_t plies = get16(p + 2);
+    p += 4;
+    game.startFen.clear();
+    if (flags & FLAG_FEN)
+    {
+        size_t length = *p++;
+        if (p + length > end) return false;
+        game.startFen.assign((const char*)p, length);
+        p += length;
+    }
+    if (p + plies * 2 > end) return false;
+    game.moves.resize(plies);
+    for (size_t i = 0; i < plies; ++i) game.moves[i] = get16(p + 2 * i);
+    return true;
+}
+
+vector<pair<size_t, int>> GameReader::findPosition(uint64_t key, vector<size_t>* damaged) const
+{
+    vector<pair<size_t, int>> found;
+    const uint8_t* filters = (const uint8_t*)file.data() + filtersOffset;
+    GameRecord game;
+    unique_ptr<Position> pos(new Position());
+    for (size_t n = 0; n < count; ++n)
+    {
+        const uint8_t* e = entry(n);
+        if (!filterMayContain(filters + get32(e + 16), filterBytes(get16(e + 20)), key)) continue;
+
+        // a filter hit only means "maybe": replay the game to find the actual plies
+        if (!readGame(n, game) || !startPosition(game, *pos))
+        {
+            if (damaged) damaged->push_back(n);
+            continue;
+        }
+        if (pos->key == key) found.push_back({ n, 0 });
+        for (size_t ply = 0; ply < game.moves.size(); ++ply)
+        {
+            if (!replayMove(*pos, game.moves[ply]))
+            {
+                if (damaged) damaged->push_back(n);
+                break;
+            }
+            if (pos->key == key) found.push_back({ n, int(ply + 1) });
+        }
+    }
+    return found;
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+#include "mappedfile.h"
+#include "position.h"
+
+// Compact binary game archive (".cgf").
+//
+//   header   "CGF1"
+//   games    result u8, flags u8, plies u16, [fen length u8, fen], moves u16 x plies
+//   index    per game: offset u64, final key u64, filter offset u32, plies u16, result u8, pad u8
+//   filters  per game: a Bloom filter over the Zobrist keys of every position in the game
+//   trailer  index offset u64, game count u32, "CGFI"
+//
+// Moves use the engine's 16-bit Move encoding, so a game costs 2 bytes per ply plus
+// about one filter byte per ply. All integers are little-endian. The fixed-size trailer
+// lets a reader find the index without touching the games; the filters let it answer
+// "which games reach this position" by replaying only the games that may match.
+
+enum GameResult { RESULT_UNKNOWN, RESULT_WHITE_WINS, RESULT_BLACK_WINS, RESULT_DRAW };
+
+struct GameRecord
+{
+    std::string startFen; // empty for the standard start position
+    std::vector<Move> moves;
+    int result = RESULT_UNKNOWN;
+};
+
+const char* resultText(int result);          // "1-0", "0-1", "1/2-1/2", "*"
+int resultFromText(const std::string& text);
+
+// the start position of a game (false on a bad FEN)
+bool startPosition(const GameRecord& game, Position& pos);
+// makes m if it is legal in pos, else returns false and leaves pos alone; archive games
+// are replayed through this, so a damaged game stops at its first bad move
+bool replayMove(Position& pos, Move m);
+
+// Writes an archive. open(append=true) keeps the games of an existing archive and adds
+// after them, and fails if the file is there but is not a readable archive. Everything is
+// written to "<path>.tmp", which close() renames over the archive once the index and
+// trailer are on disk, so a crash or a failed write leaves the old archive untouched.
+class GameWriter
+{
+public:
+    ~GameWriter() { close(); }
+    bool open(const std::string& path, bool append = false);
+    // replays the game to build its filter; false (nothing written) if a move is illegal
+    bool add(const GameRecord& game);
+    bool close();
+    size_t gameCount() const { return index.size(); }
+
+private:
+    struct IndexEntry
+    {
+        uint64_t offset;
+        uint64_t finalKey;
+        uint32_t filterOffset;
+        uint16_t plies;
+        uint8_t result;
+    };
+    std::FILE* file = nullptr;
+    std::string targetPath, tempPath;
+    bool failed = false; // a write failed: close() discards the file
+    uint64_t writeOffset = 0;
+    std::vector<IndexEntry> index;
+    std::vector<uint8_t> filters;
+};
+
+// Random access to an archive through a memory map.
+class GameReader
+{
+public:
+    // false unless every index entry's game and filter lie inside the file
+    bool open(const std::string& path);
+    size_t gameCount() const { return count; }
+    bool readGame(size_t n, GameRecord& game) const;
+    int gamePlies(size_t n) const;
+    int gameResult(size_t n) const;
+    uint64_t finalKey(size_t n) const;
+    // every (game, ply) where the position with this key occurs; ply 0 = start position.
+    // Games with an illegal move are searched up to it and listed in damaged.
+    std::vector<std::pair<size_t, int>> findPosition(uint64_t key, std::vector<size_t>* damaged = nullptr) const;
+
+private:
+    friend class GameWriter; // appending starts from the existing index
+    const uint8_t* entry(size_t n) const;
+    MappedFile file;
+    size_t count = 0;
+    uint64_t indexOffset = 0;
+    uint64_t filtersOffset = 0;
+};
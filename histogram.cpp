@@ -0,0 +1,70 @@
+#include "histogram.h"
+#include <cstdio>
+
+using namespace std;
+
+static int bucketOf(uint64_t ns)
+{
+    if (ns < (1u << 5)) return int(ns);
+    int shift = 63 - __builtin_clzll(ns) - 5;
+    return ((shift + 1) << 5) + int((ns >> shift) & 31);
+}
+
+static uint64_t bucketTop(int bucket)
+{
+    if (bucket < 32) return uint64_t(bucket);
+    int shift = (bucket >> 5) - 1;
+    return ((uint64_t(33 + (bucket & 31))) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t ns)
+{
+    counts[bucketOf(ns)]++;
+    total++;
+    sum += ns;
+    if (ns > largest) largest = ns;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+    for (int i = 0; i < BUCKETS; ++i) counts[i] += other.counts[i];
+    total += other.total;
+    sum += other.sum;
+    if (other.largest > largest) largest = other.largest;
+}
+
+void LatencyHistogram::clear()
+{
+    *this = LatencyHistogram();
+}
+
+uint64_t LatencyHistogram::percentile(double p) const
+{
+    if (total == 0) return 0;
+    uint64_t rank = uint64_t(p * total);
+    if (rank >= total) rank = total - 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; ++i)
+    {
+        seen += counts[i];
+        if (seen > rank) return bucketTop(i) < largest ? bucketTop(i) : largest;
+    }
+    return largest;
+}
+
+string formatNanoseconds(double ns)
+{
+    char text[32];
+    if (ns < 1e3) snprintf(text, sizeof(text), "%.0fns", ns);
+    else if (ns < 1e6) snprintf(text, sizeof(text), "%.1fus", ns / 1e3);
+    else if (ns < 1e9) snprintf(text, sizeof(text), "%.2fms", ns / 1e6);
+    else snprintf(text, sizeof(text), "%.2fs", ns / 1e9);
+    return text;
+}
+
+string LatencyHistogram::summary() const
+{
+    return "p50 " + formatNanoseconds(double(percentile(0.5))) + "  p90 " + formatNanoseconds(double(percentile(0.9)))
+           + "  p99 " + formatNanoseconds(double(percentile(0.99))) + "  p99.9 "
+           + formatNanoseconds(double(percentile(0.999))) + "  max " + formatNanoseconds(double(largest));
+}
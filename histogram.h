@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// Latency histogram in nanoseconds with about 3% resolution: values below 32 get a bucket
+// each, every power-of-two range above is split into 32 linear buckets. Fixed size, so
+// recording never allocates; per-thread histograms are merged for reporting.
+class LatencyHistogram
+{
+public:
+    void record(uint64_t ns);
+    void merge(const LatencyHistogram& other);
+    void clear();
+
+    uint64_t count() const { return total; }
+    uint64_t max() const { return largest; }
+    double mean() const { return total ? double(sum) / total : 0.0; }
+    // upper edge of the bucket holding the p-th fraction (0..1) of the samples
+    uint64_t percentile(double p) const;
+    // "p50 12.1us  p90 ...  p99 ...  p99.9 ...  max ..."
+    std::string summary() const;
+
+private:
+    static const int SUB_BITS = 5;
+    static const int BUCKETS = (64 - SUB_BITS + 1) << SUB_BITS;
+    uint64_t counts[BUCKETS] = {};
+    uint64_t total = 0;
+    uint64_t sum = 0;
+    uint64_t largest = 0;
+};
+
+// "850ns", "12.3us", "4.56ms", "1.20s"
+std::string formatNanoseconds(double ns);
@@ -0,0 +1,201 @@
+#include "instrument.h"
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+using namespace std;
+
+const char* hotPathName(HotPath path)
+{
+    static const char* names[HOT_PATH_COUNT] = { "isValidMove", "wouldBeInCheckAfterMove", "isSquareAttacked",
+                                                 "isCheckmate", "isStalemate", "frame" };
+    return names[path];
+}
+
+// one thread's figures; busy is only ever contended by a snapshot merging the block
+struct ThreadBlock
+{
+    atomic<bool> busy{false};
+    LatencyHistogram latency[HOT_PATH_COUNT];
+};
+
+struct Registry
+{
+    mutex lock;
+    vector<ThreadBlock*> blocks;
+    LatencyHistogram retired[HOT_PATH_COUNT]; // threads that have exited
+    int threads = 0;
+    chrono::steady_clock::time_point firstSample;
+};
+
+// never destroyed: threads may still exit (and retire their block) after main returns
+static Registry& registry()
+{
+    static Registry* r = new Registry();
+    return *r;
+}
+
+static double nsPerTick = 1;
+
+// the TSC rate against the steady clock, over a short sleep at startup (instrumented
+// builds only), so no timed region ever pays for it
+static bool calibrateTicks()
+{
+#if defined(__x86_64__) && defined(__GNUC__)
+    auto start = chrono::steady_clock::now();
+    uint64_t ticks = readTicks();
+    this_thread::sleep_for(chrono::milliseconds(5));
+    uint64_t elapsedTicks = readTicks() - ticks;
+    double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+    if (elapsedTicks > 0) nsPerTick = ns / double(elapsedTicks);
+#endif
+    return true;
+}
+static const bool ticksCalibrated = INSTRUMENTATION_ENABLED && calibrateTicks();
+
+static thread_local ThreadBlock* currentBlock = nullptr;
+
+// folds the thread's block into the retired total when the thread ends
+struct BlockReleaser
+{
+    ~BlockReleaser()
+    {
+        ThreadBlock* block = currentBlock;
+        if (!block) return;
+        Registry& r = registry();
+        lock_guard<mutex> guard(r.lock);
+        for (int p = 0; p < HOT_PATH_COUNT; ++p) r.retired[p].merge(block->latency[p]);
+        for (size_t i = 0; i < r.blocks.size(); ++i)
+            if (r.blocks[i] == block)
+            {
+                r.blocks.erase(r.blocks.begin() + i);
+                break;
+            }
+        delete block;
+        currentBlock = nullptr;
+    }
+};
+static thread_local BlockReleaser releaser;
+
+static ThreadBlock* registerThread()
+{
+    (void)ticksCalibrated;
+    (void)&releaser; // constructs it, so its destructor runs at thread exit
+    ThreadBlock* block = new ThreadBlock();
+    Registry& r = registry();
+    lock_guard<mutex> guard(r.lock);
+    if (r.threads++ == 0) r.firstSample = chrono::steady_clock::now();
+    r.blocks.push_back(block);
+    currentBlock = block;
+    return block;
+}
+
+void recordHotPath(HotPath path, uint64_t ticks)
+{
+    ThreadBlock* block = currentBlock;
+    if (!block) block = registerThread();
+    while (block->busy.exchange(true, memory_order_acquire)) this_thread::yield();
+    block->latency[path].record(uint64_t(double(ticks) * nsPerTick));
+    block->busy.store(false, memory_order_release);
+}
+
+void takeSnapshot(InstrumentSnapshot& snapshot)
+{
+    for (LatencyHistogram& h : snapshot.latency) h.clear();
+    snapshot.seconds = 0;
+    Registry& r = registry();
+    lock_guard<mutex> guard(r.lock);
+    for (int p = 0; p < HOT_PATH_COUNT; ++p) snapshot.latency[p].merge(r.retired[p]);
+    for (ThreadBlock* block : r.blocks)
+    {
+        while (block->busy.exchange(true, memory_order_acquire)) this_thread::yield();
+        for (int p = 0; p < HOT_PATH_COUNT; ++p) snapshot.latency[p].merge(block->latency[p]);
+        block->busy.store(false, memory_order_release);
+    }
+    snapshot.threads = r.threads;
+    if (r.threads) snapshot.seconds = chrono::duration<double>(chrono::steady_clock::now() - r.firstSample).count();
+}
+
+string snapshotText(const InstrumentSnapshot& snapshot)
+{
+    if (!INSTRUMENTATION_ENABLED) return "instrumentation is compiled out (configure with -DCHESS_INSTRUMENT=ON)\n";
+    char line[256];
+    snprintf(line, sizeof(line), "%-24s %12s %10s %9s %9s %9s %9s %9s\n", "hot path", "calls", "total", "mean", "p50",
+             "p99", "p99.9", "max");
+    string text = line;
+    for (int p = 0; p < HOT_PATH_COUNT; ++p)
+    {
+        const LatencyHistogram& h = snapshot.latency[p];
+        snprintf(line, sizeof(line), "%-24s %12llu %10s %9s %9s %9s %9s %9s\n", hotPathName(HotPath(p)),
+                 (unsigned long long)h.count(), formatNanoseconds(h.mean() * h.count()).c_str(),
+                 formatNanoseconds(h.mean()).c_str(), formatNanoseconds(double(h.percentile(0.5))).c_str(),
+                 formatNanoseconds(double(h.percentile(0.99))).c_str(),
+                 formatNanoseconds(double(h.percentile(0.999))).c_str(), formatNanoseconds(double(h.max())).c_str());
+        text += line;
+    }
+    snprintf(line, sizeof(line), "%d threads, %.1f s since the first sample\n", snapshot.threads, snapshot.seconds);
+    return text + line;
+}
+
+string snapshotJson(const InstrumentSnapshot& snapshot)
+{
+    char buffer[320];
+    snprintf(buffer, sizeof(buffer), "{\"enabled\":%s,\"threads\":%d,\"seconds\":%.3f,\"paths\":{",
+             INSTRUMENTATION_ENABLED ? "true" : "false", snapshot.threads, snapshot.seconds);
+    string json = buffer;
+    for (int p = 0; p < HOT_PATH_COUNT; ++p)
+    {
+        const LatencyHistogram& h = snapshot.latency[p];
+        snprintf(buffer, sizeof(buffer),
+                 "%s\"%s\":{\"calls\":%llu,\"total_ns\":%.0f,\"mean_ns\":%.1f,\"p50_ns\":%llu,\"p90_ns\":%llu,"
+                 "\"p99_ns\":%llu,\"p999_ns\":%llu,\"max_ns\":%llu}",
+                 p ? "," : "", hotPathName(HotPath(p)), (unsigned long long)h.count(), h.mean() * h.count(), h.mean(),
+                 (unsigned long long)h.percentile(0.5), (unsigned long long)h.percentile(0.9),
+                 (unsigned long long)h.percentile(0.99), (unsigned long long)h.percentile(0.999),
+                 (unsigned long long)h.max());
+        json += buffer;
+    }
+    return json + "}}\n";
+}
+
+// ---- dump on a signal ----
+
+// the handler may only make async-signal-safe calls, so it writes one byte to a pipe and
+// the dump thread does the rest
+static int dumpPipe[2] = { -1, -1 };
+static int jsonDumpSignal = 0;
+
+static void onDumpSignal(int signal)
+{
+    int saved = errno;
+    char kind = signal == jsonDumpSignal ? 'j' : 't';
+    ssize_t written = write(dumpPipe[1], &kind, 1);
+    (void)written;
+    errno = saved;
+}
+
+bool installInstrumentDump(int textSignal, int jsonSignal)
+{
+    if (!INSTRUMENTATION_ENABLED || dumpPipe[0] >= 0) return false;
+    if (pipe(dumpPipe) != 0) return false;
+    jsonDumpSignal = jsonSignal;
+    thread([] {
+        char kind;
+        while (read(dumpPipe[0], &kind, 1) == 1)
+        {
+            InstrumentSnapshot snapshot;
+            takeSnapshot(snapshot);
+            string text = kind == 'j' ? snapshotJson(snapshot) : snapshotText(snapshot);
+            fwrite(text.data(), 1, text.size(), stderr);
+            fflush(stderr);
+        }
+    }).detach();
+    signal(textSignal, onDumpSignal);
+    signal(jsonSignal, onDumpSignal);
+    return true;
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include "histogram.h"
+
+// Call counts and latency histograms for the rules engine's hot paths and the window's
+// frames, for profiling real sessions without an external profiler. Compiled out unless
+// the build defines CHESS_INSTRUMENT (cmake -DCHESS_INSTRUMENT=ON): INSTRUMENT(path) at
+// the top of a function then times it until the scope ends (or INSTRUMENT_END()),
+// otherwise both macros expand to nothing.
+//
+// Each thread records into its own block behind a thread_local pointer; the only shared
+// write is an uncontended flag that lets a snapshot merge the block while its thread
+// keeps running. A finished thread's figures are folded into a retired total. Times are
+// read from the TSC on x86-64 (a few ns per read) and scaled to nanoseconds. Timed
+// regions nest, so isCheckmate includes the time of the checks made inside it.
+
+enum HotPath
+{
+    HOT_IS_VALID_MOVE,
+    HOT_WOULD_BE_IN_CHECK,
+    HOT_IS_SQUARE_ATTACKED,
+    HOT_IS_CHECKMATE,
+    HOT_IS_STALEMATE,
+    HOT_FRAME,
+    HOT_PATH_COUNT
+};
+
+const char* hotPathName(HotPath path); // "isValidMove", ..., "frame"
+
+#ifdef CHESS_INSTRUMENT
+const bool INSTRUMENTATION_ENABLED = true;
+#else
+const bool INSTRUMENTATION_ENABLED = false;
+#endif
+
+struct InstrumentSnapshot
+{
+    LatencyHistogram latency[HOT_PATH_COUNT]; // nanoseconds; count() is the number of calls
+    int threads = 0;                          // threads that recorded anything, finished ones included
+    double seconds = 0;                       // since the first sample
+};
+
+// merges every thread's figures (empty when compiled out)
+void takeSnapshot(InstrumentSnapshot& snapshot);
+// one row per hot path: calls, total and mean time, percentiles
+std::string snapshotText(const InstrumentSnapshot& snapshot);
+std::string snapshotJson(const InstrumentSnapshot& snapshot);
+// Writes a snapshot to stderr whenever textSignal (a table) or jsonSignal arrives, from a
+// background thread (the handler only wakes it). False when compiled out or on failure.
+bool installInstrumentDump(int textSignal, int jsonSignal);
+
+// ---- recording ----
+
+inline uint64_t readTicks()
+{
+#if defined(__x86_64__) && defined(__GNUC__)
+    return __builtin_ia32_rdtsc();
+#else
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+void recordHotPath(HotPath path, uint64_t ticks);
+
+class HotPathTimer
+{
+public:
+    explicit HotPathTimer(HotPath path) : path(path), start(readTicks()) {}
+    ~HotPathTimer() { stop(); }
+    void stop()
+    {
+        if (stopped) return;
+        recordHotPath(path, readTicks() - start);
+        stopped = true;
+    }
+
+private:
+    HotPath path;
+    uint64_t start;
+    bool stopped = false;
+};
+
+#ifdef CHESS_INSTRUMENT
+#define INSTRUMENT(path) HotPathTimer hotPathTimer(path)
+#define INSTRUMENT_END() hotPathTimer.stop()
+#else
+#define INSTRUMENT(path) ((void)0)
+#define INSTRUMENT_END() ((void)0)
+#endif
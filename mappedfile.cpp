@@ -0,0 +1,46 @@
+#include "mappedfile.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+bool MappedFile::open(const string& path, bool sequential)
+{
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    length = size_t(st.st_size);
+    if (length > 0)
+    {
+        void* memory = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        if (memory == MAP_FAILED)
+        {
+            ::close(fd);
+            length = 0;
+            return false;
+        }
+        base = static_cast<const char*>(memory);
+        madvise(memory, length, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+    }
+    // the mapping keeps the file alive on its own
+    ::close(fd);
+    opened = true;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (base) munmap(const_cast<char*>(base), length);
+    base = nullptr;
+    length = 0;
+    opened = false;
+}
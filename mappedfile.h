@@ -0,0 +1,28 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// Read-only memory map of a whole file. Pages are loaded by the kernel on demand and
+// dropped under memory pressure, so even huge archives cost no heap memory.
+class MappedFile
+{
+public:
+    MappedFile() {}
+    ~MappedFile() { close(); }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // sequential hints the kernel to read ahead aggressively (one pass over the file);
+    // leave it off for random access such as index or table probes
+    bool open(const std::string& path, bool sequential = false);
+    void close();
+
+    const char* data() const { return base; }
+    size_t size() const { return length; }
+    bool isOpen() const { return opened; }
+
+private:
+    const char* base = nullptr;
+    size_t length = 0;
+    bool opened = false; // an empty file maps nothing but is still open
+};
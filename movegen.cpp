@@ -0,0 +1,176 @@
+#include "movegen.h"
+#include "rules.h"
+
+using namespace std;
+
+const Bitboard RANK_1 = 0x00000000000000FFULL;
+const Bitboard RANK_8 = 0xFF00000000000000ULL;
+
+static void addPawnMove(MoveList& list, int from, int to)
+{
+    if (squareBB(to) & (RANK_1 | RANK_8))
+    {
+        for (int type = QUEEN; type >= KNIGHT; --type)
+            list.add(makeMoveCode(from, to, PROMOTION, type));
+    }
+    else
+        list.add(makeMoveCode(from, to));
+}
+
+// Legality is decided before a move is emitted, from three masks computed once per call:
+//   checkers - enemy pieces giving check (two of them: only the king may move)
+//   target   - squares that resolve a single check (capture the checker or block its ray)
+//   pinned   - own pieces alone between the king and an enemy slider; they may only
+//              slide along lineTable[king][from]
+// so no candidate move is ever played out on a scratch board.
+struct LegalityMasks
+{
+    int kingSquare;
+    Bitboard checkers;
+    Bitboard target;
+    Bitboard pinned;
+};
+
+static Bitboard allowedTargets(const LegalityMasks& m, int from)
+{
+    return (m.pinned & squareBB(from)) ? m.target & lineTable[m.kingSquare][from] : m.target;
+}
+
+static void generatePawnMoves(const Position& pos, const LegalityMasks& m, MoveList& list)
+{
+    bool white = pos.whiteToMove;
+    int us = white ? WHITE : BLACK;
+    Bitboard enemy = pos.byColor[us ^ 1];
+    Bitboard empty = ~pos.occupied;
+    Bitboard pawns = pos.pieces[us][PAWN];
+    int up = white ? 8 : -8;
+
+    // pushes are generated set-wise: shift every pawn one rank forward at once
+    Bitboard single = (white ? pawns << 8 : pawns >> 8) & empty;
+    Bitboard thirdRank = white ? 0x0000000000FF0000ULL : 0x0000FF0000000000ULL;
+    Bitboard dbl = (white ? (single & thirdRank) << 8 : (single & thirdRank) >> 8) & empty;
+    single &= m.target;
+    dbl &= m.target;
+
+    while (single)
+    {
+        int to = popLsb(single);
+        if (allowedTargets(m, to - up) & squareBB(to)) addPawnMove(list, to - up, to);
+    }
+    while (dbl)
+    {
+        int to = popLsb(dbl);
+        if (allowedTargets(m, to - 2 * up) & squareBB(to)) list.add(makeMoveCode(to - 2 * up, to));
+    }
+
+    Bitboard b = pawns;
+    while (b)
+    {
+        int from = popLsb(b);
+        Bitboard captures = pawnAttackTable[us][from] & enemy & allowedTargets(m, from);
+        while (captures) addPawnMove(list, from, popLsb(captures));
+
+        if (pos.epSquare >= 0 && (pawnAttackTable[us][from] & squareBB(pos.epSquare)))
+        {
+            // en passant empties two squares on the same rank, which no pin mask covers;
+            // recheck the king against the occupancy as it will be after the capture
+            int captured = pos.epSquare - up;
+            Bitboard after = (pos.occupied ^ squareBB(from) ^ squareBB(captured)) | squareBB(pos.epSquare);
+            Bitboard attackers = attackersTo(pos, m.kingSquare, after) & enemy & ~squareBB(captured);
+            if (!attackers) list.add(makeMoveCode(from, pos.epSquare, EN_PASSANT));
+        }
+    }
+}
+
+void generateLegalMoves(const Position& pos, MoveList& list)
+{
+    list.count = 0;
+    int us = pos.whiteToMove ? WHITE : BLACK, them = us ^ 1;
+    Bitboard own = pos.byColor[us], enemy = pos.byColor[them];
+
+    LegalityMasks m;
+    m.kingSquare = lsb(pos.pieces[us][KING]);
+    m.checkers = attackersTo(pos, m.kingSquare, pos.occupied) & enemy;
+
+    // king steps: lift the king off the board so it cannot hide behind itself on a slider ray
+    Bitboard withoutKing = pos.occupied ^ squareBB(m.kingSquare);
+    Bitboard kingTargets = kingAttackTable[m.kingSquare] & ~own;
+    while (kingTargets)
+    {
+        int to = popLsb(kingTargets);
+        if (!(attackersTo(pos, to, withoutKing) & enemy)) list.add(makeMoveCode(m.kingSquare, to));
+    }
+
+    // double check: only the king can move
+    if (m.checkers & (m.checkers - 1)) return;
+
+    m.target = ~own;
+    if (m.checkers) m.target &= m.checkers | betweenTable[m.kingSquare][lsb(m.checkers)];
+
+    m.pinned = 0;
+    Bitboard snipers = (rookAttacks(m.kingSquare, 0) & (pos.pieces[them][ROOK] | pos.pieces[them][QUEEN]))
+                     | (bishopAttacks(m.kingSquare, 0) & (pos.pieces[them][BISHOP] | pos.pieces[them][QUEEN]));
+    while (snipers)
+    {
+        Bitboard blockers = betweenTable[m.kingSquare][popLsb(snipers)] & pos.occupied;
+        if (blockers && !(blockers & (blockers - 1)) && (blockers & own)) m.pinned |= blockers;
+    }
+
+    generatePawnMoves(pos, m, list);
+
+    for (int type = KNIGHT; type <= QUEEN; ++type)
+    {
+        Bitboard b = pos.pieces[us][type];
+        while (b)
+        {
+            int from = popLsb(b);
+            Bitboard targets = attacksFrom(pos.mailbox[from], from, pos.occupied) & allowedTargets(m, from);
+            while (targets) list.add(makeMoveCode(from, popLsb(targets)));
+        }
+    }
+
+    if (!m.checkers)
+    {
+        int king = us == WHITE ? 4 : 60;
+        if (canCastle(pos, pos.whiteToMove, true)) list.add(makeMoveCode(king, king + 2, CASTLING));
+        if (canCastle(pos, pos.whiteToMove, false)) list.add(makeMoveCode(king, king - 2, CASTLING));
+    }
+}
+
+Bitboard legalDestinations(const Position& pos, int from)
+{
+    MoveList list;
+    generateLegalMoves(pos, list);
+    Bitboard targets = 0;
+    for (int i = 0; i < list.count; ++i)
+        if (moveFrom(list.moves[i]) == from) targets |= squareBB(moveTo(list.moves[i]));
+    return targets;
+}
+
+Move moveFromUci(const Position& pos, const string& text)
+{
+    MoveList list;
+    generateLegalMoves(pos, list);
+    for (int i = 0; i < list.count; ++i)
+        if (moveToUci(list.moves[i]) == text) return list.moves[i];
+    return NO_MOVE;
+}
+
+uint64_t perft(Position& pos, int depth)
+{
+    if (depth <= 0) return 1;
+
+    MoveList list;
+    generateLegalMoves(pos, list);
+    // bulk count: the last ply only needs the number of legal moves
+    if (depth == 1) return list.count;
+
+    uint64_t nodes = 0;
+    for (int i = 0; i < list.count; ++i)
+    {
+        makeMove(pos, list.moves[i]);
+        nodes += perft(pos, depth - 1);
+        unmakeMove(pos);
+    }
+    return nodes;
+}
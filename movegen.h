@@ -0,0 +1,25 @@
+#pragma once
+#include <string>
+#include "position.h"
+
+struct MoveList
+{
+    Move moves[256];
+    int count = 0;
+
+    void add(Move m) { moves[count++] = m; }
+};
+
+// every legal move for the side to move, including castling, en passant and
+// all four promotion choices
+void generateLegalMoves(const Position& pos, MoveList& list);
+
+// squares the piece on from can legally move to (promotion choices collapse into one bit)
+Bitboard legalDestinations(const Position& pos, int from);
+
+// the legal move written as long algebraic "e2e4" / "e7e8q", or NO_MOVE
+Move moveFromUci(const Position& pos, const std::string& text);
+
+// leaf nodes reachable in exactly depth plies; walks the tree with make/unmake,
+// so pos is back in its original state on return
+uint64_t perft(Position& pos, int depth);
@@ -0,0 +1,292 @@
+#include "nnue.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "evaluate.h"
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "network files are used in host byte order");
+static_assert(NNUE_HIDDEN % 32 == 0, "the SIMD kernels work on 32 neurons at a time");
+
+static const char fileMagic[4] = { 'C', 'N', 'U', 'E' };
+const uint32_t FILE_VERSION = 1;
+const size_t HEADER_BYTES = 64;
+
+static size_t align64(size_t bytes) { return (bytes + 63) & ~size_t(63); }
+
+// section offsets, for reading and writing alike
+const size_t BIAS_OFFSET = HEADER_BYTES;
+const size_t WEIGHTS_OFFSET = BIAS_OFFSET + align64(NNUE_HIDDEN * sizeof(int16_t));
+const size_t OUTPUT_OFFSET = WEIGHTS_OFFSET + align64(size_t(NNUE_INPUTS) * NNUE_HIDDEN * sizeof(int16_t));
+const size_t OUTPUT_BIAS_OFFSET = OUTPUT_OFFSET + align64(2 * NNUE_HIDDEN);
+const size_t FILE_BYTES = OUTPUT_BIAS_OFFSET + 64;
+
+struct FileHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t hidden;
+    int32_t outputScale;
+};
+
+bool NnueNetwork::load(const string& path)
+{
+    close();
+    if (!file.open(path) || file.size() != FILE_BYTES) return false;
+    FileHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, fileMagic, 4) != 0 || header.version != FILE_VERSION || header.hidden != NNUE_HIDDEN)
+        return false;
+
+    // the map is page-aligned and every section 64-byte aligned, so the weights are used in place
+    featureBias = (const int16_t*)(file.data() + BIAS_OFFSET);
+    featureWeights = (const int16_t*)(file.data() + WEIGHTS_OFFSET);
+    outputWeights = (const int8_t*)(file.data() + OUTPUT_OFFSET);
+    memcpy(&outputBias, file.data() + OUTPUT_BIAS_OFFSET, sizeof(outputBias));
+    outputScale = header.outputScale;
+    loaded = true;
+    return true;
+}
+
+// ---- kernels ----
+// update: acc += every added column - every removed column, in one pass over acc.
+// output: clipped activations of both halves (side to move first) . output weights.
+// The SIMD versions give exactly the scalar results: activations fit in a byte and two
+// products of 127 * 127 never saturate the int16 pair sums of maddubs.
+
+struct NnueKernels
+{
+    void (*update)(int16_t* acc, const int16_t* const* added, int addedCount,
+                   const int16_t* const* removed, int removedCount);
+    int32_t (*output)(const int16_t* us, const int16_t* them, const int8_t* weights);
+};
+
+static void updateScalar(int16_t* acc, const int16_t* const* added, int addedCount,
+                         const int16_t* const* removed, int removedCount)
+{
+    for (int i = 0; i < NNUE_HIDDEN; ++i)
+    {
+        int v = acc[i];
+        for (int k = 0; k < addedCount; ++k) v += added[k][i];
+        for (int k = 0; k < removedCount; ++k) v -= removed[k][i];
+        acc[i] = int16_t(v);
+    }
+}
+
+static int32_t outputScalar(const int16_t* us, const int16_t* them, const int8_t* weights)
+{
+    int32_t sum = 0;
+    for (int i = 0; i < NNUE_HIDDEN; ++i)
+        sum += clamp<int>(us[i], 0, NNUE_ACTIVATION_MAX) * weights[i];
+    for (int i = 0; i < NNUE_HIDDEN; ++i)
+        sum += clamp<int>(them[i], 0, NNUE_ACTIVATION_MAX) * weights[NNUE_HIDDEN + i];
+    return sum;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+// target attributes instead of -mavx2 / -msse4.1 so the rest of the build still runs anywhere
+
+__attribute__((target("sse4.1"))) static void updateSse4(int16_t* acc, const int16_t* const* added, int addedCount,
+                                                          const int16_t* const* removed, int removedCount)
+{
+    for (int i = 0; i < NNUE_HIDDEN; i += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(acc + i));
+        for (int k = 0; k < addedCount; ++k) v = _mm_add_epi16(v, _mm_loadu_si128((const __m128i*)(added[k] + i)));
+        for (int k = 0; k < removedCount; ++k) v = _mm_sub_epi16(v, _mm_loadu_si128((const __m128i*)(removed[k] + i)));
+        _mm_storeu_si128((__m128i*)(acc + i), v);
+    }
+}
+
+__attribute__((target("sse4.1"))) static int32_t outputSse4(const int16_t* us, const int16_t* them, const int8_t* weights)
+{
+    const __m128i ceiling = _mm_set1_epi16(NNUE_ACTIVATION_MAX), ones = _mm_set1_epi16(1);
+    __m128i sum = _mm_setzero_si128();
+    const int16_t* halves[2] = { us, them };
+    for (int h = 0; h < 2; ++h)
+        for (int i = 0; i < NNUE_HIDDEN; i += 16)
+        {
+            // min caps at 127, the unsigned pack floors at 0
+            __m128i a = _mm_min_epi16(_mm_loadu_si128((const __m128i*)(halves[h] + i)), ceiling);
+            __m128i b = _mm_min_epi16(_mm_loadu_si128((const __m128i*)(halves[h] + i + 8)), ceiling);
+            __m128i active = _mm_packus_epi16(a, b);
+            __m128i w = _mm_loadu_si128((const __m128i*)(weights + h * NNUE_HIDDEN + i));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_maddubs_epi16(active, w), ones));
+        }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+    return _mm_cvtsi128_si32(sum);
+}
+
+__attribute__((target("avx2"))) static void updateAvx2(int16_t* acc, const int16_t* const* added, int addedCount,
+                                                        const int16_t* const* removed, int removedCount)
+{
+    for (int i = 0; i < NNUE_HIDDEN; i += 16)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(acc + i));
+        for (int k = 0; k < addedCount; ++k) v = _mm256_add_epi16(v, _mm256_loadu_si256((const __m256i*)(added[k] + i)));
+        for (int k = 0; k < removedCount; ++k) v = _mm256_sub_epi16(v, _mm256_loadu_si256((const __m256i*)(removed[k] + i)));
+        _mm256_storeu_si256((__m256i*)(acc + i), v);
+    }
+}
+
+__attribute__((target("avx2"))) static int32_t outputAvx2(const int16_t* us, const int16_t* them, const int8_t* weights)
+{
+    const __m256i ceiling = _mm256_set1_epi16(NNUE_ACTIVATION_MAX), ones = _mm256_set1_epi16(1);
+    __m256i sum = _mm256_setzero_si256();
+    const int16_t* halves[2] = { us, them };
+    for (int h = 0; h < 2; ++h)
+        for (int i = 0; i < NNUE_HIDDEN; i += 32)
+        {
+            __m256i a = _mm256_min_epi16(_mm256_loadu_si256((const __m256i*)(halves[h] + i)), ceiling);
+            __m256i b = _mm256_min_epi16(_mm256_loadu_si256((const __m256i*)(halves[h] + i + 16)), ceiling);
+            // the pack works per 128-bit lane (a0-7 b0-7 | a8-15 b8-15): put the quarters back in order
+            __m256i active = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8);
+            __m256i w = _mm256_loadu_si256((const __m256i*)(weights + h * NNUE_HIDDEN + i));
+            sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_maddubs_epi16(active, w), ones));
+        }
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+    return _mm_cvtsi128_si32(s);
+}
+#endif
+
+static const NnueKernels kernelTable[3] = {
+    { updateScalar, outputScalar },
+#if defined(__x86_64__) && defined(__GNUC__)
+    { updateSse4, outputSse4 },
+    { updateAvx2, outputAvx2 },
+#else
+    { updateScalar, outputScalar }, // never selected
+    { updateScalar, outputScalar },
+#endif
+};
+
+static NnueKernel activeKernel = NNUE_SCALAR;
+static const NnueKernels* kernels = &kernelTable[NNUE_SCALAR];
+
+bool nnueKernelSupported(NnueKernel kernel)
+{
+#if defined(__x86_64__) && defined(__GNUC__)
+    if (kernel == NNUE_AVX2) return __builtin_cpu_supports("avx2");
+    if (kernel == NNUE_SSE4) return __builtin_cpu_supports("sse4.1");
+    return true;
+#else
+    return kernel == NNUE_SCALAR;
+#endif
+}
+
+bool selectNnueKernel(NnueKernel kernel)
+{
+    if (!nnueKernelSupported(kernel)) return false;
+    activeKernel = kernel;
+    kernels = &kernelTable[kernel];
+    return true;
+}
+
+NnueKernel activeNnueKernel() { return activeKernel; }
+
+const char* nnueKernelName(NnueKernel kernel)
+{
+    static const char* names[] = { "scalar", "sse4.1", "avx2" };
+    return names[kernel];
+}
+
+static const bool kernelReady = selectNnueKernel(NNUE_AVX2) || selectNnueKernel(NNUE_SSE4);
+
+// ---- accumulators ----
+
+// weight column of one piece (colour * 6 + type) on sq, seen from side
+static const int16_t* featureColumn(const NnueNetwork* net, int side, int piece, int sq)
+{
+    int color = piece / 6, type = piece % 6;
+    int input = ((color != side) * 6 + type) * 64 + (side == WHITE ? sq : sq ^ 56);
+    return net->featureWeights + size_t(input) * NNUE_HIDDEN;
+}
+
+void refreshAccumulators(Position& pos)
+{
+    if (!pos.network) return;
+    for (int side = WHITE; side <= BLACK; ++side)
+    {
+        const int16_t* columns[32];
+        int count = 0;
+        for (int piece = 0; piece < 12; ++piece)
+            for (Bitboard b = pos.pieces[piece / 6][piece % 6]; b && count < 32;)
+                columns[count++] = featureColumn(pos.network, side, piece, popLsb(b));
+        memcpy(pos.accumulator[side], pos.network->featureBias, sizeof(pos.accumulator[side]));
+        kernels->update(pos.accumulator[side], columns, count, nullptr, 0);
+    }
+}
+
+void attachNetwork(Position& pos, const NnueNetwork* net)
+{
+    pos.network = net && net->isLoaded() ? net : nullptr;
+    refreshAccumulators(pos);
+}
+
+void updateAccumulators(Position& pos, const NnueDelta& delta)
+{
+    for (int side = WHITE; side <= BLACK; ++side)
+    {
+        const int16_t* added[2];
+        const int16_t* removed[2];
+        for (int k = 0; k < delta.addedCount; ++k)
+            added[k] = featureColumn(pos.network, side, delta.addedPiece[k], delta.addedSquare[k]);
+        for (int k = 0; k < delta.removedCount; ++k)
+            removed[k] = featureColumn(pos.network, side, delta.removedPiece[k], delta.removedSquare[k]);
+        kernels->update(pos.accumulator[side], added, delta.addedCount, removed, delta.removedCount);
+    }
+}
+
+int nnueEvaluate(const Position& pos)
+{
+    const NnueNetwork& net = *pos.network;
+    int us = pos.whiteToMove ? WHITE : BLACK;
+    int32_t out = kernels->output(pos.accumulator[us], pos.accumulator[us ^ 1], net.outputWeights) + net.outputBias;
+    return int(int64_t(out) * net.outputScale / NNUE_OUTPUT_DIVISOR);
+}
+
+// Every neuron sees the same weights (a piece's value, negated for the opponent's), so
+// each holds the piece-square score plus its own bias. The biases step by 127, so the
+// clipped neurons form a staircase whose sum is that score plus a constant over a range
+// of +-127 * NNUE_HIDDEN / 2 centipawns. The opponent's half enters with weight -1,
+// which cancels the constant and doubles the score; the scale halves it again.
+bool writePieceSquareNetwork(const string& path)
+{
+    vector<char> out(FILE_BYTES, 0);
+    FileHeader header = { { 'C', 'N', 'U', 'E' }, FILE_VERSION, NNUE_HIDDEN, NNUE_OUTPUT_DIVISOR / 2 };
+    memcpy(out.data(), &header, sizeof(header));
+
+    int16_t* bias = (int16_t*)(out.data() + BIAS_OFFSET);
+    for (int j = 0; j < NNUE_HIDDEN; ++j) bias[j] = int16_t(NNUE_ACTIVATION_MAX * (j - NNUE_HIDDEN / 2));
+
+    int16_t* weights = (int16_t*)(out.data() + WEIGHTS_OFFSET);
+    for (int relative = 0; relative < 2; ++relative)
+        for (int type = PAWN; type <= KING; ++type)
+            for (int sq = 0; sq < 64; ++sq)
+            {
+                // squares are already seen from the perspective; the opponent's tables run the other way
+                int value = relative == 0 ? pieceSquareValue(type, sq) : -pieceSquareValue(type, sq ^ 56);
+                int16_t* row = weights + size_t((relative * 6 + type) * 64 + sq) * NNUE_HIDDEN;
+                for (int j = 0; j < NNUE_HIDDEN; ++j) row[j] = int16_t(value);
+            }
+
+    int8_t* output = (int8_t*)(out.data() + OUTPUT_OFFSET);
+    for (int j = 0; j < NNUE_HIDDEN; ++j)
+    {
+        output[j] = 1;
+        output[NNUE_HIDDEN + j] = -1;
+    }
+
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f) return false;
+    bool ok = fwrite(out.data(), 1, out.size(), f) == out.size();
+    return fclose(f) == 0 && ok;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "mappedfile.h"
+#include "position.h"
+
+// Efficiently updatable evaluation network: 768 inputs (colour relative to the
+// perspective x piece type x square, ranks mirrored for Black) -> NNUE_HIDDEN int16
+// neurons per perspective -> clipped ReLU [0, 127] -> one int8-weighted output.
+//
+// The first layer is a sum of weight columns, one per piece on the board, so a move
+// only adds and subtracts the columns of the pieces it moves. Position keeps both
+// perspectives' sums (pos.accumulator); makeMove/unmakeMove update them whenever
+// pos.network is set, and evaluate() then only runs the small output layer.
+//
+// Network file, little-endian, every section starting on a 64-byte boundary:
+//   header           "CNUE", version u32 (1), hidden size u32, output scale i32, zero padding to 64
+//   feature biases   int16 x hidden
+//   feature weights  int16 x 768 x hidden, one row per input: (relative colour * 6 + type) * 64 + square
+//   output weights   int8 x 2 x hidden, the side to move's half first
+//   output bias      int32, zero padding to 64
+// Score in centipawns = (output weights . activations + bias) * scale / (127 * 64).
+// The file is memory-mapped and used in place.
+
+const int NNUE_INPUTS = 768;
+const int NNUE_ACTIVATION_MAX = 127;
+const int NNUE_OUTPUT_DIVISOR = 127 * 64;
+
+class NnueNetwork
+{
+public:
+    bool load(const std::string& path);
+    void close() { file.close(); loaded = false; }
+    bool isLoaded() const { return loaded; }
+
+    const int16_t* featureBias = nullptr;
+    const int16_t* featureWeights = nullptr;
+    const int8_t* outputWeights = nullptr;
+    int32_t outputBias = 0;
+    int32_t outputScale = 0;
+
+private:
+    MappedFile file;
+    bool loaded = false;
+};
+
+// The SIMD kernels are chosen at startup from the CPU; the benchmark switches
+// between them. selectNnueKernel is not thread-safe and returns false if the CPU
+// lacks the instructions.
+enum NnueKernel { NNUE_SCALAR, NNUE_SSE4, NNUE_AVX2 };
+bool nnueKernelSupported(NnueKernel kernel);
+bool selectNnueKernel(NnueKernel kernel);
+NnueKernel activeNnueKernel();
+const char* nnueKernelName(NnueKernel kernel);
+
+// net == nullptr detaches (evaluate() goes back to the piece-square tables).
+// setFromFen / initializeBoard also detach.
+void attachNetwork(Position& pos, const NnueNetwork* net);
+// recomputes both accumulators from the pieces on the board
+void refreshAccumulators(Position& pos);
+
+// pieces (colour * 6 + type) a move takes off and puts on squares; makeMove and
+// unmakeMove fill one in and apply it in a single pass over each accumulator
+struct NnueDelta
+{
+    int removedCount = 0, addedCount = 0;
+    int removedPiece[2], removedSquare[2];
+    int addedPiece[2], addedSquare[2];
+
+    void remove(int piece, int sq) { removedPiece[removedCount] = piece; removedSquare[removedCount++] = sq; }
+    void add(int piece, int sq) { addedPiece[addedCount] = piece; addedSquare[addedCount++] = sq; }
+};
+void updateAccumulators(Position& pos, const NnueDelta& delta);
+
+// centipawns from the side to move's view; pos.network must be set
+int nnueEvaluate(const Position& pos);
+
+// Writes a network that reproduces the material + piece-square evaluation (with the
+// middlegame king table): a starting point to train from, and a reference the
+// kernels can be checked against.
+bool writePieceSquareNetwork(const std::string& path);
@@ -0,0 +1,23 @@
+// Build step: packs pieces/*.png into one atlas image plus its metadata table.
+#include <iostream>
+#include "atlas.h"
+
+using namespace std;
+
+int main(int argc, char** argv)
+{
+    if (argc != 4)
+    {
+        cerr << "usage: pack-atlas <pieces-dir> <atlas.png> <atlas.txt>\n";
+        return 1;
+    }
+
+    PieceAtlasImage atlas;
+    if (!packPieceImages(argv[1], atlas)) return 1;
+    if (!saveAtlas(atlas, argv[2], argv[3]))
+    {
+        cerr << "cannot write " << argv[2] << " / " << argv[3] << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,333 @@
+#include "pgn.h"
+#include <cctype>
+#include <cstring>
+#include "movegen.h"
+#include "rules.h"
+
+using namespace std;
+
+Move moveFromSan(const Position& pos, string_view san)
+{
+    // annotations never change which move is meant
+    while (!san.empty() && (san.back() == '+' || san.back() == '#' || san.back() == '!' || san.back() == '?'))
+        san.remove_suffix(1);
+    if (san.size() < 2) return NO_MOVE;
+
+    MoveList list;
+    generateLegalMoves(pos, list);
+
+    if (san == "O-O" || san == "0-0" || san == "O-O-O" || san == "0-0-0")
+    {
+        int file = san.size() == 3 ? 6 : 2;
+        for (int i = 0; i < list.count; ++i)
+            if (moveKind(list.moves[i]) == CASTLING && colOf(moveTo(list.moves[i])) == file) return list.moves[i];
+        return NO_MOVE;
+    }
+
+    int type = PAWN;
+    if (strchr("NBRQK", san[0])) { type = pieceTypeOf(san[0]); san.remove_prefix(1); }
+
+    // promotion: "e8=Q", also seen without the '='
+    int promotion = PIECE_TYPE_NB;
+    if (type == PAWN && san.size() >= 2 && strchr("NBRQ", san.back()))
+    {
+        promotion = pieceTypeOf(san.back());
+        san.remove_suffix(san[san.size() - 2] == '=' ? 2 : 1);
+    }
+
+    if (san.size() < 2) return NO_MOVE;
+    char toFile = san[san.size() - 2], toRank = san[san.size() - 1];
+    if (toFile < 'a' || toFile > 'h' || toRank < '1' || toRank > '8') return NO_MOVE;
+    int to = (toRank - '1') * 8 + (toFile - 'a');
+
+    // whatever is left is disambiguation and the capture mark
+    int fromFile = -1, fromRank = -1;
+    bool capture = false;
+    for (char ch : san.substr(0, san.size() - 2))
+    {
+        if (ch >= 'a' && ch <= 'h') fromFile = ch - 'a';
+        else if (ch >= '1' && ch <= '8') fromRank = ch - '1';
+        else if (ch == 'x' || ch == ':') capture = true;
+        else return NO_MOVE;
+    }
+
+    Move found = NO_MOVE;
+    for (int i = 0; i < list.count; ++i)
+    {
+        Move m = list.moves[i];
+        int from = moveFrom(m);
+        if (moveTo(m) != to || pieceTypeOf(pos.mailbox[from]) != type || moveKind(m) == CASTLING) continue;
+        if (fromFile >= 0 && colOf(from) != fromFile) continue;
+        if (fromRank >= 0 && from / 8 != fromRank) continue;
+        if ((moveKind(m) == PROMOTION) != (promotion != PIECE_TYPE_NB)) continue;
+        if (moveKind(m) == PROMOTION && promotionType(m) != promotion) continue;
+        // a missing 'x' is tolerated, a capture mark on a quiet move is not
+        if (capture && pos.mailbox[moveTo(m)] == ' ' && moveKind(m) != EN_PASSANT) continue;
+        if (found != NO_MOVE) return NO_MOVE; // ambiguous
+        found = m;
+    }
+    return found;
+}
+
+string moveToSan(const Position& pos, Move m)
+{
+    int from = moveFrom(m), to = moveTo(m);
+    int type = pieceTypeOf(pos.mailbox[from]);
+    string san;
+    if (moveKind(m) == CASTLING) san = colOf(to) == 6 ? "O-O" : "O-O-O";
+    else
+    {
+        bool capture = pos.mailbox[to] != ' ' || moveKind(m) == EN_PASSANT;
+        if (type == PAWN)
+        {
+            if (capture) san += char('a' + colOf(from));
+        }
+        else
+        {
+            san += "PNBRQK"[type];
+            // name the file, else the rank, else both, only as far as other movers need it
+            MoveList list;
+            generateLegalMoves(pos, list);
+            bool clash = false, sameFile = false, sameRank = false;
+            for (int i = 0; i < list.count; ++i)
+            {
+                int other = moveFrom(list.moves[i]);
+                if (other == from || moveTo(list.moves[i]) != to || pos.mailbox[other] != pos.mailbox[from]) continue;
+                clash = true;
+                sameFile |= colOf(other) == colOf(from);
+                sameRank |= other / 8 == from / 8;
+            }
+            if (clash && (!sameFile || sameRank)) san += char('a' + colOf(from));
+            if (clash && sameFile) san += char('1' + from / 8);
+        }
+        if (capture) san += 'x';
+        san += squareName(to);
+        if (moveKind(m) == PROMOTION) { san += '='; san += "PNBRQK"[promotionType(m)]; }
+    }
+
+    Position after = pos;
+    makeMove(after, m);
+    if (isKingInCheck(after, after.whiteToMove)) san += isCheckmate(after, after.whiteToMove) ? '#' : '+';
+    return san;
+}
+
+static bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+// start of the line before the one starting at lineStart, skipping blank lines; npos if none
+static size_t previousLineStart(string_view text, size_t lineStart)
+{
+    size_t i = lineStart;
+    while (i > 0 && isBlank(text[i - 1])) --i;
+    if (i == 0) return string_view::npos;
+    while (i > 0 && text[i - 1] != '\n') --i;
+    while (i < lineStart && (text[i] == ' ' || text[i] == '\t')) ++i;
+    return i;
+}
+
+size_t nextLine(string_view text, size_t from)
+{
+    size_t end = text.find('\n', from);
+    return end == string_view::npos ? text.size() : end + 1;
+}
+
+size_t nextPgnGame(string_view text, size_t from)
+{
+    // snap to the start of a line first
+    size_t line = from;
+    if (line > 0 && line < text.size() && text[line - 1] != '\n') line = nextLine(text, line);
+    for (; line < text.size(); line = nextLine(text, line))
+    {
+        if (text[line] != '[') continue;
+        size_t previous = previousLineStart(text, line);
+        if (previous == string_view::npos || text[previous] != '[') return line;
+    }
+    return text.size();
+}
+
+static bool isResult(string_view token)
+{
+    return token == "1-0" || token == "0-1" || token == "1/2-1/2" || token == "*";
+}
+
+// [Name "Value"] -> name, value (escapes are left as they are; FEN and Result have none)
+static bool parseTag(string_view line, string_view& name, string_view& value)
+{
+    size_t open = line.find('"'), close = line.rfind('"');
+    if (line.size() < 2 || line[0] != '[' || open == string_view::npos || close <= open) return false;
+    name = line.substr(1, open - 1);
+    while (!name.empty() && isBlank(name.back())) name.remove_suffix(1);
+    value = line.substr(open + 1, close - open - 1);
+    return true;
+}
+
+// what the final position says about the result, checked against the claimed one
+static string checkOutcome(const Position& pos, const string& result)
+{
+    bool mover = pos.whiteToMove;
+    if (isCheckmate(pos, mover))
+    {
+        const char* expected = mover ? "0-1" : "1-0";
+        if (result != expected && result != "*") return "checkmate but result is " + result;
+    }
+    else if (isStalemate(pos, mover))
+    {
+        if (result != "1/2-1/2" && result != "*") return "stalemate but result is " + result;
+    }
+    return "";
+}
+
+GameVerdict replayPgnGame(string_view game, Position& pos, GameRecord* record)
+{
+    GameVerdict verdict;
+    auto fail = [&verdict](const string& error) {
+        verdict.ok = false;
+        verdict.error = error;
+        return verdict;
+    };
+
+    // tag section: only FEN and Result matter here
+    string tagResult;
+    bool fromFen = false;
+    size_t i = 0;
+    while (i < game.size())
+    {
+        while (i < game.size() && isBlank(game[i])) ++i;
+        if (i >= game.size() || game[i] != '[') break;
+        size_t end = nextLine(game, i);
+        string_view name, value;
+        if (!parseTag(game.substr(i, end - i), name, value)) return fail("malformed tag line");
+        if (name == "Result") tagResult = string(value);
+        if (name == "FEN")
+        {
+            if (!setFromFen(pos, string(value))) return fail("invalid FEN tag");
+            fromFen = true;
+            if (record) record->startFen = string(value);
+        }
+        i = end;
+    }
+    if (!fromFen) initializeBoard(pos);
+    if (record)
+    {
+        if (!fromFen) record->startFen.clear();
+        record->moves.clear();
+    }
+
+    bool markedMate = false;
+    while (i < game.size())
+    {
+        char c = game[i];
+        if (isBlank(c)) { ++i; continue; }
+        if (c == '{')
+        {
+            size_t end = game.find('}', i);
+            if (end == string_view::npos) return fail("unterminated comment");
+            i = end + 1;
+            continue;
+        }
+        if (c == ';' || (c == '%' && (i == 0 || game[i - 1] == '\n')))
+        {
+            i = nextLine(game, i);
+            continue;
+        }
+        if (c == '(')
+        {
+            // variations are alternatives, not part of the game: skip them, nesting included
+            int depth = 0;
+            for (; i < game.size(); ++i)
+            {
+                if (game[i] == '{') { size_t end = game.find('}', i); i = end == string_view::npos ? game.size() - 1 : end; }
+                else if (game[i] == '(') ++depth;
+                else if (game[i] == ')' && --depth == 0) break;
+            }
+            if (depth != 0) return fail("unterminated variation");
+            ++i;
+            continue;
+        }
+
+        size_t start = i;
+        while (i < game.size() && !isBlank(game[i]) && !strchr("{}();", game[i])) ++i;
+        string_view token = game.substr(start, i - start);
+        if (token.empty()) return fail(string("unexpected '") + c + "'");
+        if (token[0] == '$') continue; // numeric annotation glyph
+
+        if (isResult(token))
+        {
+            verdict.result = string(token);
+            break;
+        }
+        // move numbers: "12." or "12..." and sometimes glued to the move ("12.e4")
+        size_t digits = 0;
+        while (digits < token.size() && isdigit((unsigned char)token[digits])) ++digits;
+        if (digits > 0 && digits < token.size() && token[digits] == '.')
+        {
+            token.remove_prefix(digits);
+            while (!token.empty() && token[0] == '.') token.remove_prefix(1);
+            if (token.empty()) continue;
+        }
+
+        if (markedMate) return fail("move after a move marked '#'");
+        Move m = moveFromSan(pos, token);
+        if (m == NO_MOVE)
+            return fail("ply " + to_string(verdict.plies + 1) + ": illegal or ambiguous move '" + string(token) + "'");
+        makeMove(pos, m);
+        if (record) record->moves.push_back(m);
+        verdict.plies++;
+        markedMate = token.back() == '#';
+        if (markedMate && !isCheckmate(pos, pos.whiteToMove))
+            return fail("ply " + to_string(verdict.plies) + ": '" + string(token) + "' is marked mate but is not checkmate");
+    }
+
+    if (verdict.result.empty()) verdict.result = tagResult.empty() ? "*" : tagResult;
+    if (!tagResult.empty() && tagResult != verdict.result)
+        return fail("Result tag " + tagResult + " disagrees with movetext " + verdict.result);
+    string outcome = checkOutcome(pos, verdict.result);
+    if (!outcome.empty()) return fail(outcome);
+    if (record) record->result = resultFromText(verdict.result);
+    return verdict;
+}
+
+GameVerdict checkEpdRecord(string_view line, Position& pos)
+{
+    GameVerdict verdict;
+    auto fail = [&verdict](const string& error) {
+        verdict.ok = false;
+        verdict.error = error;
+        return verdict;
+    };
+
+    // the first four fields are the FEN without clocks
+    size_t i = 0;
+    for (int field = 0; field < 4; ++field)
+    {
+        while (i < line.size() && isBlank(line[i])) ++i;
+        if (i >= line.size()) return fail("fewer than four FEN fields");
+        while (i < line.size() && !isBlank(line[i])) ++i;
+    }
+    if (!setFromFen(pos, string(line.substr(0, i)))) return fail("invalid position");
+    // the side that just moved cannot still be in check
+    if (isKingInCheck(pos, !pos.whiteToMove)) return fail("side not to move is in check");
+
+    // operations: "opcode operand ...;" - best/avoid moves must be legal SAN here
+    while (i < line.size())
+    {
+        size_t end = line.find(';', i);
+        if (end == string_view::npos) end = line.size();
+        string_view op = line.substr(i, end - i);
+        i = end + 1;
+
+        size_t p = 0;
+        auto nextToken = [&op, &p]() {
+            while (p < op.size() && isBlank(op[p])) ++p;
+            size_t start = p;
+            while (p < op.size() && !isBlank(op[p])) ++p;
+            return op.substr(start, p - start);
+        };
+        string_view opcode = nextToken();
+        if (opcode != "bm" && opcode != "am") continue;
+        for (string_view san = nextToken(); !san.empty(); san = nextToken())
+            if (moveFromSan(pos, san) == NO_MOVE)
+                return fail(string(opcode) + " move '" + string(san) + "' is not legal");
+    }
+    verdict.result = "*";
+    return verdict;
+}
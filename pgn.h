@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include "gamefile.h"
+#include "position.h"
+
+// PGN / EPD reading on top of the rules engine. Everything works on string_views into
+// the caller's buffer (normally a memory-mapped archive); nothing is copied per token.
+
+// SAN ("Nbd7", "exd6", "O-O", "e8=Q+") to the legal move it names, or NO_MOVE if it is
+// malformed, illegal or ambiguous
+Move moveFromSan(const Position& pos, std::string_view san);
+
+// the legal move m in SAN, with the minimal disambiguation and a "+" / "#" suffix
+std::string moveToSan(const Position& pos, Move m);
+
+// outcome of checking one game or EPD record
+struct GameVerdict
+{
+    bool ok = true;
+    int plies = 0;
+    std::string result;  // "1-0", "0-1", "1/2-1/2" or "*" as the game claims it
+    std::string error;   // why the game was rejected, empty when ok
+};
+
+// Offset of the first game that starts at or after from (size if there is none).
+// A game starts at a tag line ('[' in column 0) that does not follow another tag line,
+// so any byte offset can be snapped to a boundary without parsing what came before.
+size_t nextPgnGame(std::string_view text, size_t from);
+// offset just past the line containing from (for EPD, one record per line)
+size_t nextLine(std::string_view text, size_t from);
+
+// Replays one game (tag section + movetext, variations and comments skipped) from the
+// start position or its FEN tag. Checks every move is legal, that "#" really is mate,
+// and that a final checkmate or stalemate agrees with the result. pos is scratch space;
+// record, if given, receives the start FEN, moves and result (for archiving).
+GameVerdict replayPgnGame(std::string_view game, Position& pos, GameRecord* record = nullptr);
+// One EPD record: a legal position (4 FEN fields), and legal SAN for bm/am operations.
+GameVerdict checkEpdRecord(std::string_view line, Position& pos);
@@ -0,0 +1,348 @@
+#include "posindex.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <unistd.h>
+#include "gamefile.h"
+#include "rules.h"
+
+using namespace std;
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "the position index is stored in host byte order");
+
+static const char headerMagic[4] = { 'C', 'P', 'I', '3' };
+static const char trailerMagic[4] = { 'C', 'P', 'I', 'X' };
+const int SHARD_BITS = 8;
+const int SHARD_COUNT = 1 << SHARD_BITS;
+const size_t DIRECTORY_BYTES = (SHARD_COUNT + 1) * sizeof(uint64_t);
+const size_t TRAILER_BYTES = 32;
+// the header and every segment start on this boundary, so the mapped directories and
+// entries are naturally aligned
+const size_t SECTION_ALIGN = 16;
+// more segments than this make every lookup search too many places: merge them
+const int MAX_SEGMENTS = 16;
+
+static int shardOf(uint64_t key) { return int(key >> (64 - SHARD_BITS)); }
+
+static bool entryLess(const PositionIndexEntry& a, const PositionIndexEntry& b)
+{
+    if (a.key != b.key) return a.key < b.key;
+    if (a.game != b.game) return a.game < b.game;
+    return a.ply < b.ply;
+}
+
+struct SegmentInfo
+{
+    uint64_t offset;
+    uint64_t count;
+};
+
+struct Trailer
+{
+    uint64_t tableOffset;
+    uint32_t segmentCount;
+    uint32_t gamesIndexed;
+    uint64_t fingerprint;
+    char magic[4];
+    uint32_t pad;
+};
+static_assert(sizeof(Trailer) == TRAILER_BYTES, "trailer layout");
+
+// Identifies the first `games` games of an archive by their final keys, lengths and
+// results, so an index built from another archive, or from one rewritten since, is
+// rebuilt instead of extended.
+static uint64_t archiveFingerprint(const GameReader& archive, size_t games)
+{
+    const uint64_t prime = 0x100000001B3ULL;
+    uint64_t h = 0xCBF29CE484222325ULL ^ games;
+    for (size_t n = 0; n < games; ++n)
+    {
+        h = (h ^ archive.finalKey(n)) * prime;
+        h = (h ^ (uint64_t(archive.gamePlies(n)) << 8 | uint64_t(archive.gameResult(n)))) * prime;
+    }
+    return h;
+}
+
+// the segment table, games count and archive fingerprint of an existing index; false if
+// missing or malformed. Every segment must lie before the table and its directory must
+// split exactly its entries into shards (starting at 0, never decreasing, ending at count).
+static bool readLayout(const MappedFile& file, vector<SegmentInfo>& segments, size_t& gamesIndexed,
+                       uint64_t& fingerprint, uint64_t& tableOffset)
+{
+    if (file.size() < SECTION_ALIGN + TRAILER_BYTES || memcmp(file.data(), headerMagic, 4) != 0) return false;
+    Trailer t;
+    memcpy(&t, file.data() + file.size() - TRAILER_BYTES, TRAILER_BYTES);
+    if (memcmp(t.magic, trailerMagic, 4) != 0) return false;
+    if (t.tableOffset > file.size() - TRAILER_BYTES
+        || t.tableOffset + t.segmentCount * sizeof(SegmentInfo) != file.size() - TRAILER_BYTES)
+        return false;
+    segments.resize(t.segmentCount);
+    memcpy(segments.data(), file.data() + t.tableOffset, t.segmentCount * sizeof(SegmentInfo));
+    for (const SegmentInfo& s : segments)
+    {
+        if (s.offset % SECTION_ALIGN != 0 || s.offset > t.tableOffset || t.tableOffset - s.offset < DIRECTORY_BYTES
+            || s.count > (t.tableOffset - s.offset - DIRECTORY_BYTES) / sizeof(PositionIndexEntry))
+            return false;
+        const uint64_t* dir = (const uint64_t*)(file.data() + s.offset);
+        if (dir[0] != 0 || dir[SHARD_COUNT] != s.count) return false;
+        for (int sh = 0; sh < SHARD_COUNT; ++sh)
+            if (dir[sh] > dir[sh + 1]) return false;
+    }
+    gamesIndexed = t.gamesIndexed;
+    fingerprint = t.fingerprint;
+    tableOffset = t.tableOffset;
+    return true;
+}
+
+static bool writeTableAndTrailer(FILE* out, uint64_t tableOffset, const vector<SegmentInfo>& segments,
+                                 size_t gamesIndexed, uint64_t fingerprint)
+{
+    Trailer t = { tableOffset, uint32_t(segments.size()), uint32_t(gamesIndexed), fingerprint,
+                  { 'C', 'P', 'I', 'X' }, 0 };
+    bool ok = fwrite(segments.data(), sizeof(SegmentInfo), segments.size(), out) == segments.size();
+    ok = fwrite(&t, TRAILER_BYTES, 1, out) == 1 && ok;
+    ok = fflush(out) == 0 && ok;
+    ok = ftruncate(fileno(out), off_t(tableOffset + segments.size() * sizeof(SegmentInfo) + TRAILER_BYTES)) == 0 && ok;
+    return ok;
+}
+
+// zero bytes up to the next SECTION_ALIGN boundary
+static bool padSection(FILE* out)
+{
+    static const char zeros[SECTION_ALIGN] = {};
+    size_t pad = (SECTION_ALIGN - size_t(ftell(out)) % SECTION_ALIGN) % SECTION_ALIGN;
+    return fwrite(zeros, 1, pad, out) == pad;
+}
+
+static bool writeHeader(FILE* out) { return fwrite(headerMagic, 1, 4, out) == 4 && padSection(out); }
+
+// writes one segment (directory + entries already sorted by shard and key) at the next
+// aligned position
+static bool writeSegment(FILE* out, const vector<vector<PositionIndexEntry>>& shards, SegmentInfo& info)
+{
+    vector<uint64_t> directory(SHARD_COUNT + 1, 0);
+    for (int s = 0; s < SHARD_COUNT; ++s) directory[s + 1] = directory[s] + shards[s].size();
+    bool ok = padSection(out);
+    info.offset = uint64_t(ftell(out));
+    info.count = directory[SHARD_COUNT];
+    ok = ok && fwrite(directory.data(), sizeof(uint64_t), directory.size(), out) == directory.size();
+    for (const auto& shard : shards)
+        ok = fwrite(shard.data(), sizeof(PositionIndexEntry), shard.size(), out) == shard.size() && ok;
+    return ok;
+}
+
+// Replays games [first, last) on `threads` workers, each into its own per-shard buckets,
+// then sorts shard by shard in parallel after gathering every worker's bucket for it.
+// A game stops at its first illegal move and is counted in damagedGames.
+static vector<vector<PositionIndexEntry>> buildShards(const GameReader& archive, size_t first, size_t last,
+                                                      int threads, size_t& damagedGames)
+{
+    atomic<size_t> damaged{0};
+    vector<vector<vector<PositionIndexEntry>>> local(threads, vector<vector<PositionIndexEntry>>(SHARD_COUNT));
+    atomic<size_t> nextGame{first};
+    const size_t GAME_CHUNK = 256;
+
+    auto replay = [&](int worker) {
+        GameRecord game;
+        unique_ptr<Position> pos(new Position());
+        auto& buckets = local[worker];
+        for (size_t begin = nextGame.fetch_add(GAME_CHUNK); begin < last; begin = nextGame.fetch_add(GAME_CHUNK))
+        {
+            for (size_t n = begin; n < min(last, begin + GAME_CHUNK); ++n)
+            {
+                if (!archive.readGame(n, game) || !startPosition(game, *pos))
+                {
+                    damaged++;
+                    continue;
+                }
+                buckets[shardOf(pos->key)].push_back({ pos->key, uint32_t(n), 0, 0 });
+                for (size_t ply = 0; ply < game.moves.size(); ++ply)
+                {
+                    if (!replayMove(*pos, game.moves[ply]))
+                    {
+                        damaged++;
+                        break;
+                    }
+                    buckets[shardOf(pos->key)].push_back({ pos->key, uint32_t(n), uint16_t(ply + 1), 0 });
+                }
+            }
+        }
+    };
+
+    vector<vector<PositionIndexEntry>> shards(SHARD_COUNT);
+    atomic<int> nextShard{0};
+    auto gather = [&]() {
+        for (int s = nextShard++; s < SHARD_COUNT; s = nextShard++)
+        {
+            size_t total = 0;
+            for (auto& buckets : local) total += buckets[s].size();
+            shards[s].reserve(total);
+            for (auto& buckets : local)
+            {
+                shards[s].insert(shards[s].end(), buckets[s].begin(), buckets[s].end());
+                vector<PositionIndexEntry>().swap(buckets[s]);
+            }
+            sort(shards[s].begin(), shards[s].end(), entryLess);
+        }
+    };
+
+    vector<thread> pool;
+    for (int i = 0; i < threads; ++i) pool.emplace_back(replay, i);
+    for (thread& t : pool) t.join();
+    damagedGames = damaged;
+    pool.clear();
+    for (int i = 0; i < threads; ++i) pool.emplace_back(gather);
+    for (thread& t : pool) t.join();
+    return shards;
+}
+
+bool updatePositionIndex(const string& archivePath, const string& indexPath, int threads, IndexBuildStats* stats)
+{
+    GameReader archive;
+    if (!archive.open(archivePath)) return false;
+    if (threads < 1) threads = 1;
+
+    vector<SegmentInfo> segments;
+    size_t gamesIndexed = 0;
+    uint64_t fingerprint = 0, tableOffset = 0;
+    bool extend = false;
+    {
+        MappedFile existing;
+        if (existing.open(indexPath))
+            extend = readLayout(existing, segments, gamesIndexed, fingerprint, tableOffset) &&
+                     gamesIndexed <= archive.gameCount() && fingerprint == archiveFingerprint(archive, gamesIndexed);
+    }
+    if (!extend)
+    {
+        // missing, damaged, or built from other games than the archive now starts with: start over
+        segments.clear();
+        gamesIndexed = 0;
+    }
+
+    IndexBuildStats local;
+    IndexBuildStats& s = stats ? *stats : local;
+    s = IndexBuildStats();
+    if (extend && gamesIndexed == archive.gameCount())
+    {
+        s.segments = int(segments.size());
+        return true;
+    }
+
+    vector<vector<PositionIndexEntry>> shards =
+        buildShards(archive, gamesIndexed, archive.gameCount(), threads, s.damagedGames);
+
+    FILE* out = fopen(indexPath.c_str(), extend ? "r+b" : "wb");
+    if (!out) return false;
+    bool ok = true;
+    if (extend) ok = fseek(out, long(tableOffset), SEEK_SET) == 0;
+    else ok = writeHeader(out);
+
+    SegmentInfo info;
+    ok = ok && writeSegment(out, shards, info);
+    segments.push_back(info);
+    ok = ok && writeTableAndTrailer(out, uint64_t(ftell(out)), segments, archive.gameCount(),
+                                    archiveFingerprint(archive, archive.gameCount()));
+    ok = fclose(out) == 0 && ok;
+
+    s.gamesAdded = archive.gameCount() - gamesIndexed;
+    s.entriesAdded = info.count;
+    s.segments = int(segments.size());
+    if (ok && int(segments.size()) > MAX_SEGMENTS)
+    {
+        ok = compactPositionIndex(indexPath);
+        s.compacted = true;
+        s.segments = 1;
+    }
+    return ok;
+}
+
+bool compactPositionIndex(const string& indexPath)
+{
+    vector<SegmentInfo> segments;
+    size_t gamesIndexed = 0;
+    uint64_t fingerprint = 0, tableOffset = 0;
+    MappedFile in;
+    if (!in.open(indexPath) || !readLayout(in, segments, gamesIndexed, fingerprint, tableOffset)) return false;
+    if (segments.size() <= 1) return true;
+
+    // write the merged index beside the old one and swap it in only when complete
+    string tempPath = indexPath + ".tmp";
+    FILE* out = fopen(tempPath.c_str(), "wb");
+    if (!out) return false;
+    bool ok = writeHeader(out);
+
+    uint64_t total = 0;
+    for (const SegmentInfo& s : segments) total += s.count;
+    vector<uint64_t> directory(SHARD_COUNT + 1, 0);
+    SegmentInfo merged = { uint64_t(ftell(out)), total };
+    ok = ok && fwrite(directory.data(), sizeof(uint64_t), directory.size(), out) == directory.size();
+
+    vector<PositionIndexEntry> shard;
+    for (int sh = 0; sh < SHARD_COUNT; ++sh)
+    {
+        shard.clear();
+        for (const SegmentInfo& s : segments)
+        {
+            const uint64_t* dir = (const uint64_t*)(in.data() + s.offset);
+            const PositionIndexEntry* entries = (const PositionIndexEntry*)(in.data() + s.offset + DIRECTORY_BYTES);
+            shard.insert(shard.end(), entries + dir[sh], entries + dir[sh + 1]);
+        }
+        sort(shard.begin(), shard.end(), entryLess);
+        directory[sh + 1] = directory[sh] + shard.size();
+        ok = ok && fwrite(shard.data(), sizeof(PositionIndexEntry), shard.size(), out) == shard.size();
+    }
+
+    uint64_t newTable = uint64_t(ftell(out));
+    ok = ok && fseek(out, long(merged.offset), SEEK_SET) == 0
+         && fwrite(directory.data(), sizeof(uint64_t), directory.size(), out) == directory.size()
+         && fseek(out, long(newTable), SEEK_SET) == 0;
+    ok = ok && writeTableAndTrailer(out, newTable, vector<SegmentInfo>(1, merged), gamesIndexed, fingerprint);
+    ok = fclose(out) == 0 && ok;
+    in.close();
+    if (!ok || rename(tempPath.c_str(), indexPath.c_str()) != 0)
+    {
+        remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool PositionIndex::open(const string& path)
+{
+    segments.clear();
+    games = 0;
+    vector<SegmentInfo> layout;
+    uint64_t fingerprint = 0, tableOffset = 0;
+    if (!file.open(path) || !readLayout(file, layout, games, fingerprint, tableOffset)) return false;
+    for (const SegmentInfo& s : layout)
+    {
+        const char* base = file.data() + s.offset;
+        segments.push_back({ (const uint64_t*)base, (const PositionIndexEntry*)(base + DIRECTORY_BYTES), s.count });
+    }
+    return true;
+}
+
+size_t PositionIndex::entryCount() const
+{
+    size_t total = 0;
+    for (const Segment& s : segments) total += s.count;
+    return total;
+}
+
+vector<PositionPosting> PositionIndex::find(uint64_t key) const
+{
+    vector<PositionPosting> postings;
+    int shard = shardOf(key);
+    for (const Segment& s : segments)
+    {
+        const PositionIndexEntry* first = s.entries + s.directory[shard];
+        const PositionIndexEntry* last = s.entries + s.directory[shard + 1];
+        first = lower_bound(first, last, key, [](const PositionIndexEntry& e, uint64_t k) { return e.key < k; });
+        for (; first != last && first->key == key; ++first) postings.push_back({ first->game, first->ply });
+    }
+    // segments cover increasing game ranges, so postings are already in (game, ply) order
+    return postings;
+}
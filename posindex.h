@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "mappedfile.h"
+
+// On-disk position index for a game archive (".cpi"): Zobrist key -> (game, ply).
+//
+//   header    "CPI3", zero padding to 16 bytes
+//   segments  each on a 16-byte boundary: shard directory (257 x u64 entry index), then
+//             entries sorted by key
+//   table     per segment: offset u64, entry count u64
+//   trailer   table offset u64, segment count u32, games indexed u32, archive fingerprint u64,
+//             "CPIX", pad u32
+//
+// An entry is 16 bytes (key, game, ply), stored in host byte order (little-endian only).
+// Shards are the top 8 bits of the key, so a lookup is one directory read plus a binary
+// search inside a single shard of each segment. New games are indexed as an extra segment
+// appended to the file; once there are many segments they are merged back into one.
+
+struct PositionPosting
+{
+    uint32_t game;
+    uint16_t ply;
+};
+
+struct PositionIndexEntry
+{
+    uint64_t key;
+    uint32_t game;
+    uint16_t ply;
+    uint16_t reserved;
+};
+static_assert(sizeof(PositionIndexEntry) == 16, "index entries are written as raw 16-byte records");
+
+struct IndexBuildStats
+{
+    size_t gamesAdded = 0;
+    size_t entriesAdded = 0;
+    size_t damagedGames = 0; // indexed only up to their first illegal move
+    int segments = 0;
+    bool compacted = false;
+};
+
+// Indexes the games of the archive that the index does not cover yet. The trailer holds a
+// fingerprint of the indexed games (final key, length and result of each); when the
+// index does not exist or its games are not the archive's first games any more, it is
+// rebuilt from scratch. Replay runs in parallel
+// over game ranges, sorting in parallel over shards.
+bool updatePositionIndex(const std::string& archivePath, const std::string& indexPath, int threads,
+                         IndexBuildStats* stats = nullptr);
+// merges all segments into one, shard by shard (memory stays at one shard)
+bool compactPositionIndex(const std::string& indexPath);
+
+class PositionIndex
+{
+public:
+    bool open(const std::string& path);
+    std::vector<PositionPosting> find(uint64_t key) const;
+    size_t entryCount() const;
+    size_t gamesIndexed() const { return games; }
+    int segmentCount() const { return int(segments.size()); }
+
+private:
+    struct Segment
+    {
+        const uint64_t* directory;
+        const PositionIndexEntry* entries;
+        uint64_t count;
+    };
+    MappedFile file;
+    std::vector<Segment> segments;
+    size_t games = 0;
+};
@@ -0,0 +1,407 @@
+#include "position.h"
+#include <cctype>
+#include <sstream>
+
+using namespace std;
+
+// the eight slider directions as full rays from every square
+static Bitboard rayTable[8][64];
+Bitboard betweenTable[64][64];
+Bitboard lineTable[64][64];
+
+// N, S, E, W, NE, NW, SE, SW as (rank step, file step); first four are rook rays
+static const int rayStep[8][2] = { {1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, 1}, {1, -1}, {-1, 1}, {-1, -1} };
+
+// one ray from sq, stopping on (and including) the first blocker
+static Bitboard walkRay(int dir, int sq, Bitboard occupied)
+{
+    Bitboard attacks = 0;
+    for (int r = sq / 8 + rayStep[dir][0], f = sq % 8 + rayStep[dir][1];
+         r >= 0 && r < 8 && f >= 0 && f < 8;
+         r += rayStep[dir][0], f += rayStep[dir][1])
+    {
+        attacks |= squareBB(r * 8 + f);
+        if (occupied & squareBB(r * 8 + f)) break;
+    }
+    return attacks;
+}
+
+Bitboard slidingAttacks(bool rook, int sq, Bitboard occupied)
+{
+    Bitboard attacks = 0;
+    for (int dir = rook ? 0 : 4; dir < (rook ? 4 : 8); ++dir) attacks |= walkRay(dir, sq, occupied);
+    return attacks;
+}
+
+static void initLineTables()
+{
+    for (int sq = 0; sq < 64; ++sq)
+        for (int dir = 0; dir < 8; ++dir) rayTable[dir][sq] = walkRay(dir, sq, 0);
+
+    // for every aligned pair: the squares strictly between them, and the full line through both
+    const int opposite[8] = { 1, 0, 3, 2, 7, 6, 5, 4 };
+    for (int a = 0; a < 64; ++a)
+    {
+        for (int dir = 0; dir < 8; ++dir)
+        {
+            Bitboard ray = rayTable[dir][a];
+            while (ray)
+            {
+                int b = popLsb(ray);
+                betweenTable[a][b] = rayTable[dir][a] & ~rayTable[dir][b] & ~squareBB(b);
+                lineTable[a][b] = rayTable[dir][a] | rayTable[opposite[dir]][a] | squareBB(a);
+            }
+        }
+    }
+}
+
+uint64_t pieceKeys[12][64];
+uint64_t castlingKeys[16];
+uint64_t epKeys[8];
+uint64_t sideKey;
+
+// xorshift64*: fixed seed so keys (and anything stored by key) are stable across runs
+static void initZobristKeys()
+{
+    uint64_t seed = 1070372;
+    auto next = [&seed]() {
+        seed ^= seed >> 12; seed ^= seed << 25; seed ^= seed >> 27;
+        return seed * 2685821657736338717ULL;
+    };
+    for (int p = 0; p < 12; ++p)
+        for (int sq = 0; sq < 64; ++sq) pieceKeys[p][sq] = next();
+    // castling keys combine per right so any rights set is the XOR of its bits
+    uint64_t rightKeys[4] = { next(), next(), next(), next() };
+    for (int r = 0; r < 16; ++r)
+    {
+        castlingKeys[r] = 0;
+        for (int i = 0; i < 4; ++i) if (r & (1 << i)) castlingKeys[r] ^= rightKeys[i];
+    }
+    for (int f = 0; f < 8; ++f) epKeys[f] = next();
+    sideKey = next();
+}
+
+SliderMagic rookMagics[64];
+SliderMagic bishopMagics[64];
+bool pextLookups = false;
+// every square's slice of all blocker subsets: 102400 rook and 5248 bishop entries
+static Bitboard rookTable[0x19000];
+static Bitboard bishopTable[0x1480];
+
+static bool cpuHasBmi2()
+{
+#if defined(__x86_64__) && defined(__GNUC__)
+    return __builtin_cpu_supports("bmi2");
+#else
+    return false;
+#endif
+}
+
+bool cpuHasFastPext()
+{
+#if defined(__x86_64__) && defined(__GNUC__)
+    // Zen 1/2 implement PEXT in microcode, far slower than a magic multiply
+    return cpuHasBmi2() && !__builtin_cpu_is("znver1") && !__builtin_cpu_is("znver2");
+#else
+    return false;
+#endif
+}
+
+// Fills one piece kind's tables. Magics are searched once with a fixed-seed generator
+// (sparse random candidates, Stockfish style) and reused on later rebuilds.
+static void initSliders(bool rook, SliderMagic* magics, Bitboard* table, bool usePext)
+{
+    static Bitboard occupancy[4096], reference[4096];
+    static int epoch[4096], attempt = 0;
+    uint64_t seed = rook ? 728 : 10316;
+    auto next = [&seed]() {
+        seed ^= seed >> 12; seed ^= seed << 25; seed ^= seed >> 27;
+        return seed * 2685821657736338717ULL;
+    };
+
+    Bitboard* slice = table;
+    for (int sq = 0; sq < 64; ++sq)
+    {
+        // the last square of each ray never blocks anything further, so it is not relevant
+        Bitboard edges = ((0x00000000000000FFULL | 0xFF00000000000000ULL) & ~(0xFFULL << (sq / 8 * 8)))
+                       | ((0x0101010101010101ULL | 0x8080808080808080ULL) & ~(0x0101010101010101ULL << (sq % 8)));
+        SliderMagic& m = magics[sq];
+        m.mask = slidingAttacks(rook, sq, 0) & ~edges;
+        m.shift = 64 - __builtin_popcountll(m.mask);
+        m.attacks = slice;
+
+        // enumerate every subset of the mask (carry-rippler) with its true attack set
+        int size = 0;
+        Bitboard b = 0;
+        do
+        {
+            occupancy[size] = b;
+            reference[size] = slidingAttacks(rook, sq, b);
+            if (usePext) m.attacks[pext(b, m.mask)] = reference[size];
+            ++size;
+            b = (b - m.mask) & m.mask;
+        } while (b);
+        slice += size;
+        if (usePext) continue;
+
+        for (;;)
+        {
+            if (!m.magic)
+            {
+                do m.magic = next() & next() & next();
+                while (__builtin_popcountll((m.magic * m.mask) >> 56) < 6);
+            }
+
+            // a candidate only works if no two subsets with different attacks collide
+            int i = 0;
+            for (++attempt; i < size; ++i)
+            {
+                unsigned index = unsigned(((occupancy[i] & m.mask) * m.magic) >> m.shift);
+                if (epoch[index] < attempt)
+                {
+                    epoch[index] = attempt;
+                    m.attacks[index] = reference[i];
+                }
+                else if (m.attacks[index] != reference[i])
+                    break;
+            }
+            if (i == size) break;
+            m.magic = 0;
+        }
+    }
+}
+
+bool initSliderTables(SliderLookup lookup)
+{
+    bool usePext = lookup == LOOKUP_PEXT;
+    if (usePext && !cpuHasBmi2()) return false;
+    initSliders(true, rookMagics, rookTable, usePext);
+    initSliders(false, bishopMagics, bishopTable, usePext);
+    pextLookups = usePext;
+    return true;
+}
+
+// tables are built during static initialization so no caller has to remember an init call
+static const bool attackTablesReady = (initLineTables(),
+                                       initSliderTables(cpuHasFastPext() ? LOOKUP_PEXT : LOOKUP_MAGIC),
+                                       initZobristKeys(), true);
+
+// squares a piece standing on sq attacks (pawns: diagonal captures only)
+Bitboard attacksFrom(char piece, int sq, Bitboard occupied)
+{
+    switch (tolower(piece)) {
+    case 'p': return pawnAttackTable[isupper(piece) ? WHITE : BLACK][sq];
+    case 'n': return knightAttackTable[sq];
+    case 'b': return bishopAttacks(sq, occupied);
+    case 'r': return rookAttacks(sq, occupied);
+    case 'q': return bishopAttacks(sq, occupied) | rookAttacks(sq, occupied);
+    case 'k': return kingAttackTable[sq];
+    default: return 0;
+    }
+}
+
+Bitboard attackersTo(const Position& pos, int sq, Bitboard occupied)
+{
+    const Bitboard (*p)[PIECE_TYPE_NB] = pos.pieces;
+    return (pawnAttackTable[BLACK][sq] & p[WHITE][PAWN])
+         | (pawnAttackTable[WHITE][sq] & p[BLACK][PAWN])
+         | (knightAttackTable[sq] & (p[WHITE][KNIGHT] | p[BLACK][KNIGHT]))
+         | (kingAttackTable[sq] & (p[WHITE][KING] | p[BLACK][KING]))
+         | (bishopAttacks(sq, occupied) & (p[WHITE][BISHOP] | p[BLACK][BISHOP] | p[WHITE][QUEEN] | p[BLACK][QUEEN]))
+         | (rookAttacks(sq, occupied) & (p[WHITE][ROOK] | p[BLACK][ROOK] | p[WHITE][QUEEN] | p[BLACK][QUEEN]));
+}
+
+int pieceTypeOf(char piece)
+{
+    switch (tolower(piece)) {
+    case 'p': return PAWN;
+    case 'n': return KNIGHT;
+    case 'b': return BISHOP;
+    case 'r': return ROOK;
+    case 'q': return QUEEN;
+    case 'k': return KING;
+    default: return PIECE_TYPE_NB;
+    }
+}
+
+void putPiece(Position& p, int sq, char piece)
+{
+    Bitboard b = squareBB(sq);
+    int color = isupper(piece) ? WHITE : BLACK;
+    p.pieces[color][pieceTypeOf(piece)] |= b;
+    p.byColor[color] |= b;
+    p.occupied |= b;
+    p.mailbox[sq] = piece;
+    p.key ^= pieceKeys[color * 6 + pieceTypeOf(piece)][sq];
+}
+
+void removePiece(Position& p, int sq)
+{
+    char piece = p.mailbox[sq];
+    if (piece == ' ') return;
+    Bitboard b = squareBB(sq);
+    int color = isupper(piece) ? WHITE : BLACK;
+    p.pieces[color][pieceTypeOf(piece)] &= ~b;
+    p.byColor[color] &= ~b;
+    p.occupied &= ~b;
+    p.mailbox[sq] = ' ';
+    p.key ^= pieceKeys[color * 6 + pieceTypeOf(piece)][sq];
+}
+
+bool epCapturable(const Position& pos, int sq)
+{
+    int us = pos.whiteToMove ? WHITE : BLACK;
+    return (pawnAttackTable[us ^ 1][sq] & pos.pieces[us][PAWN]) != 0;
+}
+
+uint64_t computeKey(const Position& pos)
+{
+    uint64_t key = 0;
+    for (int sq = 0; sq < 64; ++sq)
+    {
+        char p = pos.mailbox[sq];
+        if (p != ' ') key ^= pieceKeys[(isupper(p) ? 0 : 6) + pieceTypeOf(p)][sq];
+    }
+    key ^= castlingKeys[pos.castlingRights];
+    if (pos.epSquare >= 0) key ^= epKeys[pos.epSquare % 8];
+    if (!pos.whiteToMove) key ^= sideKey;
+    return key;
+}
+
+char pieceAt(const Position& pos, int r, int c)
+{
+    return pos.mailbox[squareOf(r, c)];
+}
+
+void initializeBoard(Position& pos)
+{
+    pos = Position();
+    pos.whiteToMove = true;
+    pos.castlingRights = ALL_CASTLING;
+    pos.epSquare = -1;
+    pos.fullmoveNumber = 1;
+    for (int sq = 0; sq < 64; sq++)
+    {
+        pos.mailbox[sq] = ' ';
+    }
+    // for white pieces (uppercase)
+    const char backRank[] = "RNBQKBNR";
+    for (int i = 0; i < SIZE; i++)
+    {
+        putPiece(pos, squareOf(6, i), 'P');
+        putPiece(pos, squareOf(7, i), backRank[i]);
+    }
+    // for black pieces (lowercase)
+    for (int i = 0; i < SIZE; i++)
+    {
+        putPiece(pos, squareOf(1, i), 'p');
+        putPiece(pos, squareOf(0, i), (char)tolower(backRank[i]));
+    }
+    pos.key = computeKey(pos);
+}
+
+bool setFromFen(Position& pos, const string& fen)
+{
+    istringstream in(fen);
+    string placement, side, castling, ep;
+    int halfmove = 0, fullmove = 1;
+    if (!(in >> placement >> side)) return false;
+    if (!(in >> castling)) castling = "-";
+    if (!(in >> ep)) ep = "-";
+    // move counters are optional (EPD lines omit them)
+    if (!(in >> halfmove >> fullmove)) { halfmove = 0; fullmove = 1; }
+
+    Position p = Position();
+    for (int sq = 0; sq < 64; sq++) p.mailbox[sq] = ' ';
+
+    int r = 0, c = 0;
+    for (char ch : placement)
+    {
+        if (ch == '/') { r++; c = 0; continue; }
+        if (ch >= '1' && ch <= '8') { c += ch - '0'; continue; }
+        if (pieceTypeOf(ch) == PIECE_TYPE_NB || !isInsideBoard(r, c)) return false;
+        putPiece(p, squareOf(r, c), ch);
+        c++;
+    }
+    if (r != 7 || c != 8) return false;
+    if (__builtin_popcountll(p.pieces[WHITE][KING]) != 1 || __builtin_popcountll(p.pieces[BLACK][KING]) != 1)
+        return false;
+
+    if (side != "w" && side != "b") return false;
+    p.whiteToMove = (side == "w");
+
+    for (char ch : castling)
+    {
+        switch (ch) {
+        case 'K': p.castlingRights |= WHITE_OO; break;
+        case 'Q': p.castlingRights |= WHITE_OOO; break;
+        case 'k': p.castlingRights |= BLACK_OO; break;
+        case 'q': p.castlingRights |= BLACK_OOO; break;
+        case '-': break;
+        default: return false;
+        }
+    }
+    // drop rights whose king or rook is not on its home square
+    if (p.mailbox[4] != 'K') p.castlingRights &= ~(WHITE_OO | WHITE_OOO);
+    if (p.mailbox[7] != 'R') p.castlingRights &= ~WHITE_OO;
+    if (p.mailbox[0] != 'R') p.castlingRights &= ~WHITE_OOO;
+    if (p.mailbox[60] != 'k') p.castlingRights &= ~(BLACK_OO | BLACK_OOO);
+    if (p.mailbox[63] != 'r') p.castlingRights &= ~BLACK_OO;
+    if (p.mailbox[56] != 'r') p.castlingRights &= ~BLACK_OOO;
+
+    p.epSquare = -1;
+    if (ep != "-")
+    {
+        if (ep.size() != 2 || ep[0] < 'a' || ep[0] > 'h' || (ep[1] != '3' && ep[1] != '6')) return false;
+        p.epSquare = (ep[1] - '1') * 8 + (ep[0] - 'a');
+        // only kept when a pawn can actually take, so equal positions hash equally
+        if (!epCapturable(p, p.epSquare)) p.epSquare = -1;
+    }
+
+    p.halfmoveClock = halfmove;
+    p.fullmoveNumber = fullmove;
+    p.key = computeKey(p);
+    pos = p;
+    return true;
+}
+
+string toFen(const Position& pos)
+{
+    string fen;
+    for (int r = 0; r < SIZE; r++)
+    {
+        int empty = 0;
+        for (int c = 0; c < SIZE; c++)
+        {
+            char p = pieceAt(pos, r, c);
+            if (p == ' ') { empty++; continue; }
+            if (empty) { fen += char('0' + empty); empty = 0; }
+            fen += p;
+        }
+        if (empty) fen += char('0' + empty);
+        if (r < SIZE - 1) fen += '/';
+    }
+
+    fen += pos.whiteToMove ? " w " : " b ";
+    if (pos.castlingRights & WHITE_OO) fen += 'K';
+    if (pos.castlingRights & WHITE_OOO) fen += 'Q';
+    if (pos.castlingRights & BLACK_OO) fen += 'k';
+    if (pos.castlingRights & BLACK_OOO) fen += 'q';
+    if (!pos.castlingRights) fen += '-';
+    fen += ' ';
+    fen += pos.epSquare < 0 ? string("-") : squareName(pos.epSquare);
+    fen += ' ' + to_string(pos.halfmoveClock) + ' ' + to_string(pos.fullmoveNumber);
+    return fen;
+}
+
+string squareName(int sq)
+{
+    return string(1, char('a' + sq % 8)) + char('1' + sq / 8);
+}
+
+string moveToUci(Move m)
+{
+    string s = squareName(moveFrom(m)) + squareName(moveTo(m));
+    if (moveKind(m) == PROMOTION) s += "nbrq"[promotionType(m) - KNIGHT];
+    return s;
+}
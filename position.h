@@ -0,0 +1,203 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string>
+
+// bitboard: one bit per square, bit 0 = a1, bit 7 = h1, bit 63 = h8
+typedef uint64_t Bitboard;
+
+const int SIZE = 8;
+
+enum Side { WHITE, BLACK };
+enum PieceType { PAWN, KNIGHT, BISHOP, ROOK, QUEEN, KING, PIECE_TYPE_NB };
+enum CastlingRight { WHITE_OO = 1, WHITE_OOO = 2, BLACK_OO = 4, BLACK_OOO = 8, ALL_CASTLING = 15 };
+
+const char START_FEN[] = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+// move packed into 16 bits: from (0-5), to (6-11), promotion piece (12-13), kind (14-15).
+// castling is encoded as the king's two-square step.
+typedef uint16_t Move;
+enum MoveKind { NORMAL, PROMOTION, EN_PASSANT, CASTLING };
+const Move NO_MOVE = 0;
+
+// everything makeMove overwrites, saved so unmakeMove can restore it exactly
+struct UndoInfo
+{
+    uint64_t key;
+    Move move;
+    char captured;
+    uint8_t castlingRights;
+    int8_t epSquare;
+    uint16_t halfmoveClock;
+};
+
+// capacity of the undo stack; once full the oldest half is dropped (see makeMove)
+const int MAX_GAME_PLY = 1024;
+
+// width of the evaluation network's first layer, per perspective (see nnue.h)
+const int NNUE_HIDDEN = 256;
+class NnueNetwork;
+
+// position: one set per (color, piece type) plus occupancy unions.
+// mailbox mirrors the sets so "what is on this square" stays O(1) for the GUI.
+// Everything the rules need lives here, so independent positions can be used
+// from different threads without sharing any state.
+struct Position
+{
+    Bitboard pieces[2][PIECE_TYPE_NB];
+    Bitboard byColor[2];
+    Bitboard occupied;
+    char mailbox[64];
+    bool whiteToMove;
+    int castlingRights; // CastlingRight bits still available
+    int epSquare;       // square a pawn of the side to move can capture onto en passant, -1 if none
+    int halfmoveClock;  // plies since the last capture or pawn move
+    int fullmoveNumber;
+    uint64_t key;       // Zobrist hash, maintained incrementally
+
+    // first layer of the evaluation network from White's and Black's side, kept up to
+    // date by makeMove/unmakeMove while a network is attached (attachNetwork)
+    const NnueNetwork* network = nullptr;
+    alignas(32) int16_t accumulator[2][NNUE_HIDDEN];
+
+    int historySize;    // undo stack, one entry per move played
+    UndoInfo history[MAX_GAME_PLY];
+};
+
+inline Move makeMoveCode(int from, int to, int kind = NORMAL, int promotion = KNIGHT)
+{
+    return Move(from | (to << 6) | ((promotion - KNIGHT) << 12) | (kind << 14));
+}
+inline int moveFrom(Move m) { return m & 63; }
+inline int moveTo(Move m) { return (m >> 6) & 63; }
+inline int moveKind(Move m) { return m >> 14; }
+inline int promotionType(Move m) { return ((m >> 12) & 3) + KNIGHT; }
+
+// board row 0 is rank 8 (black side), row 7 is rank 1
+inline int squareOf(int r, int c) { return (7 - r) * 8 + c; }
+inline int rowOf(int sq) { return 7 - sq / 8; }
+inline int colOf(int sq) { return sq % 8; }
+inline Bitboard squareBB(int sq) { return Bitboard(1) << sq; }
+inline int lsb(Bitboard b) { return __builtin_ctzll(b); }
+inline int msb(Bitboard b) { return 63 - __builtin_clzll(b); }
+inline int popLsb(Bitboard& b) { int sq = lsb(b); b &= b - 1; return sq; }
+
+inline bool isInsideBoard(int r, int c) { return r >= 0 && r < SIZE && c >= 0 && c < SIZE; }
+
+// squares reached by (rank, file) steps from sq that stay on the board
+constexpr Bitboard leaperAttacks(int sq, const int (&steps)[8][2])
+{
+    Bitboard attacks = 0;
+    for (int i = 0; i < 8; ++i)
+    {
+        int r = sq / 8 + steps[i][0], f = sq % 8 + steps[i][1];
+        if (r >= 0 && r < 8 && f >= 0 && f < 8) attacks |= Bitboard(1) << (r * 8 + f);
+    }
+    return attacks;
+}
+
+constexpr int knightSteps[8][2] = { {2, 1}, {1, 2}, {-1, 2}, {-2, 1}, {-2, -1}, {-1, -2}, {1, -2}, {2, -1} };
+constexpr int kingSteps[8][2] = { {1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, 1}, {1, -1}, {-1, 1}, {-1, -1} };
+// white pawns capture towards rank 8, black towards rank 1 (unused slots repeat an entry)
+constexpr int pawnSteps[2][8][2] = { { {1, -1}, {1, 1}, {1, 1}, {1, 1}, {1, 1}, {1, 1}, {1, 1}, {1, 1} },
+                                     { {-1, -1}, {-1, 1}, {-1, 1}, {-1, 1}, {-1, 1}, {-1, 1}, {-1, 1}, {-1, 1} } };
+
+constexpr std::array<Bitboard, 64> makeLeaperTable(const int (&steps)[8][2])
+{
+    std::array<Bitboard, 64> table{};
+    for (int sq = 0; sq < 64; ++sq) table[sq] = leaperAttacks(sq, steps);
+    return table;
+}
+
+// leaper tables, generated at compile time
+constexpr std::array<Bitboard, 64> knightAttackTable = makeLeaperTable(knightSteps);
+constexpr std::array<Bitboard, 64> kingAttackTable = makeLeaperTable(kingSteps);
+constexpr std::array<Bitboard, 64> pawnAttackTable[2] = { makeLeaperTable(pawnSteps[WHITE]),
+                                                         makeLeaperTable(pawnSteps[BLACK]) };
+static_assert(knightAttackTable[0] == 0x20400ULL && kingAttackTable[63] == 0x40C0000000000000ULL
+              && pawnAttackTable[WHITE][8] == 0x20000ULL && pawnAttackTable[BLACK][0] == 0,
+              "leaper tables");
+
+// squares strictly between two aligned squares / whole line through them (0 if not aligned)
+extern Bitboard betweenTable[64][64];
+extern Bitboard lineTable[64][64];
+
+// Slider attacks come from lookup tables indexed by the relevant blockers: with BMI2
+// the index is PEXT(occupied, mask), otherwise ((occupied & mask) * magic) >> shift.
+// Which one is used is decided once at startup from the CPU (see initSliderTables).
+struct SliderMagic
+{
+    Bitboard mask;     // relevant occupancy: the rays without their last square
+    Bitboard magic;
+    Bitboard* attacks; // this square's slice of the shared table
+    unsigned shift;
+};
+extern SliderMagic rookMagics[64];
+extern SliderMagic bishopMagics[64];
+extern bool pextLookups;
+
+enum SliderLookup { LOOKUP_MAGIC, LOOKUP_PEXT };
+// rebuilds the slider tables for the given index scheme (the benchmark switches between them);
+// not thread-safe. Returns false if PEXT was asked for on a CPU without BMI2.
+bool initSliderTables(SliderLookup lookup);
+bool cpuHasFastPext();
+
+#if defined(__x86_64__) && defined(__GNUC__)
+// inline asm instead of the intrinsic so the rest of the build does not need -mbmi2
+inline Bitboard pext(Bitboard src, Bitboard mask)
+{
+    Bitboard result;
+    asm("pextq %2, %1, %0" : "=r"(result) : "r"(src), "r"(mask));
+    return result;
+}
+#else
+inline Bitboard pext(Bitboard, Bitboard) { return 0; } // never selected
+#endif
+
+inline unsigned sliderIndex(const SliderMagic& m, Bitboard occupied)
+{
+    if (pextLookups) return unsigned(pext(occupied, m.mask));
+    return unsigned(((occupied & m.mask) * m.magic) >> m.shift);
+}
+
+//attack masks
+inline Bitboard rookAttacks(int sq, Bitboard occupied)
+{
+    return rookMagics[sq].attacks[sliderIndex(rookMagics[sq], occupied)];
+}
+inline Bitboard bishopAttacks(int sq, Bitboard occupied)
+{
+    return bishopMagics[sq].attacks[sliderIndex(bishopMagics[sq], occupied)];
+}
+// step along each ray to the edge or the first blocker: the reference the tables are built
+// from and benchmarked against
+Bitboard slidingAttacks(bool rook, int sq, Bitboard occupied);
+Bitboard attacksFrom(char piece, int sq, Bitboard occupied);
+// pieces of both colors attacking sq, with sliders blocked by the given occupancy
+Bitboard attackersTo(const Position& pos, int sq, Bitboard occupied);
+
+// Zobrist keys: one per (piece, square), castling-rights set, en passant file and side
+extern uint64_t pieceKeys[12][64];
+extern uint64_t castlingKeys[16];
+extern uint64_t epKeys[8];
+extern uint64_t sideKey;
+uint64_t computeKey(const Position& pos); // from scratch, for verification
+
+int pieceTypeOf(char piece);
+// putPiece/removePiece keep pos.key in step with the piece sets
+void putPiece(Position& pos, int sq, char piece);
+void removePiece(Position& pos, int sq);
+char pieceAt(const Position& pos, int r, int c);
+
+void initializeBoard(Position& pos);
+
+// true if the side to move has a pawn that could capture onto sq (en passant bookkeeping)
+bool epCapturable(const Position& pos, int sq);
+
+// FEN import/export; setFromFen leaves pos untouched and returns false on malformed input
+bool setFromFen(Position& pos, const std::string& fen);
+std::string toFen(const Position& pos);
+
+// coordinate notation, e.g. "e2e4" or "e7e8q"
+std::string squareName(int sq);
+std::string moveToUci(Move m);
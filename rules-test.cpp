@@ -0,0 +1,277 @@
+// Rules-engine regression tests, run by ctest.
+//
+//   rules-test perft       leaf counts of the standard perft positions against their published values
+//   rules-test validmove   isValidMove agrees with the move generator on every square pair, through
+//                          the first two plies of the perft positions
+//   rules-test enpassant   only the side to move may capture en passant
+//   rules-test polyglot [keys]
+//                          the built-in Polyglot keys give the published test keys, a key file
+//                          that does not is refused, and the given one (polyglot-random.txt) is
+//                          accepted
+//   rules-test tablebase   damaged KRvK tables (a bad header, a truncated file, random contents)
+//                          make probes fail instead of crashing
+//
+// Each test prints one line per failure and exits 1 if there was any.
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "book.h"
+#include "movegen.h"
+#include "rules.h"
+#include "syzygy.h"
+
+using namespace std;
+
+struct PerftCase
+{
+    const char* fen;
+    uint64_t nodes[6]; // depth 1, 2, ...; 0 ends the list
+};
+
+static const PerftCase perftCases[] = {
+    { "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", { 20, 400, 8902, 197281, 4865609 } },
+    { "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", { 48, 2039, 97862, 4085603 } },
+    { "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", { 14, 191, 2812, 43238, 674624 } },
+    { "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", { 6, 264, 9467, 422333 } },
+    { "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", { 44, 1486, 62379, 2103487 } },
+    { "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10", { 46, 2079, 89890, 3894594 } },
+};
+
+static unique_ptr<Position> fromFen(const char* fen)
+{
+    unique_ptr<Position> pos(new Position());
+    if (!setFromFen(*pos, fen))
+    {
+        printf("invalid FEN: %s\n", fen);
+        return nullptr;
+    }
+    return pos;
+}
+
+static int testPerft()
+{
+    int failures = 0;
+    for (const PerftCase& c : perftCases)
+    {
+        unique_ptr<Position> pos = fromFen(c.fen);
+        if (!pos) return 1;
+        for (int depth = 1; depth <= 6 && c.nodes[depth - 1]; ++depth)
+        {
+            uint64_t nodes = perft(*pos, depth);
+            if (nodes == c.nodes[depth - 1]) continue;
+            printf("perft %d of %s: %llu, expected %llu\n", depth, c.fen, (unsigned long long)nodes,
+                   (unsigned long long)c.nodes[depth - 1]);
+            failures++;
+        }
+    }
+    return failures;
+}
+
+// isValidMove (row/column arguments) against legalDestinations for the side to move's pieces
+static int compareDestinations(const Position& pos, const char* fen)
+{
+    int failures = 0;
+    Bitboard own = pos.byColor[pos.whiteToMove ? WHITE : BLACK];
+    for (int from = 0; from < 64; ++from)
+    {
+        if (!(own & squareBB(from))) continue;
+        Bitboard expected = legalDestinations(pos, from), got = 0;
+        for (int to = 0; to < 64; ++to)
+            if (isValidMove(pos, 7 - from / 8, from % 8, 7 - to / 8, to % 8)) got |= squareBB(to);
+        if (got == expected) continue;
+        printf("isValidMove from square %d, %s to move, under %s: %016llx, generator %016llx\n", from,
+               pos.whiteToMove ? "white" : "black", fen, (unsigned long long)got, (unsigned long long)expected);
+        failures++;
+    }
+    return failures;
+}
+
+static int testValidMove()
+{
+    int failures = 0;
+    for (const PerftCase& c : perftCases)
+    {
+        unique_ptr<Position> pos = fromFen(c.fen);
+        if (!pos) return 1;
+        failures += compareDestinations(*pos, c.fen);
+        MoveList first;
+        generateLegalMoves(*pos, first);
+        for (int i = 0; i < first.count; ++i)
+        {
+            makeMove(*pos, first.moves[i]);
+            failures += compareDestinations(*pos, c.fen);
+            MoveList second;
+            generateLegalMoves(*pos, second);
+            for (int j = 0; j < second.count; ++j)
+            {
+                makeMove(*pos, second.moves[j]);
+                failures += compareDestinations(*pos, c.fen);
+                unmakeMove(*pos);
+            }
+            unmakeMove(*pos);
+        }
+    }
+    return failures;
+}
+
+static int testEnPassant()
+{
+    int failures = 0;
+    // after 1. e2e4 the e3 square is open to black's d4 pawn only
+    unique_ptr<Position> pos = fromFen("4k3/8/8/8/3pP3/8/5P2/4K3 b - e3 0 1");
+    if (!pos) return 1;
+    if (!isValidMove(*pos, 4, 3, 5, 4))
+    {
+        printf("black d4xe3 en passant rejected\n");
+        failures++;
+    }
+    // white's f2 pawn attacks e3 too, but the capture is not white's to make
+    if (isValidMove(*pos, 6, 5, 5, 4))
+    {
+        printf("white f2xe3 accepted on black's en-passant square\n");
+        failures++;
+    }
+    return failures;
+}
+
+static int testPolyglot(const char* keysPath)
+{
+    int failures = 0;
+    PolyglotKeys keys;
+    unique_ptr<Position> pos = fromFen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+    unique_ptr<Position> e4 = fromFen("rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1");
+    if (!pos || !e4) return 1;
+    if (keys.key(*pos) != 0x463b96181691fc9cULL || keys.key(*e4) != 0x823c9b50fd114196ULL || !keys.verify())
+    {
+        printf("built-in table: start %016llx, 1.e4 %016llx, expected 463b96181691fc9c, 823c9b50fd114196\n",
+               (unsigned long long)keys.key(*pos), (unsigned long long)keys.key(*e4));
+        failures++;
+    }
+
+    // 781 well-formed values that are not Polyglot's
+    const char* bogusPath = "polyglot-test-keys.txt";
+    {
+        ofstream out(bogusPath);
+        char value[24];
+        uint64_t x = 0x9E3779B97F4A7C15ULL;
+        for (int i = 0; i < 781; ++i)
+        {
+            x ^= x << 13, x ^= x >> 7, x ^= x << 17;
+            snprintf(value, sizeof(value), "%016llX\n", (unsigned long long)x);
+            out << value;
+        }
+    }
+    if (keys.load(bogusPath))
+    {
+        printf("a table that is not Polyglot's was accepted\n");
+        failures++;
+    }
+    else if (keys.key(*pos) != 0x463b96181691fc9cULL)
+    {
+        printf("a refused table replaced the built-in one\n");
+        failures++;
+    }
+    remove(bogusPath);
+    if (keysPath && !keys.load(keysPath))
+    {
+        printf("%s: not 781 values giving the Polyglot test keys\n", keysPath);
+        failures++;
+    }
+    return failures;
+}
+
+// KRvK headers up to the first subtable's sizes: split WDL flags, group order, piece order
+static const uint8_t krvkHeader[] = { 0x71, 0xE8, 0x23, 0x5D, 0x01, 0x00, 0x66, 0x44, 0xEE, 0x00 };
+
+// probes KRvK with either side to move and either colouring; mustFail for tables no
+// probe can be answered from
+static int probeDamaged(const char* dir, const vector<uint8_t>& contents, const char* what, bool mustFail)
+{
+    static const char* fens[] = { "8/8/8/4k3/8/8/8/R3K3 w - - 0 1", "8/8/8/4k3/8/8/8/R3K3 b - - 0 1",
+                                  "r3k3/8/8/8/4K3/8/8/8 w - - 0 1", "r3k3/8/8/8/4K3/8/8/8 b - - 0 1" };
+    for (const char* name : { "/KRvK.rtbw", "/KRvK.rtbz" })
+    {
+        ofstream out(string(dir) + name, ios::binary);
+        out.write((const char*)contents.data(), contents.size());
+    }
+    Tablebases tablebases;
+    tablebases.init(dir);
+    int failures = 0;
+    for (const char* fen : fens)
+    {
+        unique_ptr<Position> pos = fromFen(fen);
+        if (!pos) return 1;
+        int wdl, dtz;
+        bool answered = tablebases.probeWdl(*pos, wdl);
+        answered |= tablebases.probeDtz(*pos, dtz);
+        if (answered && mustFail)
+        {
+            printf("%s: probe of %s answered\n", what, fen);
+            failures++;
+        }
+    }
+    return failures;
+}
+
+static int testTablebase()
+{
+    const char* dir = "syzygy-test";
+    mkdir(dir, 0755);
+    int failures = 0;
+
+    // the right magic and size, nothing else
+    vector<uint8_t> contents(80, 0);
+    copy(begin(krvkHeader), begin(krvkHeader) + 4, contents.begin());
+    failures += probeDamaged(dir, contents, "bad header", true);
+
+    // a header promising 1000 blocks of 1 KB in an 80-byte file
+    contents.assign(80, 0);
+    copy(begin(krvkHeader), end(krvkHeader), contents.begin());
+    const uint8_t sizes[] = { 0x00, 10, 10, 0, 0xE8, 0x03, 0x00, 0x00, 1, 1 };
+    copy(begin(sizes), end(sizes), contents.begin() + sizeof(krvkHeader));
+    failures += probeDamaged(dir, contents, "truncated", true);
+
+    // random bytes behind the magic or a valid header; only a crash fails here
+    uint64_t x = 0x2545F4914F6CDD1DULL;
+    for (int round = 0; round < 400; ++round)
+    {
+        x ^= x << 13, x ^= x >> 7, x ^= x << 17;
+        contents.assign(64 * (1 + x % 16) + 16, 0);
+        for (uint8_t& byte : contents)
+        {
+            x ^= x << 13, x ^= x >> 7, x ^= x << 17;
+            byte = uint8_t(x);
+        }
+        copy(begin(krvkHeader), round % 2 ? end(krvkHeader) : begin(krvkHeader) + 4, contents.begin());
+        failures += probeDamaged(dir, contents, "random", false);
+    }
+
+    remove("syzygy-test/KRvK.rtbw");
+    remove("syzygy-test/KRvK.rtbz");
+    rmdir(dir);
+    return failures;
+}
+
+int main(int argc, char** argv)
+{
+    string test = argc > 1 ? argv[1] : "";
+    int failures;
+    if (test == "perft") failures = testPerft();
+    else if (test == "validmove") failures = testValidMove();
+    else if (test == "enpassant") failures = testEnPassant();
+    else if (test == "polyglot") failures = testPolyglot(argc > 2 ? argv[2] : nullptr);
+    else if (test == "tablebase") failures = testTablebase();
+    else
+    {
+        printf("usage: rules-test perft|validmove|enpassant|polyglot [keys]|tablebase\n");
+        return 1;
+    }
+    if (failures) printf("%s: %d failure%s\n", test.c_str(), failures, failures == 1 ? "" : "s");
+    return failures ? 1 : 0;
+}
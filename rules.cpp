@@ -0,0 +1,399 @@
+#include "rules.h"
+#include "instrument.h"
+#include "movegen.h"
+#include "nnue.h"
+#include <cctype>
+#include <cstring>
+
+using namespace std;
+
+bool isValidMove(const Position& pos, int sx, int sy, int dx, int dy)
+{
+    INSTRUMENT(HOT_IS_VALID_MOVE);
+    if (!isInsideBoard(sx, sy) || !isInsideBoard(dx, dy)) return false;
+    if (sx == dx && sy == dy) return false; // no movement
+
+    char piece = pieceAt(pos, sx, sy);
+    if (piece == ' ') return false; // no piece selected
+
+    // destination cannot be occupied by same-color piece
+    if (pos.byColor[isupper(piece) ? WHITE : BLACK] & squareBB(squareOf(dx, dy))) return false;
+
+    char lower = tolower(piece);
+    bool valid = false;
+    switch (lower) {
+    case 'p': valid = isValidPawnMove(pos, sx, sy, dx, dy, piece); break;
+    case 'r': valid = isValidRookMove(pos, sx, sy, dx, dy, piece); break;
+    case 'n': valid = isValidKnightMove(pos, sx, sy, dx, dy, piece); break;
+    case 'b': valid = isValidBishopMove(pos, sx, sy, dx, dy, piece); break;
+    case 'q': valid = isValidQueenMove(pos, sx, sy, dx, dy, piece); break;
+    case 'k': valid = isValidKingMove(pos, sx, sy, dx, dy, piece); break;
+    default: return false;
+    }
+
+    if (!valid) return false;
+
+    //prevent moves that leave your own king in check
+    if (wouldBeInCheckAfterMove(pos, sx, sy, dx, dy)) return false;
+
+    return true;
+}
+
+bool isValidPawnMove(const Position& pos, int sx, int sy, int dx, int dy, char piece)
+{
+    int from = squareOf(sx, sy);
+    Bitboard to = squareBB(squareOf(dx, dy));
+    Bitboard empty = ~pos.occupied;
+    bool white = isupper(piece);
+
+    // single push, then double push from the start rank through an empty square
+    Bitboard single = (white ? squareBB(from) << 8 : squareBB(from) >> 8) & empty;
+    Bitboard startRank = white ? 0x000000000000FF00ULL : 0x00FF000000000000ULL;
+    Bitboard dbl = (squareBB(from) & startRank) ? (white ? single << 8 : single >> 8) & empty : 0;
+    if (to & (single | dbl)) return true;
+
+    //one step diagonally captures only if target occupied by opponent,
+    //or onto the square a double-pushed enemy pawn just skipped (en passant),
+    //which only the side to move may take
+    Bitboard targets = pos.byColor[white ? BLACK : WHITE];
+    if (pos.epSquare >= 0 && white == pos.whiteToMove) targets |= squareBB(pos.epSquare);
+    return (pawnAttackTable[white ? WHITE : BLACK][from] & targets & to) != 0;
+}
+
+bool isValidRookMove(const Position& pos, int sx, int sy, int dx, int dy, char)
+{
+    // destination handled in outer check (cannot capture same color)
+    return (rookAttacks(squareOf(sx, sy), pos.occupied) & squareBB(squareOf(dx, dy))) != 0;
+}
+
+bool isValidKnightMove(const Position&, int sx, int sy, int dx, int dy, char)
+{
+    // destination color check done earlier
+    return (knightAttackTable[squareOf(sx, sy)] & squareBB(squareOf(dx, dy))) != 0;
+}
+
+bool isValidBishopMove(const Position& pos, int sx, int sy, int dx, int dy, char)
+{
+    return (bishopAttacks(squareOf(sx, sy), pos.occupied) & squareBB(squareOf(dx, dy))) != 0;
+}
+
+bool isValidQueenMove(const Position& pos, int sx, int sy, int dx, int dy, char piece)
+{
+    // queen = rook OR bishop
+    return isValidRookMove(pos, sx, sy, dx, dy, piece) || isValidBishopMove(pos, sx, sy, dx, dy, piece);
+}
+
+bool isValidKingMove(const Position& pos, int sx, int sy, int dx, int dy, char piece)
+{
+    // cannot capture same color (already checked)
+    if (kingAttackTable[squareOf(sx, sy)] & squareBB(squareOf(dx, dy))) return true;
+
+    // castling: two files sideways along the home rank
+    if (sx != dx || abs(dy - sy) != 2) return false;
+    return canCastle(pos, isupper(piece), dy > sy);
+}
+
+// king and rook unmoved, squares between them empty, and the king neither
+// starts in, passes through, nor lands on an attacked square
+bool canCastle(const Position& pos, bool white, bool kingSide)
+{
+    int right = white ? (kingSide ? WHITE_OO : WHITE_OOO) : (kingSide ? BLACK_OO : BLACK_OOO);
+    if (!(pos.castlingRights & right)) return false;
+
+    int king = white ? 4 : 60;
+    Bitboard between = kingSide ? (squareBB(king + 1) | squareBB(king + 2))
+                                : (squareBB(king - 1) | squareBB(king - 2) | squareBB(king - 3));
+    if (pos.occupied & between) return false;
+
+    int step = kingSide ? 1 : -1;
+    for (int i = 0; i <= 2; ++i)
+    {
+        int sq = king + i * step;
+        if (isSquareAttacked(pos, rowOf(sq), colOf(sq), !white)) return false;
+    }
+    return true;
+}
+
+// castling rights surviving a move that touches each square
+static const int castlingMask[64] = {
+    ~WHITE_OOO, ~0, ~0, ~0, ~(WHITE_OO | WHITE_OOO), ~0, ~0, ~WHITE_OO,
+    ~0, ~0, ~0, ~0, ~0, ~0, ~0, ~0,
+    ~0, ~0, ~0, ~0, ~0, ~0, ~0, ~0,
+    ~0, ~0, ~0, ~0, ~0, ~0, ~0, ~0,
+    ~0, ~0, ~0, ~0, ~0, ~0, ~0, ~0,
+    ~0, ~0, ~0, ~0, ~0, ~0, ~0, ~0,
+    ~0, ~0, ~0, ~0, ~0, ~0, ~0, ~0,
+    ~BLACK_OOO, ~0, ~0, ~0, ~(BLACK_OO | BLACK_OOO), ~0, ~0, ~BLACK_OO,
+};
+
+Move moveFromSquares(const Position& pos, int from, int to, char promotion)
+{
+    char piece = pos.mailbox[from];
+    int type = pieceTypeOf(piece);
+    if (type == KING && abs(to - from) == 2) return makeMoveCode(from, to, CASTLING);
+    if (type == PAWN)
+    {
+        if (to == pos.epSquare && colOf(to) != colOf(from)) return makeMoveCode(from, to, EN_PASSANT);
+        if (to / 8 == 0 || to / 8 == 7) return makeMoveCode(from, to, PROMOTION, pieceTypeOf(promotion));
+    }
+    return makeMoveCode(from, to);
+}
+
+// colour * 6 + type, as the network indexes pieces
+static int nnuePiece(char piece) { return (isupper(piece) ? WHITE : BLACK) * 6 + pieceTypeOf(piece); }
+
+void makeMove(Position& pos, Move m)
+{
+    int from = moveFrom(m), to = moveTo(m), kind = moveKind(m);
+    char piece = pos.mailbox[from];
+    bool white = isupper(piece);
+    int capturedSquare = kind == EN_PASSANT ? (white ? to - 8 : to + 8) : to;
+    char moved = piece;
+
+    // the undo stack never needs to reach back further than the last irreversible
+    // move for repetition checks, so a full stack simply forgets its oldest half
+    if (pos.historySize == MAX_GAME_PLY)
+    {
+        memmove(pos.history, pos.history + MAX_GAME_PLY / 2, sizeof(UndoInfo) * (MAX_GAME_PLY / 2));
+        pos.historySize -= MAX_GAME_PLY / 2;
+    }
+    UndoInfo& undo = pos.history[pos.historySize++];
+    undo.key = pos.key;
+    undo.move = m;
+    undo.captured = pos.mailbox[capturedSquare];
+    undo.castlingRights = (uint8_t)pos.castlingRights;
+    undo.epSquare = (int8_t)pos.epSquare;
+    undo.halfmoveClock = (uint16_t)pos.halfmoveClock;
+
+    // the captured pawn sits behind the target square for en passant
+    removePiece(pos, capturedSquare);
+    if (kind == CASTLING)
+    {
+        // rook jumps over the king: h-file rook to f-file, a-file rook to d-file
+        int rookFrom = to > from ? to + 1 : to - 2;
+        int rookTo = to > from ? to - 1 : to + 1;
+        char rook = pos.mailbox[rookFrom];
+        removePiece(pos, rookFrom);
+        putPiece(pos, rookTo, rook);
+    }
+
+    // Basic move: move piece, capture handled by clearing the destination first
+    removePiece(pos, from);
+    if (kind == PROMOTION)
+        piece = white ? "NBRQ"[promotionType(m) - KNIGHT] : "nbrq"[promotionType(m) - KNIGHT];
+    putPiece(pos, to, piece);
+
+    bool pawn = pieceTypeOf(piece) == PAWN || kind == PROMOTION;
+    pos.halfmoveClock = (pawn || undo.captured != ' ') ? 0 : pos.halfmoveClock + 1;
+    if (!white) pos.fullmoveNumber++;
+
+    // castling rights, en passant file and side are hashed as deltas too
+    pos.key ^= castlingKeys[pos.castlingRights];
+    pos.castlingRights &= castlingMask[from] & castlingMask[to];
+    pos.key ^= castlingKeys[pos.castlingRights];
+    if (pos.epSquare >= 0) pos.key ^= epKeys[pos.epSquare % 8];
+
+    // then hand the turn to the other side
+    pos.whiteToMove = !pos.whiteToMove;
+    pos.key ^= sideKey;
+
+    pos.epSquare = -1;
+    if (pawn && abs(to - from) == 16 && epCapturable(pos, (from + to) / 2))
+    {
+        pos.epSquare = (from + to) / 2;
+        pos.key ^= epKeys[pos.epSquare % 8];
+    }
+
+    // the network's first layer follows the pieces that moved
+    if (pos.network)
+    {
+        NnueDelta delta;
+        if (undo.captured != ' ') delta.remove(nnuePiece(undo.captured), capturedSquare);
+        delta.remove(nnuePiece(moved), from);
+        delta.add(nnuePiece(piece), to);
+        if (kind == CASTLING)
+        {
+            int rook = nnuePiece(white ? 'R' : 'r');
+            delta.remove(rook, to > from ? to + 1 : to - 2);
+            delta.add(rook, to > from ? to - 1 : to + 1);
+        }
+        updateAccumulators(pos, delta);
+    }
+}
+
+void unmakeMove(Position& pos)
+{
+    const UndoInfo& undo = pos.history[--pos.historySize];
+    Move m = undo.move;
+    int from = moveFrom(m), to = moveTo(m), kind = moveKind(m);
+
+    pos.whiteToMove = !pos.whiteToMove;
+    bool white = pos.whiteToMove;
+
+    char arrived = pos.mailbox[to];
+    char piece = kind == PROMOTION ? (white ? 'P' : 'p') : arrived;
+    removePiece(pos, to);
+    putPiece(pos, from, piece);
+
+    if (undo.captured != ' ')
+        putPiece(pos, kind == EN_PASSANT ? (white ? to - 8 : to + 8) : to, undo.captured);
+    if (kind == CASTLING)
+    {
+        int rookFrom = to > from ? to + 1 : to - 2;
+        int rookTo = to > from ? to - 1 : to + 1;
+        char rook = pos.mailbox[rookTo];
+        removePiece(pos, rookTo);
+        putPiece(pos, rookFrom, rook);
+    }
+
+    if (!white) pos.fullmoveNumber--;
+    pos.castlingRights = undo.castlingRights;
+    pos.epSquare = undo.epSquare;
+    pos.halfmoveClock = undo.halfmoveClock;
+    pos.key = undo.key;
+
+    if (pos.network)
+    {
+        NnueDelta delta;
+        delta.remove(nnuePiece(arrived), to);
+        delta.add(nnuePiece(piece), from);
+        if (undo.captured != ' ')
+            delta.add(nnuePiece(undo.captured), kind == EN_PASSANT ? (white ? to - 8 : to + 8) : to);
+        if (kind == CASTLING)
+        {
+            int rook = nnuePiece(white ? 'R' : 'r');
+            delta.remove(rook, to > from ? to - 1 : to + 1);
+            delta.add(rook, to > from ? to + 1 : to - 2);
+        }
+        updateAccumulators(pos, delta);
+    }
+}
+
+int repetitionCount(const Position& pos)
+{
+    // only positions since the last capture or pawn move can repeat, and only
+    // those with the same side to move (every second ply)
+    int count = 0;
+    int limit = pos.halfmoveClock < pos.historySize ? pos.halfmoveClock : pos.historySize;
+    for (int back = 4; back <= limit; back += 2)
+        if (pos.history[pos.historySize - back].key == pos.key) count++;
+    return count;
+}
+
+void makeMove(Position& pos, int sx, int sy, int dx, int dy, char promotion)
+{
+    makeMove(pos, moveFromSquares(pos, squareOf(sx, sy), squareOf(dx, dy), promotion));
+}
+
+
+// low-level: determines whether piece at (sx,sy) could move to (dx,dy)
+// using piece-specific movement rules (bypasses king-in-check prevention).
+bool canPieceAttackSquare(const Position& pos, int sx, int sy, int dx, int dy)
+{
+    if (!isInsideBoard(sx, sy) || !isInsideBoard(dx, dy)) return false;
+    if (sx == dx && sy == dy) return false;
+    char piece = pieceAt(pos, sx, sy);
+    if (piece == ' ') return false;
+
+    // pawns attack diagonally regardless of target occupancy
+    return (attacksFrom(piece, squareOf(sx, sy), pos.occupied) & squareBB(squareOf(dx, dy))) != 0;
+}
+
+// Is square (r,c) attacked by any piece of color byWhite?
+bool isSquareAttacked(const Position& pos, int r, int c, bool byWhite)
+{
+    INSTRUMENT(HOT_IS_SQUARE_ATTACKED);
+    int sq = squareOf(r, c);
+    const Bitboard* them = pos.pieces[byWhite ? WHITE : BLACK];
+
+    // reverse lookup: put each piece type on the target square and intersect with the enemy set
+    if (pawnAttackTable[byWhite ? BLACK : WHITE][sq] & them[PAWN]) return true;
+    if (knightAttackTable[sq] & them[KNIGHT]) return true;
+    if (kingAttackTable[sq] & them[KING]) return true;
+    if (bishopAttacks(sq, pos.occupied) & (them[BISHOP] | them[QUEEN])) return true;
+    if (rookAttacks(sq, pos.occupied) & (them[ROOK] | them[QUEEN])) return true;
+    return false;
+}
+
+// Is the given color's king currently in check?
+bool isKingInCheck(const Position& pos, bool whiteKing)
+{
+    Bitboard king = pos.pieces[whiteKing ? WHITE : BLACK][KING];
+    // king not found (shouldn't happen in normal play) treat as not in check
+    if (!king) return false;
+    int sq = lsb(king);
+    return isSquareAttacked(pos, rowOf(sq), colOf(sq), !whiteKing);
+}
+
+bool isInsufficientMaterial(const Position& pos)
+{
+    for (int color = WHITE; color <= BLACK; ++color)
+        if (pos.pieces[color][PAWN] | pos.pieces[color][ROOK] | pos.pieces[color][QUEEN]) return false;
+    Bitboard minors = pos.pieces[WHITE][KNIGHT] | pos.pieces[WHITE][BISHOP]
+                    | pos.pieces[BLACK][KNIGHT] | pos.pieces[BLACK][BISHOP];
+    return __builtin_popcountll(minors) <= 1;
+}
+
+// Test whether the mover's king would be in check after the move, from the occupancy
+// the move leaves behind; the position itself is never modified or copied
+bool wouldBeInCheckAfterMove(const Position& pos, int sx, int sy, int dx, int dy)
+{
+    INSTRUMENT(HOT_WOULD_BE_IN_CHECK);
+    int from = squareOf(sx, sy), to = squareOf(dx, dy);
+    char piece = pos.mailbox[from];
+    // which color's king are we checking? same color as the moving piece
+    int us = isupper(piece) ? WHITE : BLACK;
+    if (!pos.pieces[us][KING]) return false;
+
+    Bitboard occupied = (pos.occupied ^ squareBB(from)) | squareBB(to);
+    Bitboard captured = squareBB(to);
+    if (pieceTypeOf(piece) == PAWN && to == pos.epSquare && sy != dy)
+    {
+        int behind = us == WHITE ? to - 8 : to + 8;
+        occupied ^= squareBB(behind);
+        captured |= squareBB(behind);
+    }
+
+    int king = pieceTypeOf(piece) == KING ? to : lsb(pos.pieces[us][KING]);
+    return (attackersTo(pos, king, occupied) & pos.byColor[us ^ 1] & ~captured) != 0;
+}
+
+// Returns true if 'whiteKing' color has any legal move (despite the name, not only
+// check evasions). One pass of the pin/check-mask generator; no board is mutated.
+bool canAnyMoveSaveKing(const Position& pos, bool whiteKing)
+{
+    MoveList list;
+    if (whiteKing == pos.whiteToMove)
+    {
+        generateLegalMoves(pos, list);
+        return list.count > 0;
+    }
+
+    // asking about the side not on move: pretend it is their turn (no en passant available)
+    Position flipped = pos;
+    flipped.whiteToMove = whiteKing;
+    flipped.epSquare = -1;
+    generateLegalMoves(flipped, list);
+    return list.count > 0;
+}
+
+bool isCheckmate(const Position& pos, bool whiteKing)
+{
+    INSTRUMENT(HOT_IS_CHECKMATE);
+    if (!isKingInCheck(pos, whiteKing)) return false;
+    if (canAnyMoveSaveKing(pos, whiteKing)) return false;
+    return true;
+}
+// Stalemate: side to move is NOT in check, but has no legal moves.
+bool isStalemate(const Position& pos, bool whiteKing)
+{
+    INSTRUMENT(HOT_IS_STALEMATE);
+    // If side is in check, it's not stalemate
+    if (isKingInCheck(pos, whiteKing)) return false;
+
+    // If there's any legal move for that side, it's not stalemate
+    if (canAnyMoveSaveKing(pos, whiteKing)) return false;
+
+    // Not in check and no legal moves => stalemate
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,40 @@
+#pragma once
+#include "position.h"
+
+// Move rules. Every query takes the position it works on; nothing here touches
+// global state, so separate positions can be checked concurrently.
+
+bool isValidMove(const Position& pos, int sx, int sy, int dx, int dy);
+bool isValidPawnMove(const Position& pos, int sx, int sy, int dx, int dy, char piece);
+bool isValidBishopMove(const Position& pos, int sx, int sy, int dx, int dy, char piece);
+bool isValidRookMove(const Position& pos, int sx, int sy, int dx, int dy, char piece);
+bool isValidKnightMove(const Position& pos, int sx, int sy, int dx, int dy, char piece);
+bool isValidQueenMove(const Position& pos, int sx, int sy, int dx, int dy, char piece);
+bool isValidKingMove(const Position& pos, int sx, int sy, int dx, int dy, char piece);
+bool canCastle(const Position& pos, bool white, bool kingSide);
+
+// builds the move code for a from/to pair, detecting castling, en passant and promotion
+Move moveFromSquares(const Position& pos, int from, int to, char promotion = 'q');
+
+// plays the move (castling rook, en passant capture and promotion included),
+// updates rights/clocks and the Zobrist key, pushes an undo record and passes
+// the turn to the other side
+void makeMove(Position& pos, Move m);
+void makeMove(Position& pos, int sx, int sy, int dx, int dy, char promotion = 'q');
+// takes back the last move played with makeMove
+void unmakeMove(Position& pos);
+// how many earlier positions in the history are identical to the current one
+int repetitionCount(const Position& pos);
+// neither side can ever mate: bare kings, or a single minor piece left
+bool isInsufficientMaterial(const Position& pos);
+
+//check and checkmate
+bool canPieceAttackSquare(const Position& pos, int sx, int sy, int dx, int dy); // low-level attack test
+bool isSquareAttacked(const Position& pos, int r, int c, bool byWhite);
+bool isKingInCheck(const Position& pos, bool whiteKing);
+bool wouldBeInCheckAfterMove(const Position& pos, int sx, int sy, int dx, int dy);
+bool canAnyMoveSaveKing(const Position& pos, bool whiteKing);
+bool isCheckmate(const Position& pos, bool whiteKing);
+
+//stalemate
+bool isStalemate(const Position& pos, bool whiteKing);
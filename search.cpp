@@ -0,0 +1,475 @@
+#include "search.h"
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include "evaluate.h"
+#include "movegen.h"
+#include "rules.h"
+#include "syzygy.h"
+#include "tt.h"
+
+using namespace std;
+
+// move ordering bands: captures/promotions above killers above plain history scores
+const int CAPTURE_BONUS = 1 << 24;
+const int KILLER_BONUS = 1 << 23;
+const int HISTORY_MAX = 1 << 22;
+
+struct SearchThread;
+
+// state the threads of one search share; everything else is per thread
+struct SearchShared
+{
+    atomic<bool> stopAll{false};
+    vector<SearchThread*> threads;
+};
+
+// everything one search thread owns: its own copy of the position plus killer and
+// history tables, so helpers never write to each other's memory (only to the TT)
+struct SearchThread
+{
+    int index = 0; // 0 = main thread, which owns the clock and the reports
+    SearchShared* shared = nullptr;
+    Position pos;
+    SearchLimits limits;
+    chrono::steady_clock::time_point start;
+    atomic<bool>* stop = nullptr;
+    TranspositionTable* tt = nullptr;
+    bool aborted = false;
+    uint64_t nodes = 0;
+    atomic<uint64_t> publishedNodes{0}; // nodes, refreshed every few thousand for the main thread to sum
+    uint64_t ttProbes = 0, ttHits = 0, ttStores = 0;
+    const Tablebases* tablebases = nullptr;
+    uint64_t tbProbes = 0, tbHits = 0;
+    MoveList rootMoves;                 // the moves searched at the root (tablebase-filtered)
+    bool rootInTablebase = false;
+    int rootTbScore = 0;                // the root's tablebase result as a score
+    SearchResult completed;             // last fully searched iteration
+
+    Move killers[MAX_PLY][2];
+    int history[2][64][64];
+
+    // triangular PV table: pv[ply] holds the line found from that ply on
+    Move pv[MAX_PLY][MAX_PLY];
+    int pvLength[MAX_PLY];
+    Move rootBest = NO_MOVE;
+};
+
+static int64_t elapsedMs(const SearchThread& t)
+{
+    return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - t.start).count();
+}
+
+static uint64_t totalNodes(const SearchShared& shared)
+{
+    uint64_t total = 0;
+    for (const SearchThread* th : shared.threads) total += th->publishedNodes.load(memory_order_relaxed);
+    return total;
+}
+
+// polled every few thousand nodes so the clock is not read on every node.
+// Only the main thread checks the budget; it then stops everyone through stopAll.
+static bool shouldStop(SearchThread& t)
+{
+    if (t.aborted) return true;
+    if ((t.nodes & 2047) != 0) return false;
+    t.publishedNodes.store(t.nodes, memory_order_relaxed);
+
+    if (t.shared->stopAll.load(memory_order_relaxed) || (t.stop && t.stop->load(memory_order_relaxed)))
+        t.aborted = true;
+    else if (t.index == 0
+             && ((t.limits.nodes && totalNodes(*t.shared) >= t.limits.nodes)
+                 || (t.limits.movetimeMs && elapsedMs(t) >= t.limits.movetimeMs)))
+    {
+        t.aborted = true;
+        t.shared->stopAll = true;
+    }
+    return t.aborted;
+}
+
+static bool isCapture(const Position& pos, Move m)
+{
+    return pos.mailbox[moveTo(m)] != ' ' || moveKind(m) == EN_PASSANT;
+}
+
+static void scoreMoves(const SearchThread& t, const MoveList& list, int* scores, int ply, Move first)
+{
+    int us = t.pos.whiteToMove ? WHITE : BLACK;
+    for (int i = 0; i < list.count; ++i)
+    {
+        Move m = list.moves[i];
+        if (m == first) scores[i] = INT32_MAX;
+        else if (isCapture(t.pos, m) || moveKind(m) == PROMOTION)
+        {
+            // MVV-LVA: most valuable victim first, cheapest attacker breaking ties
+            int victim = moveKind(m) == EN_PASSANT ? PAWN : pieceTypeOf(t.pos.mailbox[moveTo(m)]);
+            int gain = victim == PIECE_TYPE_NB ? 0 : pieceValue[victim];
+            if (moveKind(m) == PROMOTION) gain += pieceValue[promotionType(m)];
+            scores[i] = CAPTURE_BONUS + gain * 8 - pieceTypeOf(t.pos.mailbox[moveFrom(m)]);
+        }
+        else if (m == t.killers[ply][0]) scores[i] = KILLER_BONUS + 1;
+        else if (m == t.killers[ply][1]) scores[i] = KILLER_BONUS;
+        else scores[i] = t.history[us][moveFrom(m)][moveTo(m)];
+    }
+}
+
+// selection sort step: bring the best remaining move to index i
+static Move pickMove(MoveList& list, int* scores, int i)
+{
+    int best = i;
+    for (int j = i + 1; j < list.count; ++j)
+        if (scores[j] > scores[best]) best = j;
+    swap(list.moves[i], list.moves[best]);
+    swap(scores[i], scores[best]);
+    return list.moves[i];
+}
+
+static void updateQuietStats(SearchThread& t, Move m, int ply, int depth)
+{
+    if (t.killers[ply][0] != m)
+    {
+        t.killers[ply][1] = t.killers[ply][0];
+        t.killers[ply][0] = m;
+    }
+    int us = t.pos.whiteToMove ? WHITE : BLACK;
+    int& h = t.history[us][moveFrom(m)][moveTo(m)];
+    h += depth * depth;
+    if (h > HISTORY_MAX)
+    {
+        // age the whole table so it keeps favoring recent cutoffs
+        for (auto& side : t.history)
+            for (auto& row : side)
+                for (int& v : row) v /= 2;
+    }
+}
+
+// mate scores are stored relative to the node, not the root, so they stay valid
+// when the same position is reached at a different ply
+static int scoreToTT(int score, int ply)
+{
+    return score >= MATE_BOUND ? score + ply : score <= -MATE_BOUND ? score - ply : score;
+}
+
+static int scoreFromTT(int score, int ply)
+{
+    return score >= MATE_BOUND ? score - ply : score <= -MATE_BOUND ? score + ply : score;
+}
+
+static bool isDraw(const Position& pos)
+{
+    return pos.halfmoveClock >= 100 || repetitionCount(pos) > 0 || isInsufficientMaterial(pos);
+}
+
+static int quiesce(SearchThread& t, int ply, int alpha, int beta)
+{
+    t.nodes++;
+    if (shouldStop(t)) return 0;
+    if (ply >= MAX_PLY - 1) return evaluate(t.pos);
+
+    bool inCheck = isKingInCheck(t.pos, t.pos.whiteToMove);
+    MoveList list;
+    generateLegalMoves(t.pos, list);
+    if (list.count == 0) return inCheck ? -MATE_SCORE + ply : 0;
+
+    // stand pat: the side to move may decline every capture (not when in check)
+    if (!inCheck)
+    {
+        int standPat = evaluate(t.pos);
+        if (standPat >= beta) return standPat;
+        if (standPat > alpha) alpha = standPat;
+
+        int kept = 0;
+        for (int i = 0; i < list.count; ++i)
+            if (isCapture(t.pos, list.moves[i]) || moveKind(list.moves[i]) == PROMOTION)
+                list.moves[kept++] = list.moves[i];
+        list.count = kept;
+    }
+
+    int scores[256];
+    scoreMoves(t, list, scores, ply, NO_MOVE);
+    int best = inCheck ? -INFINITE_SCORE : alpha;
+    for (int i = 0; i < list.count; ++i)
+    {
+        Move m = pickMove(list, scores, i);
+        makeMove(t.pos, m);
+        int score = -quiesce(t, ply + 1, -beta, -alpha);
+        unmakeMove(t.pos);
+        if (t.aborted) return 0;
+
+        if (score > best) best = score;
+        if (score > alpha) alpha = score;
+        if (alpha >= beta) break;
+    }
+    return best;
+}
+
+static int negamax(SearchThread& t, int depth, int ply, int alpha, int beta)
+{
+    t.pvLength[ply] = ply;
+    if (ply > 0 && isDraw(t.pos)) return 0;
+
+    bool inCheck = isKingInCheck(t.pos, t.pos.whiteToMove);
+    if (inCheck) depth++; // check extension
+    if (depth <= 0) return quiesce(t, ply, alpha, beta);
+
+    t.nodes++;
+    if (shouldStop(t)) return 0;
+    if (ply >= MAX_PLY - 1) return evaluate(t.pos);
+
+    // mate distance pruning: no line from here can beat an already found shorter mate
+    if (ply > 0)
+    {
+        alpha = max(alpha, -MATE_SCORE + ply);
+        beta = min(beta, MATE_SCORE - ply - 1);
+        if (alpha >= beta) return alpha;
+    }
+
+    // a stored result at least this deep can end non-PV nodes outright;
+    // otherwise its move is still the best first guess
+    Move ttMove = NO_MOVE;
+    bool pvNode = beta - alpha > 1;
+    if (t.tt)
+    {
+        TTData entry;
+        t.ttProbes++;
+        if (t.tt->probe(t.pos.key, entry))
+        {
+            t.ttHits++;
+            ttMove = entry.move;
+            int ttScore = scoreFromTT(entry.score, ply);
+            if (!pvNode && ply > 0 && entry.depth >= depth
+                && (entry.bound == BOUND_EXACT
+                    || (entry.bound == BOUND_LOWER && ttScore >= beta)
+                    || (entry.bound == BOUND_UPPER && ttScore <= alpha)))
+                return ttScore;
+        }
+    }
+
+    // just after a capture or pawn move is where a position can enter the tables; a
+    // decisive result bounds the score, a draw is exact
+    if (t.tablebases && ply > 0 && t.pos.halfmoveClock == 0 && t.tablebases->covers(t.pos))
+    {
+        int wdl;
+        t.tbProbes++;
+        if (t.tablebases->probeWdl(t.pos, wdl))
+        {
+            t.tbHits++;
+            int score = wdl == WDL_WIN ? TB_WIN_SCORE - ply : wdl == WDL_LOSS ? -TB_WIN_SCORE + ply : 0;
+            int bound = wdl == WDL_WIN ? BOUND_LOWER : wdl == WDL_LOSS ? BOUND_UPPER : BOUND_EXACT;
+            if (bound == BOUND_EXACT || (bound == BOUND_LOWER ? score >= beta : score <= alpha))
+            {
+                if (t.tt) t.tt->store(t.pos.key, min(depth + 6, MAX_PLY - 1), bound, score, NO_MOVE);
+                return score;
+            }
+        }
+    }
+
+    MoveList list;
+    if (ply == 0) list = t.rootMoves;
+    else generateLegalMoves(t.pos, list);
+    if (list.count == 0) return inCheck ? -MATE_SCORE + ply : 0;
+
+    int scores[256];
+    scoreMoves(t, list, scores, ply, ply == 0 && t.rootBest ? t.rootBest : ttMove);
+
+    int alphaOrig = alpha;
+    Move bestMove = NO_MOVE;
+    int best = -INFINITE_SCORE;
+    for (int i = 0; i < list.count; ++i)
+    {
+        Move m = pickMove(list, scores, i);
+        bool quiet = !isCapture(t.pos, m) && moveKind(m) != PROMOTION;
+
+        makeMove(t.pos, m);
+        int score;
+        if (i == 0)
+            score = -negamax(t, depth - 1, ply + 1, -beta, -alpha);
+        else
+        {
+            // principal variation search: prove the move is no better with a null window
+            score = -negamax(t, depth - 1, ply + 1, -alpha - 1, -alpha);
+            if (score > alpha && score < beta)
+                score = -negamax(t, depth - 1, ply + 1, -beta, -alpha);
+        }
+        unmakeMove(t.pos);
+        if (t.aborted) return 0;
+
+        if (score > best)
+        {
+            best = score;
+            bestMove = m;
+            if (score > alpha)
+            {
+                alpha = score;
+                t.pv[ply][ply] = m;
+                for (int j = ply + 1; j < t.pvLength[ply + 1]; ++j) t.pv[ply][j] = t.pv[ply + 1][j];
+                t.pvLength[ply] = t.pvLength[ply + 1];
+            }
+        }
+        if (alpha >= beta)
+        {
+            if (quiet) updateQuietStats(t, m, ply, depth);
+            break;
+        }
+    }
+
+    if (t.tt)
+    {
+        int bound = best >= beta ? BOUND_LOWER : best > alphaOrig ? BOUND_EXACT : BOUND_UPPER;
+        t.tt->store(t.pos.key, depth, bound, scoreToTT(best, ply), bestMove);
+        t.ttStores++;
+    }
+    return best;
+}
+
+// Lazy SMP depth staggering: helper i skips some iterations so the threads spread
+// over neighbouring depths instead of all searching the same tree in lockstep
+static const int skipSize[16] = { 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4 };
+static const int skipPhase[16] = { 0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3 };
+
+static bool skipDepth(int index, int depth)
+{
+    if (index == 0) return false;
+    int i = (index - 1) % 16;
+    return ((depth + skipPhase[i]) / skipSize[i]) % 2 != 0;
+}
+
+static void iterativeDeepening(SearchThread& t, const SearchCallback& onIteration)
+{
+    int maxDepth = t.limits.depth > 0 && t.limits.depth < MAX_PLY ? t.limits.depth : MAX_PLY - 1;
+    for (int depth = 1; depth <= maxDepth; ++depth)
+    {
+        if (skipDepth(t.index, depth)) continue;
+
+        int score = negamax(t, depth, 0, -INFINITE_SCORE, INFINITE_SCORE);
+        if (t.aborted) break;
+
+        // a covered root has a known result; keep the search's own score only for a mate
+        if (t.rootInTablebase && abs(score) < MATE_BOUND) score = t.rootTbScore;
+
+        SearchResult& r = t.completed;
+        r.depth = depth;
+        r.score = score;
+        r.pv.assign(t.pv[0], t.pv[0] + t.pvLength[0]);
+        if (!r.pv.empty()) r.bestMove = r.pv[0];
+        t.rootBest = r.bestMove;
+        if (t.index != 0) continue;
+
+        r.timeMs = elapsedMs(t);
+        t.publishedNodes.store(t.nodes, memory_order_relaxed);
+        if (onIteration)
+        {
+            SearchReport report;
+            report.depth = depth;
+            report.score = score;
+            report.nodes = totalNodes(*t.shared);
+            report.timeMs = r.timeMs;
+            report.pv = r.pv;
+            onIteration(report);
+        }
+
+        // a found mate will not get any shorter by searching deeper
+        if (abs(score) >= MATE_BOUND && depth >= MATE_SCORE - abs(score)) break;
+        // the next iteration costs more than everything so far; do not start what cannot finish
+        if (t.limits.movetimeMs && r.timeMs * 2 >= t.limits.movetimeMs) break;
+    }
+
+    t.publishedNodes.store(t.nodes, memory_order_relaxed);
+    // helpers only exist to feed the main thread's TT; they stop when it does
+    if (t.index == 0) t.shared->stopAll = true;
+}
+
+SearchResult search(const Position& pos, const SearchLimits& limits,
+                    const SearchCallback& onIteration, atomic<bool>* stop, TranspositionTable* tt,
+                    int threads, Tablebases* tablebases)
+{
+    SearchResult result;
+    MoveList rootMoves;
+    generateLegalMoves(pos, rootMoves);
+    if (rootMoves.count == 0) return result;
+
+    // search only the moves that keep the best tablebase result
+    bool rootInTablebase = false;
+    int rootTbScore = 0;
+    uint64_t rootTbProbes = 0;
+    if (tablebases && tablebases->covers(pos))
+    {
+        unique_ptr<Position> scratch(new Position(pos));
+        MoveList kept = rootMoves;
+        int wdl;
+        rootTbProbes++;
+        if (tablebases->filterRootMoves(*scratch, kept, wdl))
+        {
+            rootMoves = kept;
+            rootInTablebase = true;
+            rootTbScore = wdl == WDL_WIN ? TB_WIN_SCORE - 1 : wdl == WDL_LOSS ? -TB_WIN_SCORE + 1 : 0;
+        }
+    }
+
+    if (threads < 1) threads = 1;
+    // helpers without a shared table would just repeat the main thread's work
+    TranspositionTable localTable;
+    if (!tt && threads > 1 && localTable.resize(16)) tt = &localTable;
+    if (tt) tt->newSearch();
+
+    SearchShared shared;
+    vector<unique_ptr<SearchThread>> workers;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < threads; ++i)
+    {
+        workers.emplace_back(new SearchThread());
+        SearchThread& t = *workers.back();
+        t.index = i;
+        t.shared = &shared;
+        t.pos = pos;
+        t.limits = limits;
+        t.stop = stop;
+        t.tt = tt;
+        t.tablebases = tablebases;
+        t.rootMoves = rootMoves;
+        t.rootInTablebase = rootInTablebase;
+        t.rootTbScore = rootTbScore;
+        t.start = start;
+        memset(t.killers, 0, sizeof(t.killers));
+        memset(t.history, 0, sizeof(t.history));
+        // always have something to play, even if the first iteration is cut short
+        t.completed.bestMove = rootMoves.moves[0];
+        shared.threads.push_back(&t);
+    }
+
+    vector<thread> helpers;
+    for (int i = 1; i < threads; ++i)
+        helpers.emplace_back(iterativeDeepening, ref(*workers[i]), SearchCallback());
+    iterativeDeepening(*workers[0], onIteration);
+    for (thread& h : helpers) h.join();
+
+    // deterministic merge: deepest completed iteration wins, lowest thread index on ties
+    const SearchThread* best = workers[0].get();
+    for (const auto& w : workers)
+        if (w->completed.depth > best->completed.depth) best = w.get();
+    result = best->completed;
+
+    result.nodes = 0;
+    result.tbProbes = rootTbProbes;
+    result.tbHits = rootInTablebase;
+    for (const auto& w : workers)
+    {
+        result.nodes += w->nodes;
+        result.ttProbes += w->ttProbes;
+        result.ttHits += w->ttHits;
+        result.tbProbes += w->tbProbes;
+        result.tbHits += w->tbHits;
+        if (tt) tt->addStats(w->ttProbes, w->ttHits, w->ttStores);
+    }
+    result.timeMs = elapsedMs(*workers[0]);
+    if (tablebases) tablebases->addStats(result.tbProbes, result.tbHits);
+    return result;
+}
+
+string formatScore(int score)
+{
+    if (score >= MATE_BOUND) return "mate " + to_string((MATE_SCORE - score + 1) / 2);
+    if (score <= -MATE_BOUND) return "mate -" + to_string((MATE_SCORE + score) / 2);
+    return "cp " + to_string(score);
+}
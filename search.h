@@ -0,0 +1,74 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+#include "position.h"
+
+class Tablebases;
+class TranspositionTable;
+
+const int MAX_PLY = 128;
+const int MATE_SCORE = 32000;
+const int INFINITE_SCORE = 32001;
+// scores beyond this are "mate in n"
+const int MATE_BOUND = MATE_SCORE - MAX_PLY;
+// tablebase wins: above any evaluation, below every mate
+const int TB_WIN_SCORE = MATE_BOUND - 1;
+
+// search budget; a zero field means "no limit" on that axis
+struct SearchLimits
+{
+    int depth = 0;
+    int64_t movetimeMs = 0;
+    uint64_t nodes = 0;
+};
+
+// one completed iteration of the iterative-deepening loop
+struct SearchReport
+{
+    int depth = 0;
+    int score = 0;
+    uint64_t nodes = 0;
+    int64_t timeMs = 0;
+    std::vector<Move> pv;
+};
+
+struct SearchResult
+{
+    Move bestMove = NO_MOVE;
+    int score = 0;
+    int depth = 0;
+    uint64_t nodes = 0;
+    int64_t timeMs = 0;
+    std::vector<Move> pv;
+    uint64_t ttProbes = 0;
+    uint64_t ttHits = 0;
+    uint64_t tbProbes = 0;
+    uint64_t tbHits = 0;
+};
+
+typedef std::function<void(const SearchReport&)> SearchCallback;
+
+// Iterative-deepening negamax alpha-beta (PVS) with quiescence search on captures and
+// TT / MVV-LVA / killer / history move ordering. pos is not modified. Another thread may
+// raise *stop to end the search; the last completed iteration is returned. tt may be
+// shared between searches (and threads); without one nothing is cached.
+//
+// threads > 1 runs Lazy SMP: helpers search the same root on their own position copy
+// and killer/history tables at staggered depths, sharing only the TT (a 16 MB one is
+// created if none is given). The main thread owns the budget and the onIteration
+// reports; the result is the deepest completed iteration, lowest thread on ties.
+//
+// With tablebases, a root they cover is searched over only the moves that keep its
+// tablebase result, and positions they cover right after a capture or pawn move are
+// scored from the WDL tables instead of being searched.
+SearchResult search(const Position& pos, const SearchLimits& limits,
+                    const SearchCallback& onIteration = nullptr,
+                    std::atomic<bool>* stop = nullptr,
+                    TranspositionTable* tt = nullptr,
+                    int threads = 1,
+                    Tablebases* tablebases = nullptr);
+
+// UCI-style score text: "cp 35" or "mate -2"
+std::string formatScore(int score);
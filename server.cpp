@@ -0,0 +1,707 @@
+#include "server.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "histogram.h"
+#include "movegen.h"
+#include "rules.h"
+
+using namespace std;
+
+const size_t SESSIONS_PER_CHUNK = 256;
+const size_t READ_CHUNK = 1 << 16;
+
+static uint64_t cpuNanoseconds(clockid_t clock)
+{
+    timespec ts;
+    clock_gettime(clock, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ULL + uint64_t(ts.tv_nsec);
+}
+
+// ---- sessions ----
+
+struct Session
+{
+    uint32_t generation = 1;
+    bool live = false;
+    const char* status = "ongoing"; // as of the last move, so "game over" costs nothing
+    Position pos;
+};
+
+// Slots come in chunks that are never moved or freed, so a session's address stays put
+// while the pool grows. Only the I/O thread allocates and releases, between rounds.
+class SessionPool
+{
+public:
+    explicit SessionPool(size_t maxSessions) : maxSlots(maxSessions) {}
+
+    // 0 when the pool is full
+    uint64_t allocate()
+    {
+        size_t slot;
+        if (!freeSlots.empty())
+        {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else
+        {
+            if (slotCount == maxSlots) return 0;
+            if (slotCount % SESSIONS_PER_CHUNK == 0) chunks.emplace_back(new Session[SESSIONS_PER_CHUNK]);
+            slot = slotCount++;
+        }
+        Session& s = at(slot);
+        s.live = true;
+        s.status = "ongoing";
+        liveCount++;
+        return uint64_t(s.generation) << 32 | slot;
+    }
+
+    void release(uint64_t id)
+    {
+        Session& s = at(size_t(id & 0xFFFFFFFF));
+        s.live = false;
+        s.generation++; // old ids no longer match
+        freeSlots.push_back(uint32_t(id & 0xFFFFFFFF));
+        liveCount--;
+    }
+
+    // null for ids that were never handed out or whose game is closed
+    Session* find(uint64_t id)
+    {
+        size_t slot = size_t(id & 0xFFFFFFFF);
+        if (slot >= slotCount) return nullptr;
+        Session& s = at(slot);
+        return s.live && s.generation == uint32_t(id >> 32) ? &s : nullptr;
+    }
+
+    size_t live() const { return liveCount; }
+    size_t slots() const { return slotCount; }
+
+private:
+    Session& at(size_t slot) { return chunks[slot / SESSIONS_PER_CHUNK][slot % SESSIONS_PER_CHUNK]; }
+
+    vector<unique_ptr<Session[]>> chunks;
+    vector<uint32_t> freeSlots;
+    size_t slotCount = 0;
+    size_t liveCount = 0;
+    size_t maxSlots;
+};
+
+// ---- requests ----
+
+enum RequestKind { REQUEST_NEW, REQUEST_MOVE, REQUEST_MOVES, REQUEST_STATUS, REQUEST_CLOSE, REQUEST_LOCAL };
+
+struct Request
+{
+    int connection = 0;
+    RequestKind kind = REQUEST_LOCAL;
+    uint64_t id = 0;
+    string argument;
+    chrono::steady_clock::time_point received;
+    string reply;
+    bool release = false; // free the slot once the round is over
+};
+
+static const char* gameStatus(const Position& pos)
+{
+    MoveList list;
+    generateLegalMoves(pos, list);
+    if (list.count == 0)
+    {
+        if (!isKingInCheck(pos, pos.whiteToMove)) return "stalemate 1/2-1/2";
+        return pos.whiteToMove ? "checkmate 0-1" : "checkmate 1-0";
+    }
+    if (pos.halfmoveClock >= 100) return "fifty-moves 1/2-1/2";
+    if (repetitionCount(pos) >= 2) return "repetition 1/2-1/2";
+    if (isInsufficientMaterial(pos)) return "material 1/2-1/2";
+    return "ongoing";
+}
+
+// worker side: the session belongs to this worker for the whole round
+static void handleRequest(SessionPool& pool, Request& r)
+{
+    Session* s = pool.find(r.id);
+    if (!s)
+    {
+        r.reply = "error unknown session";
+        return;
+    }
+    switch (r.kind)
+    {
+    case REQUEST_NEW:
+        if (!setFromFen(s->pos, r.argument.empty() ? string(START_FEN) : r.argument))
+        {
+            s->live = false;
+            r.release = true;
+            r.reply = "error bad fen";
+            return;
+        }
+        s->status = gameStatus(s->pos);
+        r.reply = "ok " + to_string(r.id);
+        return;
+    case REQUEST_MOVE:
+    {
+        if (strcmp(s->status, "ongoing") != 0)
+        {
+            r.reply = "error game over";
+            return;
+        }
+        Move m = moveFromUci(s->pos, r.argument);
+        if (m == NO_MOVE)
+        {
+            r.reply = "illegal";
+            return;
+        }
+        makeMove(s->pos, m);
+        s->status = gameStatus(s->pos);
+        r.reply = string("ok ") + s->status;
+        return;
+    }
+    case REQUEST_MOVES:
+    {
+        MoveList list;
+        generateLegalMoves(s->pos, list);
+        r.reply = "ok " + to_string(list.count);
+        for (int i = 0; i < list.count; ++i) r.reply += " " + moveToUci(list.moves[i]);
+        return;
+    }
+    case REQUEST_STATUS:
+        r.reply = string("ok ") + s->status + " " + toFen(s->pos);
+        return;
+    case REQUEST_CLOSE:
+        s->live = false;
+        r.release = true;
+        r.reply = "ok";
+        return;
+    default:
+        return;
+    }
+}
+
+// Persistent workers that each take one batch per round; runRound returns when all are done.
+class WorkerPool
+{
+public:
+    WorkerPool(int count, SessionPool& pool) : pool(pool), batches(count)
+    {
+        for (int i = 0; i < count; ++i) threads.emplace_back(&WorkerPool::work, this, i);
+    }
+
+    ~WorkerPool()
+    {
+        {
+            lock_guard<mutex> lock(roundMutex);
+            quitting = true;
+        }
+        roundStart.notify_all();
+        for (thread& t : threads) t.join();
+    }
+
+    int size() const { return int(batches.size()); }
+    vector<Request*>& batch(int worker) { return batches[worker]; }
+
+    void runRound()
+    {
+        unique_lock<mutex> lock(roundMutex);
+        remaining = size();
+        round++;
+        roundStart.notify_all();
+        roundDone.wait(lock, [this]() { return remaining == 0; });
+    }
+
+    uint64_t cpuTime() const { return cpuNs.load(); }
+
+private:
+    void work(int index)
+    {
+        uint64_t seen = 0;
+        for (;;)
+        {
+            {
+                unique_lock<mutex> lock(roundMutex);
+                roundStart.wait(lock, [&]() { return quitting || round != seen; });
+                if (quitting) return;
+                seen = round;
+            }
+            uint64_t start = cpuNanoseconds(CLOCK_THREAD_CPUTIME_ID);
+            for (Request* r : batches[index]) handleRequest(pool, *r);
+            cpuNs += cpuNanoseconds(CLOCK_THREAD_CPUTIME_ID) - start;
+            {
+                lock_guard<mutex> lock(roundMutex);
+                if (--remaining == 0) roundDone.notify_one();
+            }
+        }
+    }
+
+    SessionPool& pool;
+    vector<vector<Request*>> batches;
+    vector<thread> threads;
+    mutex roundMutex;
+    condition_variable roundStart, roundDone;
+    uint64_t round = 0;
+    int remaining = 0;
+    bool quitting = false;
+    atomic<uint64_t> cpuNs{0};
+};
+
+// ---- server ----
+
+struct Connection
+{
+    int in, out;
+    string input, output;
+    bool ended = false; // no more input; dropped once the output is flushed
+};
+
+static atomic<bool> stopRequested{false};
+static void requestStop(int) { stopRequested = true; }
+
+static bool parseRequest(const string& line, Request& r)
+{
+    istringstream in(line);
+    string command;
+    in >> command;
+    if (command == "new") r.kind = REQUEST_NEW;
+    else if (command == "move") r.kind = REQUEST_MOVE;
+    else if (command == "moves") r.kind = REQUEST_MOVES;
+    else if (command == "status") r.kind = REQUEST_STATUS;
+    else if (command == "close") r.kind = REQUEST_CLOSE;
+    else return false;
+    getline(in >> ws, r.argument);
+    if (r.kind == REQUEST_NEW) return true;
+    istringstream rest(r.argument);
+    if (!(rest >> r.id)) return false;
+    getline(rest >> ws, r.argument);
+    return r.kind != REQUEST_MOVE || !r.argument.empty();
+}
+
+static int listenOn(const string& path)
+{
+    sockaddr_un address = {};
+    if (path.size() >= sizeof(address.sun_path)) return -1;
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path.c_str());
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    unlink(path.c_str()); // a socket file left by an earlier run
+    if (bind(fd, (sockaddr*)&address, sizeof(address)) != 0 || listen(fd, 128) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int runServer(const ServerOptions& options, ostream& log)
+{
+    bool socketMode = !options.socketPath.empty();
+    int listener = -1;
+    vector<Connection> connections;
+    if (socketMode)
+    {
+        listener = listenOn(options.socketPath);
+        if (listener < 0)
+        {
+            log << "cannot listen on " << options.socketPath << ": " << strerror(errno) << "\n";
+            return 1;
+        }
+        signal(SIGINT, requestStop);
+        signal(SIGTERM, requestStop);
+        log << "listening on " << options.socketPath << " with " << options.workers << " workers" << endl;
+    }
+    else
+        connections.push_back({ 0, 1, "", "", false });
+    signal(SIGPIPE, SIG_IGN); // a client that vanishes shows up as a failed write instead
+
+    SessionPool pool(options.maxSessions);
+    WorkerPool workers(max(1, options.workers), pool);
+    LatencyHistogram moveLatency, requestLatency;
+    uint64_t requests = 0, moves = 0;
+    uint64_t cpuStart = cpuNanoseconds(CLOCK_PROCESS_CPUTIME_ID);
+    auto started = chrono::steady_clock::now();
+    vector<Request> round;
+    vector<char> buffer(READ_CHUNK);
+
+    while (!stopRequested && (socketMode || !connections.empty()))
+    {
+        vector<pollfd> fds;
+        if (listener >= 0) fds.push_back({ listener, POLLIN, 0 });
+        for (Connection& c : connections)
+        {
+            fds.push_back({ c.ended ? -1 : c.in, POLLIN, 0 });
+            fds.push_back({ c.output.empty() ? -1 : c.out, POLLOUT, 0 });
+        }
+        if (poll(fds.data(), fds.size(), 100) < 0 && errno != EINTR) break;
+
+        size_t polled = connections.size(), base = listener >= 0 ? 1 : 0;
+        if (listener >= 0 && (fds[0].revents & POLLIN))
+        {
+            int client = accept(listener, nullptr, nullptr);
+            if (client >= 0)
+            {
+                fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK);
+                connections.push_back({ client, client, "", "", false });
+            }
+        }
+
+        // gather every complete line that has arrived into this round
+        round.clear();
+        for (size_t i = 0; i < polled; ++i)
+        {
+            Connection& c = connections[i];
+            if (!(fds[base + 2 * i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            ssize_t n = read(c.in, buffer.data(), buffer.size());
+            if (n <= 0)
+            {
+                if (n == 0 || (errno != EAGAIN && errno != EINTR)) c.ended = true;
+                continue;
+            }
+            auto now = chrono::steady_clock::now();
+            c.input.append(buffer.data(), size_t(n));
+            size_t start = 0;
+            for (size_t end; (end = c.input.find('\n', start)) != string::npos; start = end + 1)
+            {
+                Request r;
+                r.connection = int(i);
+                r.received = now;
+                string line = c.input.substr(start, end - start);
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                if (line.empty()) continue;
+                if (line == "stats") r.argument = line;
+                else if (!parseRequest(line, r))
+                {
+                    r.kind = REQUEST_LOCAL;
+                    r.argument.clear();
+                    r.reply = "error bad request";
+                }
+                round.push_back(move(r));
+            }
+            c.input.erase(0, start);
+        }
+
+        if (!round.empty())
+        {
+            // slots are handed out here, so a "new" gets its id before the workers run
+            for (int w = 0; w < workers.size(); ++w) workers.batch(w).clear();
+            for (Request& r : round)
+            {
+                if (r.kind == REQUEST_LOCAL) continue;
+                if (r.kind == REQUEST_NEW && (r.id = pool.allocate()) == 0)
+                {
+                    r.kind = REQUEST_LOCAL;
+                    r.reply = "error server full";
+                    continue;
+                }
+                workers.batch(int((r.id & 0xFFFFFFFF) % workers.size())).push_back(&r);
+            }
+            workers.runRound();
+
+            auto now = chrono::steady_clock::now();
+            for (Request& r : round)
+            {
+                if (r.release) pool.release(r.id);
+                if (r.kind == REQUEST_LOCAL && r.argument == "stats")
+                {
+                    uint64_t cpu = cpuNanoseconds(CLOCK_PROCESS_CPUTIME_ID) - cpuStart;
+                    r.reply = "ok sessions " + to_string(pool.live()) + " slots " + to_string(pool.slots())
+                              + " requests " + to_string(requests) + " moves " + to_string(moves)
+                              + " cpu-ns " + to_string(cpu) + " worker-cpu-ns " + to_string(workers.cpuTime())
+                              + " move-latency " + moveLatency.summary();
+                }
+                uint64_t ns = uint64_t(chrono::duration_cast<chrono::nanoseconds>(now - r.received).count());
+                requestLatency.record(ns);
+                requests++;
+                if (r.kind == REQUEST_MOVE)
+                {
+                    moveLatency.record(ns);
+                    moves++;
+                }
+                connections[r.connection].output += r.reply + "\n";
+            }
+        }
+
+        // flush what each connection can take; sockets are non-blocking, stdout is not
+        for (Connection& c : connections)
+        {
+            while (!c.output.empty())
+            {
+                ssize_t n = write(c.out, c.output.data(), c.output.size());
+                if (n <= 0)
+                {
+                    if (n < 0 && errno != EAGAIN && errno != EINTR)
+                    {
+                        c.output.clear();
+                        c.ended = true;
+                    }
+                    break;
+                }
+                c.output.erase(0, size_t(n));
+            }
+        }
+        // a finished connection's sessions stay open: games are not tied to one client
+        for (size_t i = connections.size(); i-- > 0;)
+        {
+            if (!connections[i].ended || !connections[i].output.empty()) continue;
+            if (socketMode) close(connections[i].in);
+            connections.erase(connections.begin() + i);
+        }
+    }
+
+    if (listener >= 0)
+    {
+        close(listener);
+        unlink(options.socketPath.c_str());
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    uint64_t cpu = cpuNanoseconds(CLOCK_PROCESS_CPUTIME_ID) - cpuStart;
+    log << "Requests: " << requests << " (" << moves << " moves) in " << seconds << " s\n"
+        << "Sessions: " << pool.live() << " open, " << pool.slots() << " slots of " << sizeof(Session) << " bytes\n"
+        << "Latency:  " << requestLatency.summary() << "\n"
+        << "Moves:    " << moveLatency.summary() << "\n"
+        << "CPU:      " << formatNanoseconds(requests ? double(cpu) / requests : 0.0) << " per request\n";
+    return 0;
+}
+
+// ---- load generator ----
+
+// one line at a time from a socket, blocking
+struct LineReader
+{
+    int fd;
+    string pending;
+
+    bool next(string& line)
+    {
+        char chunk[READ_CHUNK];
+        size_t end;
+        while ((end = pending.find('\n')) == string::npos)
+        {
+            ssize_t n = read(fd, chunk, sizeof(chunk));
+            if (n <= 0) return false;
+            pending.append(chunk, size_t(n));
+        }
+        line = pending.substr(0, end);
+        pending.erase(0, end + 1);
+        return true;
+    }
+};
+
+static bool sendAll(int fd, const string& text)
+{
+    for (size_t done = 0; done < text.size();)
+    {
+        ssize_t n = write(fd, text.data() + done, text.size() - done);
+        if (n <= 0) return false;
+        done += size_t(n);
+    }
+    return true;
+}
+
+static int connectTo(const string& path)
+{
+    sockaddr_un address = {};
+    if (path.size() >= sizeof(address.sun_path)) return -1;
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path.c_str());
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (sockaddr*)&address, sizeof(address)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+struct ClientStats
+{
+    LatencyHistogram latency;
+    uint64_t requests = 0;
+    uint64_t moves = 0;
+    uint64_t games = 0;
+    uint64_t errors = 0;
+    bool failed = false;
+};
+
+struct ClientGame
+{
+    string id;
+    int plies = 0;
+    string move;
+};
+
+// Sends the batch, then reads one reply per line, timing each from the moment the batch
+// went out: with pipelining that is what a client of a busy server sees.
+static bool roundTrip(int fd, LineReader& reader, const string& batch, size_t lines, vector<string>& replies,
+                      ClientStats& stats)
+{
+    auto sent = chrono::steady_clock::now();
+    if (!sendAll(fd, batch)) return false;
+    replies.resize(lines);
+    for (size_t i = 0; i < lines; ++i)
+    {
+        if (!reader.next(replies[i])) return false;
+        stats.latency.record(uint64_t(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - sent).count()));
+        stats.requests++;
+        if (replies[i].compare(0, 2, "ok") != 0) stats.errors++;
+    }
+    return true;
+}
+
+static void runClient(const LoadOptions& options, int sessions, atomic<uint64_t>& gamesLeft, uint64_t seed,
+                      ClientStats& stats)
+{
+    int fd = connectTo(options.socketPath);
+    if (fd < 0)
+    {
+        stats.failed = true;
+        return;
+    }
+    LineReader reader{ fd, "" };
+    mt19937_64 random(seed);
+    vector<ClientGame> games;
+    vector<string> replies;
+
+    auto claimGames = [&](int wanted) {
+        string batch;
+        int count = 0;
+        for (; count < wanted; ++count)
+        {
+            uint64_t left = gamesLeft.load();
+            while (left > 0 && !gamesLeft.compare_exchange_weak(left, left - 1)) {}
+            if (left == 0) break;
+            batch += "new\n";
+        }
+        if (count == 0) return true;
+        if (!roundTrip(fd, reader, batch, size_t(count), replies, stats)) return false;
+        for (const string& reply : replies)
+            if (reply.compare(0, 3, "ok ") == 0) games.push_back({ reply.substr(3), 0, "" });
+        return true;
+    };
+
+    bool ok = claimGames(sessions);
+    while (ok && !games.empty())
+    {
+        // every session asks for its moves, then plays a random one
+        string batch;
+        for (const ClientGame& g : games) batch += "moves " + g.id + "\n";
+        if (!(ok = roundTrip(fd, reader, batch, games.size(), replies, stats))) break;
+        batch.clear();
+        for (size_t i = 0; i < games.size(); ++i)
+        {
+            istringstream in(replies[i]);
+            string status;
+            int count = 0;
+            in >> status >> count;
+            vector<string> legal(count > 0 ? count : 0);
+            for (string& m : legal) in >> m;
+            games[i].move = legal.empty() ? string("0000") : legal[random() % legal.size()];
+            batch += "move " + games[i].id + " " + games[i].move + "\n";
+        }
+        if (!(ok = roundTrip(fd, reader, batch, games.size(), replies, stats))) break;
+
+        // finished and over-long games are closed and replaced
+        batch.clear();
+        int closed = 0;
+        for (size_t i = 0; i < games.size();)
+        {
+            stats.moves++;
+            bool over = replies[i] != "ok ongoing" || ++games[i].plies >= options.maxPlies;
+            if (!over)
+            {
+                ++i;
+                continue;
+            }
+            batch += "close " + games[i].id + "\n";
+            stats.games++;
+            closed++;
+            replies.erase(replies.begin() + i);
+            games.erase(games.begin() + i);
+        }
+        if (closed && !(ok = roundTrip(fd, reader, batch, size_t(closed), replies, stats))) break;
+        if (closed) ok = claimGames(closed);
+    }
+    if (!ok) stats.failed = true;
+    close(fd);
+}
+
+int runLoadGenerator(const LoadOptions& options, ostream& out)
+{
+    int connections = max(1, options.connections);
+    atomic<uint64_t> gamesLeft{options.games};
+    vector<ClientStats> stats(connections);
+    vector<thread> clients;
+    auto started = chrono::steady_clock::now();
+    for (int i = 0; i < connections; ++i)
+    {
+        int share = options.sessions / connections + (i < options.sessions % connections);
+        clients.emplace_back(runClient, cref(options), share, ref(gamesLeft), options.seed + i, ref(stats[i]));
+    }
+    for (thread& t : clients) t.join();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+    ClientStats total;
+    for (const ClientStats& s : stats)
+    {
+        total.latency.merge(s.latency);
+        total.requests += s.requests;
+        total.moves += s.moves;
+        total.games += s.games;
+        total.errors += s.errors;
+        total.failed = total.failed || s.failed;
+    }
+    if (total.failed) out << "some connections to " << options.socketPath << " failed\n";
+
+    out << "Games:     " << total.games << " finished, " << total.moves << " moves, " << total.requests << " requests"
+        << (total.errors ? ", " + to_string(total.errors) + " errors" : string()) << "\n"
+        << "Rate:      " << int64_t(total.requests / seconds) << " requests/s, " << int64_t(total.moves / seconds)
+        << " moves/s over " << connections << " connections, " << options.sessions << " sessions\n"
+        << "Latency:   " << total.latency.summary() << " (client side, per pipelined batch)\n";
+
+    // the server's own view: latency from arrival to reply, and CPU spent per move
+    int fd = connectTo(options.socketPath);
+    LineReader reader{ fd, "" };
+    string reply;
+    if (fd >= 0 && sendAll(fd, "stats\n") && reader.next(reply))
+    {
+        istringstream in(reply);
+        string token;
+        uint64_t serverMoves = 0, cpu = 0, requests = 0;
+        while (in >> token)
+        {
+            if (token == "moves") in >> serverMoves;
+            else if (token == "requests") in >> requests;
+            else if (token == "cpu-ns") in >> cpu;
+            else if (token == "move-latency") break;
+        }
+        string latency;
+        getline(in >> ws, latency);
+        out << "Server:    " << latency << " (moves, arrival to reply)\n";
+        if (serverMoves > 0)
+        {
+            double perMove = double(cpu) / serverMoves; // every request of the game, spread over its moves
+            out << "CPU:       " << formatNanoseconds(perMove) << " per move, all server threads included\n"
+                << "Capacity:  " << int64_t(options.moveIntervalSec * 1e9 / perMove)
+                << " sessions per core at one move every " << options.moveIntervalSec << " s\n";
+        }
+    }
+    if (fd >= 0) close(fd);
+    return total.failed ? 1 : 0;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+// Headless game server: many independent games in one process, driven over a local
+// Unix stream socket (any number of clients) or stdin/stdout (one client, e.g. a pipe).
+//
+// Protocol: one request per line, one reply line per request, in order per connection;
+// requests may be pipelined.
+//   new [fen]          -> ok <id>                 (start position without a FEN)
+//   move <id> <uci>    -> ok <status> | illegal
+//   moves <id>         -> ok <count> <uci> ...
+//   status <id>        -> ok <status> <fen>
+//   close <id>         -> ok
+//   stats              -> ok sessions <n> requests <n> <latency percentiles> ...
+// status: ongoing, checkmate 1-0 / 0-1, stalemate / fifty-moves / repetition / material 1/2-1/2.
+// Errors: "error <reason>" (unknown session, game over, bad fen, bad request).
+//
+// Sessions live in a pool of slots allocated in fixed-size chunks, reused through a
+// free list; ids carry a generation, so the id of a closed game never reaches its
+// slot's next game. The I/O thread gathers every request that has arrived into a round
+// and splits it across the workers by slot, so each session is only ever touched by one
+// worker and needs no lock; move validation and the mate / stalemate check that follows
+// it run there. Replies go out when the round is done.
+
+struct ServerOptions
+{
+    std::string socketPath; // empty: serve stdin/stdout
+    int workers = 2;
+    size_t maxSessions = 1000000;
+};
+
+// Runs until the input ends (stdin) or SIGINT / SIGTERM (socket), then prints the
+// request count, latency percentiles and CPU cost per request to log.
+int runServer(const ServerOptions& options, std::ostream& log);
+
+struct LoadOptions
+{
+    std::string socketPath;
+    int connections = 4;
+    int sessions = 1000;       // games in progress at any time, spread over the connections
+    uint64_t games = 2000;     // total games to finish
+    int maxPlies = 200;        // longer games are closed unfinished
+    double moveIntervalSec = 5; // the pace one session of a real game needs, for the capacity estimate
+    uint64_t seed = 1;
+};
+
+// Synthetic clients: every connection keeps its share of the sessions busy with random
+// legal moves (a "moves" then a "move" request per ply, pipelined across the sessions),
+// replacing each finished game with a new one. Prints throughput, client-side latency
+// percentiles and the server's own figures, plus how many sessions one worker core
+// could serve at moveIntervalSec per move.
+int runLoadGenerator(const LoadOptions& options, std::ostream& out);
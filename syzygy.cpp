@@ -0,0 +1,936 @@
+#include "syzygy.h"
+#include <algorithm>
+#include <cstring>
+#include <dirent.h>
+#include "mappedfile.h"
+#include "rules.h"
+
+using namespace std;
+
+// The file layout and index scheme follow the Syzygy generator (and the reference
+// probing code in Fathom / Stockfish): a position is reduced by symmetry, its pieces
+// are grouped and each group is numbered combinatorially, and the resulting index is
+// looked up in Huffman-coded blocks of "recursive pairing" symbols.
+
+static const uint8_t wdlMagic[4] = { 0x71, 0xE8, 0x23, 0x5D };
+static const uint8_t dtzMagic[4] = { 0xD7, 0x66, 0x0C, 0xA5 };
+
+// per-table flags stored in the file
+enum { FLAG_STM = 1, FLAG_MAPPED = 2, FLAG_WIN_PLIES = 4, FLAG_LOSS_PLIES = 8, FLAG_WIDE = 16,
+       FLAG_SINGLE_VALUE = 128 };
+
+// how a table lookup went: CHANGE_STM means a one-sided DTZ table holds the other side to move
+enum { PROBE_FAIL = 0, PROBE_OK = 1, PROBE_CHANGE_STM = -1, PROBE_ZEROING_BEST_MOVE = 2 };
+
+const int MAX_DTZ = 1 << 18;
+
+static int fileOf(int sq) { return sq & 7; }
+static int rankOf(int sq) { return sq >> 3; }
+// negative below the a1-h8 diagonal, 0 on it
+static int offDiagonal(int sq) { return rankOf(sq) - fileOf(sq); }
+static int edgeDistance(int file) { return min(file, 7 - file); }
+
+static uint16_t get16(const uint8_t* p) { return uint16_t(p[0] | p[1] << 8); }
+static uint32_t get32(const uint8_t* p) { return uint32_t(get16(p)) | uint32_t(get16(p + 2)) << 16; }
+static uint32_t get32be(const uint8_t* p) { return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3]; }
+static uint64_t get64be(const uint8_t* p) { return uint64_t(get32be(p)) << 32 | get32be(p + 4); }
+
+// index tables shared by every table file
+static int mapPawns[64];           // a2-h7 -> 0..47, edge files and low ranks highest
+static int mapB1H1H7[64];          // squares below the a1-h8 diagonal -> 0..27
+static int mapA1D1D4[64];          // the a1-d1-d4 triangle -> 0..9, diagonal squares last
+static int mapKK[10][64];          // the 462 non-adjacent king pairs, first king in the triangle
+static uint64_t binomial[7][64];   // binomial[k][n] = n choose k
+static int leadPawnIdx[6][64];     // leading pawn group start index by pawn count and square
+static int leadPawnsSize[6][4];    // leading pawn group size by pawn count and file
+
+static void initIndexTables()
+{
+    int code = 0;
+    for (int sq = 0; sq < 64; ++sq)
+        if (offDiagonal(sq) < 0) mapB1H1H7[sq] = code++;
+
+    code = 0;
+    vector<int> diagonal;
+    for (int sq = 0; sq <= 27; ++sq)
+    {
+        if (offDiagonal(sq) < 0 && fileOf(sq) <= 3) mapA1D1D4[sq] = code++;
+        else if (offDiagonal(sq) == 0 && fileOf(sq) <= 3) diagonal.push_back(sq);
+    }
+    for (int sq : diagonal) mapA1D1D4[sq] = code++;
+
+    code = 0;
+    vector<pair<int, int>> bothOnDiagonal;
+    for (int idx = 0; idx < 10; ++idx)
+        for (int s1 = 0; s1 <= 27; ++s1)
+        {
+            if (mapA1D1D4[s1] != idx || (idx == 0 && s1 != 1)) continue; // b1 is mapped to 0
+            for (int s2 = 0; s2 < 64; ++s2)
+            {
+                if ((kingAttackTable[s1] | squareBB(s1)) & squareBB(s2)) continue; // kings touch
+                if (offDiagonal(s1) == 0 && offDiagonal(s2) > 0) continue;        // mirrored case
+                if (offDiagonal(s1) == 0 && offDiagonal(s2) == 0) bothOnDiagonal.push_back({ idx, s2 });
+                else mapKK[idx][s2] = code++;
+            }
+        }
+    for (const auto& p : bothOnDiagonal) mapKK[p.first][p.second] = code++;
+
+    binomial[0][0] = 1;
+    for (int n = 1; n < 64; ++n)
+        for (int k = 0; k < 7 && k <= n; ++k)
+            binomial[k][n] = (k > 0 ? binomial[k - 1][n - 1] : 0) + (k < n ? binomial[k][n - 1] : 0);
+
+    int available = 47;
+    for (int leadPawns = 1; leadPawns <= 5; ++leadPawns)
+        for (int file = 0; file < 4; ++file)
+        {
+            // the index restarts at every file: each file has its own table
+            int idx = 0;
+            for (int rank = 1; rank <= 6; ++rank)
+            {
+                int sq = rank * 8 + file;
+                if (leadPawns == 1)
+                {
+                    mapPawns[sq] = available--;
+                    mapPawns[sq ^ 7] = available--;
+                }
+                leadPawnIdx[leadPawns][sq] = idx;
+                idx += int(binomial[leadPawns - 1][mapPawns[sq]]);
+            }
+            leadPawnsSize[leadPawns][file] = idx;
+        }
+}
+
+static const bool indexTablesReady = (initIndexTables(), true);
+
+// Decoding state of one (side to move, leading file) subtable.
+struct PairsData
+{
+    int flags = 0;
+    size_t blockSize = 0;
+    size_t span = 0;                         // a sparse index entry every span positions
+    uint32_t numBlocks = 0;
+    uint32_t blockLengthSize = 0;
+    int maxSymLen = 0;
+    int minSymLen = 0;                       // the single value when FLAG_SINGLE_VALUE is set
+    const uint8_t* lowestSym = nullptr;      // u16 per symbol length
+    const uint8_t* btree = nullptr;          // 3 bytes per symbol: left and right 12-bit children
+    const uint8_t* blockLength = nullptr;    // u16 per block: stored positions minus one
+    const uint8_t* sparseIndex = nullptr;    // 6 bytes per entry: block u32, offset u16
+    size_t sparseIndexSize = 0;
+    const uint8_t* data = nullptr;           // the Huffman-coded blocks
+    const uint8_t* end = nullptr;            // end of the mapped file
+    uint64_t tableSize = 0;                  // positions in the subtable
+    vector<uint64_t> base64;                 // lowest code of each length, left-aligned
+    vector<uint8_t> symlen;                  // values (minus one) a symbol expands to
+    int pieces[MAX_TABLEBASE_PIECES] = {};
+    uint64_t groupIdx[MAX_TABLEBASE_PIECES + 1] = {};
+    int groupLen[MAX_TABLEBASE_PIECES + 1] = {};
+    uint16_t mapIdx[4] = {};                 // DTZ value maps: win, loss, cursed win, blessed loss
+
+    int left(int sym) const { return ((btree[3 * sym + 1] & 0xF) << 8) | btree[3 * sym]; }
+    int right(int sym) const { return (btree[3 * sym + 2] << 4) | (btree[3 * sym + 1] >> 4); }
+};
+
+struct Tablebases::Table
+{
+    string path;
+    bool dtz = false;
+    uint64_t key = 0, key2 = 0; // material with the name's first side white / black
+    int pieceCount = 0;
+    bool hasPawns = false;
+    bool hasUniquePieces = false;
+    int pawnCount[2] = {};      // leading side first
+
+    atomic<bool> ready{false};  // mapping attempted (usable tells whether it worked)
+    bool usable = false;
+    MappedFile file;
+    const uint8_t* map = nullptr;
+    size_t mapSize = 0;         // bytes of the DTZ value maps
+    PairsData items[2][4];      // [side to move][leading pawn file]
+
+    PairsData* get(int stm, int file) { return &items[dtz ? 0 : stm][hasPawns ? file : 0]; }
+    const PairsData* get(int stm, int file) const { return &items[dtz ? 0 : stm][hasPawns ? file : 0]; }
+};
+
+// piece counts packed four bits per (colour, type); kings are always one each and left out
+static uint64_t materialKey(const int counts[2][PIECE_TYPE_NB], bool flip)
+{
+    uint64_t key = 0;
+    for (int c = WHITE; c <= BLACK; ++c)
+        for (int type = PAWN; type < KING; ++type)
+            key |= uint64_t(counts[c][type]) << (4 * ((c ^ flip) * 6 + type));
+    return key;
+}
+
+static uint64_t materialKey(const Position& pos)
+{
+    int counts[2][PIECE_TYPE_NB];
+    for (int c = WHITE; c <= BLACK; ++c)
+        for (int type = PAWN; type < PIECE_TYPE_NB; ++type) counts[c][type] = __builtin_popcountll(pos.pieces[c][type]);
+    return materialKey(counts, false);
+}
+
+// table piece code: colour * 8 + type + 1, as in the files
+static int pieceCode(const Position& pos, int sq)
+{
+    int c = (pos.byColor[BLACK] >> sq) & 1;
+    for (int type = PAWN; type < PIECE_TYPE_NB; ++type)
+        if (pos.pieces[c][type] & squareBB(sq)) return c * 8 + type + 1;
+    return 0;
+}
+
+// "KRPvKR" -> piece counts per side; false unless each side is a king plus pieces
+static bool parseTableName(const string& name, int counts[2][PIECE_TYPE_NB], int& pieceCount)
+{
+    memset(counts, 0, sizeof(int) * 2 * PIECE_TYPE_NB);
+    size_t v = name.find('v');
+    if (v == string::npos || v == 0 || v + 1 >= name.size()) return false;
+    pieceCount = 0;
+    for (size_t i = 0; i < name.size(); ++i)
+    {
+        if (i == v) continue;
+        const char* type = strchr("PNBRQK", name[i]);
+        if (!type || !name[i]) return false;
+        counts[i > v][type - "PNBRQK"]++;
+        pieceCount++;
+    }
+    return counts[WHITE][KING] == 1 && counts[BLACK][KING] == 1 && pieceCount <= MAX_TABLEBASE_PIECES;
+}
+
+static void setGroups(const Tablebases::Table& e, PairsData* d, const int order[2], int file)
+{
+    int n = 0, firstLen = e.hasPawns ? 0 : e.hasUniquePieces ? 3 : 2;
+    d->groupLen[n] = 1;
+    // KRKN is encoded as (K, R, K) then (N): the first group is the kings plus a unique
+    // piece (or the leading pawns), each further group a run of identical pieces
+    for (int i = 1; i < e.pieceCount; ++i)
+    {
+        if (--firstLen > 0 || d->pieces[i] == d->pieces[i - 1]) d->groupLen[n]++;
+        else d->groupLen[++n] = 1;
+    }
+    d->groupLen[++n] = 0;
+
+    // the groups are multiplied together in the per-table order stored in the file
+    bool pp = e.hasPawns && e.pawnCount[1];
+    int next = pp ? 2 : 1;
+    int freeSquares = 64 - d->groupLen[0] - (pp ? d->groupLen[1] : 0);
+    uint64_t idx = 1;
+    for (int k = 0; next < n || k == order[0] || k == order[1]; ++k)
+    {
+        if (k == order[0])
+        {
+            d->groupIdx[0] = idx;
+            idx *= e.hasPawns ? leadPawnsSize[d->groupLen[0]][file] : e.hasUniquePieces ? 31332 : 462;
+        }
+        else if (k == order[1])
+        {
+            d->groupIdx[1] = idx;
+            idx *= binomial[d->groupLen[1]][48 - d->groupLen[0]];
+        }
+        else
+        {
+            d->groupIdx[next] = idx;
+            idx *= binomial[d->groupLen[next]][freeSquares];
+            freeSquares -= d->groupLen[next++];
+        }
+    }
+    d->groupIdx[n] = idx;
+}
+
+// true when n bytes from p lie inside the file
+static bool fits(const uint8_t* p, const uint8_t* end, uint64_t n) { return p <= end && n <= uint64_t(end - p); }
+
+static uint8_t setSymlen(PairsData* d, int sym, vector<bool>& visited)
+{
+    visited[sym] = true;
+    int r = d->right(sym);
+    if (r == 0xFFF) return 0;
+    int l = d->left(sym);
+    if (!visited[l]) d->symlen[l] = setSymlen(d, l, visited);
+    if (!visited[r]) d->symlen[r] = setSymlen(d, r, visited);
+    return uint8_t(d->symlen[l] + d->symlen[r] + 1);
+}
+
+// nullptr if the sizes or the Huffman tables do not fit the file
+static const uint8_t* setSizes(PairsData* d, const uint8_t* data, const uint8_t* end)
+{
+    d->end = end;
+    if (!fits(data, end, 1)) return nullptr;
+    d->flags = *data++;
+    if (d->flags & FLAG_SINGLE_VALUE)
+    {
+        if (!fits(data, end, 1)) return nullptr;
+        d->minSymLen = *data++;
+        return data;
+    }
+
+    if (!fits(data, end, 9)) return nullptr;
+    int blockBits = *data++, spanBits = *data++;
+    if (blockBits > 31 || spanBits > 31) return nullptr;
+    d->blockSize = size_t(1) << blockBits;
+    d->span = size_t(1) << spanBits;
+    d->sparseIndexSize = size_t((d->tableSize + d->span - 1) / d->span);
+    int padding = *data++;
+    d->numBlocks = get32(data);
+    data += 4;
+    d->blockLengthSize = d->numBlocks + padding;
+    d->maxSymLen = *data++;
+    d->minSymLen = *data++;
+    // codes are at most 32 bits, which keeps every shift below in range
+    if (d->minSymLen < 1 || d->maxSymLen < d->minSymLen || d->maxSymLen > 32 || d->numBlocks == 0) return nullptr;
+    d->lowestSym = data;
+    d->base64.assign(d->maxSymLen - d->minSymLen + 1, 0);
+    if (!fits(data, end, d->base64.size() * 2 + 2)) return nullptr;
+
+    // canonical Huffman code: longer codes have lower values, so base64[] decreases and a
+    // left-aligned code of length l lies between base64[l - 1] and base64[l]
+    for (int i = int(d->base64.size()) - 2; i >= 0; --i)
+        d->base64[i] = (d->base64[i + 1] + get16(d->lowestSym + 2 * i) - get16(d->lowestSym + 2 * (i + 1))) / 2;
+    for (size_t i = 0; i < d->base64.size(); ++i) d->base64[i] <<= 64 - i - d->minSymLen;
+
+    data += d->base64.size() * 2;
+    d->symlen.assign(get16(data), 0);
+    data += 2;
+    d->btree = data;
+    if (d->symlen.empty() || !fits(data, end, d->symlen.size() * 3 + (d->symlen.size() & 1))) return nullptr;
+    // a symbol pairs up symbols defined before it, so the tree has no cycles
+    for (size_t sym = 0; sym < d->symlen.size(); ++sym)
+        if (d->right(int(sym)) != 0xFFF && (size_t(d->left(int(sym))) >= sym || size_t(d->right(int(sym))) >= sym))
+            return nullptr;
+    vector<bool> visited(d->symlen.size());
+    for (size_t sym = 0; sym < d->symlen.size(); ++sym)
+        if (!visited[sym]) d->symlen[sym] = setSymlen(d, int(sym), visited);
+    return data + d->symlen.size() * 3 + (d->symlen.size() & 1);
+}
+
+// the piece list of a subtable must be the table's material, leading pawns first
+static bool validPieces(const Tablebases::Table& e, const PairsData* d)
+{
+    int counts[16] = {};
+    for (int k = 0; k < e.pieceCount; ++k) counts[d->pieces[k]]++;
+    for (int c = WHITE; c <= BLACK; ++c)
+        for (int type = PAWN; type < PIECE_TYPE_NB; ++type)
+        {
+            int expected = type == KING ? 1 : int((e.key >> (4 * (c * 6 + type))) & 0xF);
+            if (counts[c * 8 + type + 1] != expected) return false;
+        }
+    if (!e.hasPawns) return true;
+    int lead = d->pieces[0];
+    if ((lead & 7) != PAWN + 1) return false;
+    for (int k = 0; k < e.pawnCount[0] + e.pawnCount[1]; ++k)
+        if (d->pieces[k] != (k < e.pawnCount[0] ? lead : lead ^ 8)) return false;
+    return true;
+}
+
+// Parses the header of a mapped table (data is just past the magic): piece order and
+// group layout per subtable, then the Huffman tables, sparse index and block list.
+// False if any of it disagrees with the table's name or points outside the file.
+static bool setupTable(Tablebases::Table& e, const uint8_t* data)
+{
+    const uint8_t* base = (const uint8_t*)e.file.data();
+    const uint8_t* end = base + e.file.size();
+    int sides = !e.dtz && e.key != e.key2 ? 2 : 1;
+    int maxFile = e.hasPawns ? 3 : 0;
+    bool pp = e.hasPawns && e.pawnCount[1];
+
+    // flags: split (two sides to move) and has-pawns, both known from the name
+    if (!fits(data, end, 1)) return false;
+    int fileFlags = *data++;
+    if (bool(fileFlags & 2) != e.hasPawns || (!e.dtz && bool(fileFlags & 1) != (sides == 2))) return false;
+
+    for (int f = 0; f <= maxFile; ++f)
+    {
+        if (!fits(data, end, 1 + pp + e.pieceCount)) return false;
+        int order[2][2] = { { *data & 0xF, pp ? *(data + 1) & 0xF : 0xF },
+                            { *data >> 4, pp ? *(data + 1) >> 4 : 0xF } };
+        data += 1 + pp;
+        for (int k = 0; k < e.pieceCount; ++k, ++data)
+            for (int i = 0; i < sides; ++i) e.get(i, f)->pieces[k] = i ? *data >> 4 : *data & 0xF;
+        for (int i = 0; i < sides; ++i)
+        {
+            PairsData* d = e.get(i, f);
+            if (!validPieces(e, d)) return false;
+            setGroups(e, d, order[i], f);
+            // every group must have been placed by the stored order
+            int groups = int(find(d->groupLen, d->groupLen + MAX_TABLEBASE_PIECES, 0) - d->groupLen);
+            for (int g = 0; g <= groups; ++g)
+                if (!d->groupIdx[g]) return false;
+            d->tableSize = d->groupIdx[groups];
+        }
+    }
+    data += (data - base) & 1;
+
+    for (int f = 0; f <= maxFile; ++f)
+        for (int i = 0; i < sides; ++i)
+            if (!(data = setSizes(e.get(i, f), data, end))) return false;
+
+    if (e.dtz)
+    {
+        // per file, four value maps (win, loss, cursed win, blessed loss) of u8 or u16
+        e.map = data;
+        for (int f = 0; f <= maxFile; ++f)
+        {
+            PairsData* d = e.get(0, f);
+            if (!(d->flags & FLAG_MAPPED)) continue;
+            if (d->flags & FLAG_WIDE)
+            {
+                data += (data - base) & 1;
+                for (int i = 0; i < 4; ++i)
+                {
+                    if (!fits(data, end, 2) || (data - e.map) / 2 + 1 > 0xFFFF) return false;
+                    d->mapIdx[i] = uint16_t((data - e.map) / 2 + 1);
+                    data += 2 * get16(data) + 2;
+                }
+            }
+            else
+            {
+                for (int i = 0; i < 4; ++i)
+                {
+                    if (!fits(data, end, 1) || data - e.map + 1 > 0xFFFF) return false;
+                    d->mapIdx[i] = uint16_t(data - e.map + 1);
+                    data += *data + 1;
+                }
+            }
+            if (data > end) return false;
+        }
+        data += (data - base) & 1;
+        e.mapSize = size_t(data - e.map);
+    }
+
+    for (int f = 0; f <= maxFile; ++f)
+        for (int i = 0; i < sides; ++i)
+        {
+            PairsData* d = e.get(i, f);
+            d->sparseIndex = data;
+            if (!fits(data, end, uint64_t(d->sparseIndexSize) * 6)) return false;
+            data += d->sparseIndexSize * 6;
+        }
+    for (int f = 0; f <= maxFile; ++f)
+        for (int i = 0; i < sides; ++i)
+        {
+            PairsData* d = e.get(i, f);
+            d->blockLength = data;
+            if (!fits(data, end, uint64_t(d->blockLengthSize) * 2)) return false;
+            data += d->blockLengthSize * 2;
+        }
+    for (int f = 0; f <= maxFile; ++f)
+        for (int i = 0; i < sides; ++i)
+        {
+            PairsData* d = e.get(i, f);
+            if (d->flags & FLAG_SINGLE_VALUE) continue;
+            data = base + ((data - base + 0x3F) & ~0x3F); // blocks are 64-byte aligned
+            d->data = data;
+            if (!fits(data, end, uint64_t(d->numBlocks) * d->blockSize)) return false;
+            data += size_t(d->numBlocks) * d->blockSize;
+        }
+    return true;
+}
+
+// The value stored for position number idx of a subtable, or -1 if the data turns out
+// to be corrupt (every read is checked against the end of the file).
+static int decompressPairs(const PairsData* d, uint64_t idx)
+{
+    if (idx >= d->tableSize) return -1;
+    if (d->flags & FLAG_SINGLE_VALUE) return d->minSymLen;
+
+    // the sparse index gives a block and an offset for every span-th position; walk
+    // block lengths from there to the block holding idx
+    uint64_t k = idx / d->span;
+    uint32_t block = get32(d->sparseIndex + 6 * k);
+    int64_t offset = get16(d->sparseIndex + 6 * k + 4);
+    offset += int64_t(idx % d->span) - int64_t(d->span / 2);
+    if (block >= d->numBlocks) return -1;
+    while (offset < 0)
+    {
+        if (block == 0) return -1;
+        offset += get16(d->blockLength + 2 * --block) + 1;
+    }
+    while (offset > get16(d->blockLength + 2 * block))
+    {
+        offset -= get16(d->blockLength + 2 * block++) + 1;
+        if (block >= d->numBlocks) return -1;
+    }
+
+    // decode symbols until the one that covers offset
+    const uint8_t* ptr = d->data + uint64_t(block) * d->blockSize;
+    if (!fits(ptr, d->end, 8)) return -1;
+    uint64_t buf64 = get64be(ptr);
+    ptr += 8;
+    int buf64Size = 64;
+    int sym;
+    int lengths = int(d->base64.size());
+    while (true)
+    {
+        int len = 0;
+        while (len < lengths && buf64 < d->base64[len]) ++len;
+        if (len == lengths) return -1;
+        sym = int((buf64 - d->base64[len]) >> (64 - len - d->minSymLen));
+        sym += get16(d->lowestSym + 2 * len);
+        if (size_t(sym) >= d->symlen.size()) return -1;
+        if (offset < d->symlen[sym] + 1) break;
+
+        offset -= d->symlen[sym] + 1;
+        len += d->minSymLen;
+        buf64 <<= len;
+        buf64Size -= len;
+        if (buf64Size <= 32)
+        {
+            if (!fits(ptr, d->end, 4)) return -1;
+            buf64Size += 32;
+            buf64 |= uint64_t(get32be(ptr)) << (64 - buf64Size);
+            ptr += 4;
+        }
+    }
+
+    // a symbol expands into a pair of symbols, recursively: descend to the leaf at offset
+    // (children come before their parent, so this ends)
+    while (d->right(sym) != 0xFFF)
+    {
+        int l = d->left(sym);
+        if (offset < d->symlen[l] + 1) sym = l;
+        else
+        {
+            offset -= d->symlen[l] + 1;
+            sym = d->right(sym);
+        }
+    }
+    return d->left(sym);
+}
+
+static bool pawnsBefore(int a, int b) { return mapPawns[a] < mapPawns[b]; }
+
+Tablebases::Tablebases() {}
+Tablebases::~Tablebases() {}
+
+int Tablebases::init(const string& paths)
+{
+    tables.clear();
+    wdlTables.clear();
+    dtzTables.clear();
+    wdlCount = 0;
+    largest = 0;
+
+    size_t start = 0;
+    while (start <= paths.size())
+    {
+        size_t end = paths.find(':', start);
+        if (end == string::npos) end = paths.size();
+        string dir = paths.substr(start, end - start);
+        start = end + 1;
+        DIR* listing = dir.empty() ? nullptr : opendir(dir.c_str());
+        if (!listing) continue;
+
+        while (dirent* entry = readdir(listing))
+        {
+            string name = entry->d_name;
+            if (name.size() < 6) continue;
+            string extension = name.substr(name.size() - 5);
+            bool dtz = extension == ".rtbz";
+            if (!dtz && extension != ".rtbw") continue;
+
+            string code = name.substr(0, name.size() - 5);
+            int counts[2][PIECE_TYPE_NB], pieceCount;
+            if (!parseTableName(code, counts, pieceCount)) continue;
+            uint64_t key = materialKey(counts, false);
+            auto& byKey = dtz ? dtzTables : wdlTables;
+            if (byKey.count(key)) continue; // the first directory listed wins
+
+            unique_ptr<Table> t(new Table());
+            t->path = dir + "/" + name;
+            t->dtz = dtz;
+            t->key = key;
+            t->key2 = materialKey(counts, true);
+            t->pieceCount = pieceCount;
+            t->hasPawns = counts[WHITE][PAWN] || counts[BLACK][PAWN];
+            for (int c = WHITE; c <= BLACK; ++c)
+                for (int type = PAWN; type < KING; ++type)
+                    if (counts[c][type] == 1) t->hasUniquePieces = true;
+            // with pawns on both sides the side with fewer pawns leads (it compresses better)
+            bool whiteLeads = !counts[BLACK][PAWN]
+                              || (counts[WHITE][PAWN] && counts[BLACK][PAWN] >= counts[WHITE][PAWN]);
+            t->pawnCount[0] = counts[whiteLeads ? WHITE : BLACK][PAWN];
+            t->pawnCount[1] = counts[whiteLeads ? BLACK : WHITE][PAWN];
+
+            byKey[t->key] = t.get();
+            byKey[t->key2] = t.get();
+            if (!dtz)
+            {
+                wdlCount++;
+                largest = max(largest, pieceCount);
+            }
+            tables.push_back(move(t));
+        }
+        closedir(listing);
+    }
+    return wdlCount;
+}
+
+bool Tablebases::covers(const Position& pos) const
+{
+    return largest && !pos.castlingRights && __builtin_popcountll(pos.occupied) <= largest;
+}
+
+void Tablebases::addStats(uint64_t probes, uint64_t hits)
+{
+    probeCount += probes;
+    hitCount += hits;
+}
+
+// the table for this material, mapped on first use; nullptr if missing or unreadable
+const Tablebases::Table* Tablebases::mappedTable(const Position& pos, bool dtz) const
+{
+    const auto& byKey = dtz ? dtzTables : wdlTables;
+    auto found = byKey.find(materialKey(pos));
+    if (found == byKey.end()) return nullptr;
+    Table& t = *found->second;
+
+    if (!t.ready.load(memory_order_acquire))
+    {
+        lock_guard<mutex> lock(mapMutex);
+        if (!t.ready.load(memory_order_relaxed))
+        {
+            // a valid file is the magic, the tables, and a 64-byte aligned tail plus 16 bytes
+            const uint8_t* magic = dtz ? dtzMagic : wdlMagic;
+            // (any header or section that does not fit leaves the table unusable)
+            t.usable = t.file.open(t.path) && t.file.size() % 64 == 16 && memcmp(t.file.data(), magic, 4) == 0
+                       && setupTable(t, (const uint8_t*)t.file.data() + 4);
+            if (!t.usable) t.file.close();
+            t.ready.store(true, memory_order_release);
+        }
+    }
+    return t.usable ? &t : nullptr;
+}
+
+// Looks the position up in its WDL or DTZ table. For DTZ, wdl is the known result,
+// needed to decode the stored value, and state turns CHANGE_STM if the table only
+// holds the other side to move.
+int Tablebases::probeTable(const Position& pos, bool dtz, int wdl, int& state) const
+{
+    if (__builtin_popcountll(pos.occupied) == 2) return WDL_DRAW; // bare kings
+    const Table* entry = mappedTable(pos, dtz);
+    if (!entry)
+    {
+        state = PROBE_FAIL;
+        return 0;
+    }
+
+    int squares[MAX_TABLEBASE_PIECES], pieces[MAX_TABLEBASE_PIECES];
+    int size = 0, leadPawnsCnt = 0, tbFile = 0;
+    Bitboard leadPawns = 0;
+    int stmSide = pos.whiteToMove ? WHITE : BLACK;
+
+    // Tables are stored with the name's first side as white, and symmetric ones only
+    // with white to move; anything else is looked up with colours and ranks swapped.
+    bool symmetricBlackToMove = entry->key == entry->key2 && stmSide == BLACK;
+    bool blackStronger = materialKey(pos) != entry->key;
+    bool flip = symmetricBlackToMove || blackStronger;
+    int flipColor = flip ? 8 : 0, flipSquares = flip ? 56 : 0;
+    int stm = int(flip) ^ stmSide;
+
+    // pawn tables are split by the file of the leading pawn: the one nearest the edge, then lowest
+    if (entry->hasPawns)
+    {
+        int pc = entry->get(0, 0)->pieces[0] ^ flipColor;
+        Bitboard b = leadPawns = pos.pieces[pc >> 3][PAWN];
+        while (b) squares[size++] = popLsb(b) ^ flipSquares;
+        leadPawnsCnt = size;
+        swap(squares[0], *max_element(squares, squares + leadPawnsCnt, pawnsBefore));
+        tbFile = edgeDistance(fileOf(squares[0]));
+    }
+
+    // one-sided DTZ tables: the caller has to go one ply deeper
+    if (dtz)
+    {
+        int flags = entry->get(stm, tbFile)->flags;
+        if ((flags & FLAG_STM) != stm && !(entry->key == entry->key2 && !entry->hasPawns))
+        {
+            state = PROBE_CHANGE_STM;
+            return 0;
+        }
+    }
+
+    Bitboard b = pos.occupied ^ leadPawns;
+    while (b)
+    {
+        int sq = popLsb(b);
+        squares[size] = sq ^ flipSquares;
+        pieces[size++] = pieceCode(pos, sq) ^ flipColor;
+    }
+
+    const PairsData* d = entry->get(stm, tbFile);
+
+    // put the pieces in the table's order
+    for (int i = leadPawnsCnt; i < size - 1; ++i)
+        for (int j = i + 1; j < size; ++j)
+            if (d->pieces[i] == pieces[j])
+            {
+                swap(pieces[i], pieces[j]);
+                swap(squares[i], squares[j]);
+                break;
+            }
+
+    // mirror so the leading piece is on files a-d
+    if (fileOf(squares[0]) > 3)
+        for (int i = 0; i < size; ++i) squares[i] ^= 7;
+
+    uint64_t idx;
+    if (entry->hasPawns)
+    {
+        idx = leadPawnIdx[leadPawnsCnt][squares[0]];
+        stable_sort(squares + 1, squares + leadPawnsCnt, pawnsBefore);
+        for (int i = 1; i < leadPawnsCnt; ++i) idx += binomial[i][mapPawns[squares[i]]];
+    }
+    else
+    {
+        // without pawns also mirror to ranks 1-4, then below the a1-h8 diagonal
+        if (rankOf(squares[0]) > 3)
+            for (int i = 0; i < size; ++i) squares[i] ^= 56;
+        for (int i = 0; i < d->groupLen[0]; ++i)
+        {
+            if (!offDiagonal(squares[i])) continue;
+            if (offDiagonal(squares[i]) > 0)
+                for (int j = i; j < size; ++j) squares[j] = ((squares[j] >> 3) | (squares[j] << 3)) & 63;
+            break;
+        }
+
+        if (entry->hasUniquePieces)
+        {
+            // three unique pieces (kings included) are numbered together, skipping
+            // occupied squares; the diagonal cases come after the below-diagonal ones
+            int adjust1 = squares[1] > squares[0];
+            int adjust2 = (squares[2] > squares[0]) + (squares[2] > squares[1]);
+            if (offDiagonal(squares[0]))
+                idx = (uint64_t(mapA1D1D4[squares[0]]) * 63 + (squares[1] - adjust1)) * 62 + squares[2] - adjust2;
+            else if (offDiagonal(squares[1]))
+                idx = (6 * 63 + rankOf(squares[0]) * 28 + mapB1H1H7[squares[1]]) * 62 + squares[2] - adjust2;
+            else if (offDiagonal(squares[2]))
+                idx = 6 * 63 * 62 + 4 * 28 * 62 + rankOf(squares[0]) * 7 * 28
+                      + (rankOf(squares[1]) - adjust1) * 28 + mapB1H1H7[squares[2]];
+            else
+                idx = 6 * 63 * 62 + 4 * 28 * 62 + 4 * 7 * 28 + rankOf(squares[0]) * 7 * 6
+                      + (rankOf(squares[1]) - adjust1) * 6 + (rankOf(squares[2]) - adjust2);
+        }
+        else idx = mapKK[mapA1D1D4[squares[0]]][squares[1]];
+    }
+
+    // every further group: a combination of squares, each shifted down past the squares
+    // of the earlier groups (pawns also skip ranks 1 and 8)
+    idx *= d->groupIdx[0];
+    int* groupSq = squares + d->groupLen[0];
+    bool remainingPawns = entry->hasPawns && entry->pawnCount[1];
+    for (int next = 1; d->groupLen[next]; ++next)
+    {
+        stable_sort(groupSq, groupSq + d->groupLen[next]);
+        uint64_t n = 0;
+        for (int i = 0; i < d->groupLen[next]; ++i)
+        {
+            int adjust = int(count_if(squares, groupSq, [&](int sq) { return groupSq[i] > sq; }));
+            n += binomial[i + 1][groupSq[i] - adjust - 8 * remainingPawns];
+        }
+        remainingPawns = false;
+        idx += n * d->groupIdx[next];
+        groupSq += d->groupLen[next];
+    }
+
+    int value = decompressPairs(d, idx);
+    if (value < 0 || (!dtz && value > 4))
+    {
+        state = PROBE_FAIL;
+        return 0;
+    }
+    if (!dtz) return value - 2;
+
+    // DTZ values may go through a per-result map and may be stored in full moves
+    const PairsData* first = entry->get(0, tbFile);
+    static const int wdlMap[] = { 1, 3, 0, 2, 0 };
+    if (first->flags & FLAG_MAPPED)
+    {
+        size_t at = size_t(first->mapIdx[wdlMap[wdl + 2]]) + value;
+        if ((first->flags & FLAG_WIDE ? 2 * at + 2 : at + 1) > entry->mapSize)
+        {
+            state = PROBE_FAIL;
+            return 0;
+        }
+        value = first->flags & FLAG_WIDE ? get16(entry->map + 2 * at) : entry->map[at];
+    }
+    if ((wdl == WDL_WIN && !(first->flags & FLAG_WIN_PLIES)) || (wdl == WDL_LOSS && !(first->flags & FLAG_LOSS_PLIES))
+        || wdl == WDL_CURSED_WIN || wdl == WDL_BLESSED_LOSS)
+        value *= 2;
+    return value + 1;
+}
+
+static bool isCaptureMove(const Position& pos, Move m)
+{
+    return moveKind(m) == EN_PASSANT || (pos.occupied & squareBB(moveTo(m)));
+}
+
+static bool isPawnMove(const Position& pos, Move m)
+{
+    return pos.pieces[pos.whiteToMove ? WHITE : BLACK][PAWN] & squareBB(moveFrom(m));
+}
+
+// The tables store "don't care" values where a capture (or, for DTZ, any zeroing move)
+// decides the result, so the captures are resolved by search and combined with the
+// stored value. State becomes ZEROING_BEST_MOVE when the best result needs such a move.
+int Tablebases::searchCaptures(Position& pos, bool zeroingMoves, int& state) const
+{
+    int best = WDL_LOSS, value;
+    MoveList list;
+    generateLegalMoves(pos, list);
+    int tried = 0;
+    for (int i = 0; i < list.count; ++i)
+    {
+        Move m = list.moves[i];
+        if (!isCaptureMove(pos, m) && (!zeroingMoves || !isPawnMove(pos, m))) continue;
+        tried++;
+        makeMove(pos, m);
+        value = -searchCaptures(pos, false, state);
+        unmakeMove(pos);
+        if (state == PROBE_FAIL) return WDL_DRAW;
+        if (value > best)
+        {
+            best = value;
+            if (value >= WDL_WIN)
+            {
+                state = PROBE_ZEROING_BEST_MOVE;
+                return value;
+            }
+        }
+    }
+
+    // with every legal move a capture the table need not be (and is not always) right
+    bool noMoreMoves = tried && tried == list.count;
+    if (noMoreMoves) value = best;
+    else
+    {
+        value = probeTable(pos, false, WDL_DRAW, state);
+        if (state == PROBE_FAIL) return WDL_DRAW;
+    }
+
+    if (best >= value)
+    {
+        state = best > WDL_DRAW || noMoreMoves ? PROBE_ZEROING_BEST_MOVE : PROBE_OK;
+        return best;
+    }
+    state = PROBE_OK;
+    return value;
+}
+
+// DTZ of the move before a zeroing move that reaches this result
+static int dtzBeforeZeroing(int wdl)
+{
+    return wdl == WDL_WIN ? 1 : wdl == WDL_CURSED_WIN ? 101 : wdl == WDL_BLESSED_LOSS ? -101 : wdl == WDL_LOSS ? -1 : 0;
+}
+
+static int signOf(int x) { return (x > 0) - (x < 0); }
+
+int Tablebases::probeDtzState(Position& pos, int& state) const
+{
+    state = PROBE_OK;
+    int wdl = searchCaptures(pos, true, state);
+    if (state == PROBE_FAIL || wdl == WDL_DRAW) return 0;
+    if (state == PROBE_ZEROING_BEST_MOVE) return dtzBeforeZeroing(wdl);
+
+    int dtz = probeTable(pos, true, wdl, state);
+    if (state == PROBE_FAIL) return 0;
+    if (state != PROBE_CHANGE_STM)
+        return (dtz + 100 * (wdl == WDL_BLESSED_LOSS || wdl == WDL_CURSED_WIN)) * signOf(wdl);
+
+    // the table holds the other side to move: best DTZ over a one-ply search
+    int minDtz = 0xFFFF;
+    MoveList list;
+    generateLegalMoves(pos, list);
+    for (int i = 0; i < list.count; ++i)
+    {
+        Move m = list.moves[i];
+        bool zeroing = isCaptureMove(pos, m) || isPawnMove(pos, m);
+        makeMove(pos, m);
+        if (zeroing)
+        {
+            state = PROBE_OK;
+            dtz = -dtzBeforeZeroing(searchCaptures(pos, false, state));
+        }
+        else dtz = -probeDtzState(pos, state);
+
+        if (dtz == 1 && isKingInCheck(pos, pos.whiteToMove))
+        {
+            MoveList replies;
+            generateLegalMoves(pos, replies);
+            if (replies.count == 0) minDtz = 1; // mate
+        }
+        if (!zeroing) dtz += signOf(dtz);
+        if (dtz < minDtz && signOf(dtz) == signOf(wdl)) minDtz = dtz;
+        unmakeMove(pos);
+        if (state == PROBE_FAIL) return 0;
+    }
+    return minDtz == 0xFFFF ? -1 : minDtz;
+}
+
+bool Tablebases::probeWdl(Position& pos, int& wdl) const
+{
+    if (!covers(pos)) return false;
+    int state = PROBE_OK;
+    wdl = searchCaptures(pos, false, state);
+    return state != PROBE_FAIL;
+}
+
+bool Tablebases::probeDtz(Position& pos, int& dtz) const
+{
+    if (!covers(pos)) return false;
+    int state = PROBE_OK;
+    dtz = probeDtzState(pos, state);
+    return state != PROBE_FAIL;
+}
+
+bool Tablebases::filterRootMoves(Position& pos, MoveList& moves, int& wdl) const
+{
+    if (!covers(pos) || moves.count == 0) return false;
+    int halfmoves = pos.halfmoveClock;
+    bool repeated = repetitionCount(pos) > 0;
+    int ranks[256];
+    int bestRank = -MAX_DTZ - 1;
+    for (int i = 0; i < moves.count; ++i)
+    {
+        int state = PROBE_OK, dtz;
+        makeMove(pos, moves.moves[i]);
+        if (pos.halfmoveClock == 0)
+        {
+            // after a zeroing move only the result matters
+            int childWdl = searchCaptures(pos, false, state);
+            dtz = dtzBeforeZeroing(-childWdl);
+        }
+        else if (pos.halfmoveClock >= 100 || repetitionCount(pos) >= 2)
+            dtz = 0;
+        else
+        {
+            dtz = -probeDtzState(pos, state);
+            dtz = dtz > 0 ? dtz + 1 : dtz < 0 ? dtz - 1 : 0;
+        }
+        if (dtz == 2 && isKingInCheck(pos, pos.whiteToMove))
+        {
+            MoveList replies;
+            generateLegalMoves(pos, replies);
+            if (replies.count == 0) dtz = 1;
+        }
+        unmakeMove(pos);
+        if (state == PROBE_FAIL) return false;
+
+        // wins that the 50-move counter cannot spoil rank equal; otherwise shorter is better,
+        // and losses that might still be saved by the counter rank above certain ones
+        ranks[i] = dtz > 0 ? (dtz + halfmoves <= 99 && !repeated ? MAX_DTZ : MAX_DTZ - (dtz + halfmoves))
+                 : dtz < 0 ? (-dtz * 2 + halfmoves < 100 ? -MAX_DTZ : -MAX_DTZ + (-dtz + halfmoves))
+                 : 0;
+        bestRank = max(bestRank, ranks[i]);
+    }
+
+    int kept = 0;
+    for (int i = 0; i < moves.count; ++i)
+        if (ranks[i] == bestRank) moves.moves[kept++] = moves.moves[i];
+    moves.count = kept;
+
+    int bound = MAX_DTZ - 100;
+    wdl = bestRank >= bound ? WDL_WIN : bestRank > 0 ? WDL_CURSED_WIN : bestRank == 0 ? WDL_DRAW
+        : bestRank > -bound ? WDL_BLESSED_LOSS : WDL_LOSS;
+    return true;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "movegen.h"
+#include "position.h"
+
+// Syzygy endgame tablebases: ".rtbw" files hold win/draw/loss for every position of a
+// material signature, ".rtbz" files the distance (in plies) to the next capture or pawn
+// move on the way to that result.
+//
+// init() only lists the files; a table is memory-mapped and its header parsed the first
+// time a position with its material is probed, so startup stays instant and only the
+// endgames actually reached cost address space. Probing is thread-safe.
+//
+// Results are from the side to move's view. "Cursed" wins and "blessed" losses are
+// decisive on the board but drawn under the 50-move rule. Positions with castling
+// rights are not covered.
+
+enum TablebaseWdl { WDL_LOSS = -2, WDL_BLESSED_LOSS = -1, WDL_DRAW = 0, WDL_CURSED_WIN = 1, WDL_WIN = 2 };
+
+const int MAX_TABLEBASE_PIECES = 7;
+
+class Tablebases
+{
+public:
+    Tablebases();
+    ~Tablebases();
+    Tablebases(const Tablebases&) = delete;
+    Tablebases& operator=(const Tablebases&) = delete;
+
+    // looks for table files in the given directories (separated by ':'), replacing any
+    // earlier set; returns the number of WDL tables found
+    int init(const std::string& paths);
+    int tableCount() const { return wdlCount; }
+    // most pieces (kings included) of any table found, 0 without tables
+    int maxPieces() const { return largest; }
+    // few enough pieces for the tables found, and no castling rights
+    bool covers(const Position& pos) const;
+
+    // pos is used as scratch space (captures are tried) and restored on return.
+    // All return false if a needed table is missing or unreadable.
+    bool probeWdl(Position& pos, int& wdl) const;
+    // signed plies to the next zeroing move under best play: positive when winning,
+    // beyond +-100 for cursed wins / blessed losses, 0 for draws
+    bool probeDtz(Position& pos, int& dtz) const;
+    // Keeps only the moves that reach the best outcome, taking the 50-move counter and
+    // repetitions into account (all wins rank equal while the win cannot slip away, then
+    // the lowest DTZ first). wdl receives the root result.
+    bool filterRootMoves(Position& pos, MoveList& moves, int& wdl) const;
+
+    // searches report their counts once finished, as with the transposition table
+    void addStats(uint64_t probes, uint64_t hits);
+    uint64_t probes() const { return probeCount.load(); }
+    uint64_t hits() const { return hitCount.load(); }
+    double hitRate() const { return probes() ? double(hits()) / probes() : 0.0; }
+
+    struct Table;
+
+private:
+    const Table* mappedTable(const Position& pos, bool dtz) const;
+    int probeTable(const Position& pos, bool dtz, int wdl, int& state) const;
+    int searchCaptures(Position& pos, bool zeroingMoves, int& state) const;
+    int probeDtzState(Position& pos, int& state) const;
+
+    std::vector<std::unique_ptr<Table>> tables;
+    std::unordered_map<uint64_t, Table*> wdlTables; // by material key, both colourings
+    std::unordered_map<uint64_t, Table*> dtzTables;
+    int wdlCount = 0;
+    int largest = 0;
+    mutable std::mutex mapMutex;
+
+    std::atomic<uint64_t> probeCount{0};
+    std::atomic<uint64_t> hitCount{0};
+};
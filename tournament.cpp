@@ -0,0 +1,489 @@
+#include "tournament.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <random>
+#include <sstream>
+#include <thread>
+#include "gamefile.h"
+#include "movegen.h"
+#include "nnue.h"
+#include "pgn.h"
+#include "rules.h"
+#include "tt.h"
+
+using namespace std;
+
+// ---- statistics ----
+
+static double eloFromScore(double score)
+{
+    score = min(max(score, 1e-6), 1 - 1e-6);
+    return 400 * log10(score / (1 - score));
+}
+
+static double scoreFromElo(double elo) { return 1 / (1 + pow(10.0, -elo / 400)); }
+
+// mean score per game and its per-game variance
+static void scoreMoments(const MatchScore& m, double& mean, double& variance)
+{
+    double n = double(m.games());
+    mean = (m.wins + 0.5 * m.draws) / n;
+    variance = (m.wins * (1 - mean) * (1 - mean) + m.draws * (0.5 - mean) * (0.5 - mean) +
+                m.losses * mean * mean) / n;
+}
+
+double eloDifference(const MatchScore& score)
+{
+    if (score.games() == 0) return 0;
+    double mean, variance;
+    scoreMoments(score, mean, variance);
+    return eloFromScore(mean);
+}
+
+double eloMargin(const MatchScore& score)
+{
+    if (score.games() < 2) return 0;
+    double mean, variance;
+    scoreMoments(score, mean, variance);
+    double deviation = 1.959964 * sqrt(variance / score.games());
+    return (eloFromScore(mean + deviation) - eloFromScore(mean - deviation)) / 2;
+}
+
+double likelihoodOfSuperiority(const MatchScore& score)
+{
+    double decisive = double(score.wins + score.losses);
+    if (decisive == 0) return 0.5;
+    return 0.5 * (1 + erf((double(score.wins) - double(score.losses)) / sqrt(2 * decisive)));
+}
+
+double sprtLogLikelihoodRatio(const MatchScore& score, double elo0, double elo1)
+{
+    if (score.games() == 0) return 0;
+    // half a game of each outcome keeps the variance above zero while one side has won
+    // everything so far; it fades out as games come in
+    double n = score.games() + 1.5;
+    double mean = (score.wins + 0.5 + 0.5 * (score.draws + 0.5)) / n;
+    double variance = ((score.wins + 0.5) * (1 - mean) * (1 - mean) + (score.draws + 0.5) * (0.5 - mean) * (0.5 - mean) +
+                       (score.losses + 0.5) * mean * mean) / n;
+    double s0 = scoreFromElo(elo0), s1 = scoreFromElo(elo1);
+    return n * (s1 - s0) * (2 * mean - s0 - s1) / (2 * variance);
+}
+
+// ---- opening suite ----
+
+bool readOpeningSuite(const string& path, vector<string>& fens, int* rejected)
+{
+    ifstream in(path);
+    if (!in) return false;
+    int bad = 0;
+    unique_ptr<Position> pos(new Position());
+    string line;
+    while (getline(in, line))
+    {
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == string::npos || line[first] == '#') continue;
+        // setFromFen reads the four position fields and drops anything after them that
+        // is not a pair of move counters, so EPD operations fall away
+        if (!setFromFen(*pos, line)) { bad++; continue; }
+        fens.push_back(toFen(*pos));
+    }
+    if (rejected) *rejected = bad;
+    return true;
+}
+
+// ---- work-stealing scheduler ----
+
+// A worker's own deque: it pops the back, thieves take the front (the games it would
+// have reached last). Each sits on its own cache line so workers do not contend on
+// each other's locks when they are not stealing.
+struct alignas(64) TaskQueue
+{
+    mutex lock;
+    deque<uint64_t> tasks;
+};
+
+class WorkStealingPool
+{
+public:
+    explicit WorkStealingPool(int workers) : queues(workers) {}
+
+    // deals tasks 0..count-1 round-robin; each worker meets its lowest task first
+    void deal(uint64_t count)
+    {
+        for (uint64_t task = count; task-- > 0;) queues[task % queues.size()].tasks.push_back(task);
+    }
+
+    // false once every deque is empty or the pool was cancelled
+    bool next(int worker, uint64_t& task, uint64_t& steals)
+    {
+        if (cancelled.load(memory_order_relaxed)) return false;
+        {
+            TaskQueue& own = queues[worker];
+            lock_guard<mutex> guard(own.lock);
+            if (!own.tasks.empty())
+            {
+                task = own.tasks.back();
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        // no task is ever added after the deal, so one empty sweep means the work is gone
+        for (size_t k = 1; k < queues.size(); ++k)
+        {
+            TaskQueue& victim = queues[(worker + k) % queues.size()];
+            lock_guard<mutex> guard(victim.lock);
+            if (!victim.tasks.empty())
+            {
+                task = victim.tasks.front();
+                victim.tasks.pop_front();
+                steals++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void cancel() { cancelled = true; }
+
+private:
+    vector<TaskQueue> queues;
+    atomic<bool> cancelled{false};
+};
+
+// ---- games ----
+
+enum Termination { END_CHECKMATE, END_STALEMATE, END_REPETITION, END_FIFTY_MOVES, END_MATERIAL, END_PLY_CAP,
+                   END_NO_MOVE, END_COUNT };
+static const char* terminationNames[END_COUNT] = { "checkmate", "stalemate", "repetition", "fifty-moves",
+                                                   "material", "ply cap", "no move" };
+
+struct Player
+{
+    const PlayerConfig* config;
+    const NnueNetwork* network; // nullptr: piece-square evaluation
+};
+
+struct PlayedGame
+{
+    uint64_t index = 0;
+    bool firstIsWhite = true;
+    int termination = END_NO_MOVE;
+    uint64_t nodes = 0;
+    GameRecord record;
+};
+
+// per worker: its engines' hash tables, a scratch position and its share of the figures
+struct Worker
+{
+    TranspositionTable tt[2];
+    bool useTT = false;
+    unique_ptr<Position> pos{new Position()};
+    uint64_t games = 0, plies = 0, nodes = 0, steals = 0;
+    double busySeconds = 0, finishedAt = 0;
+};
+
+static void playGame(Worker& w, const Player players[2], int maxPlies, PlayedGame& game)
+{
+    Position& pos = *w.pos;
+    startPosition(game.record, pos);
+    if (w.useTT)
+    {
+        w.tt[0].clear();
+        w.tt[1].clear();
+    }
+
+    int result = RESULT_UNKNOWN;
+    for (int ply = 0;; ++ply)
+    {
+        bool white = pos.whiteToMove;
+        int end = -1;
+        if (isCheckmate(pos, white)) end = END_CHECKMATE;
+        else if (isStalemate(pos, white)) end = END_STALEMATE;
+        else if (pos.halfmoveClock >= 100) end = END_FIFTY_MOVES;
+        else if (repetitionCount(pos) >= 2) end = END_REPETITION;
+        else if (isInsufficientMaterial(pos)) end = END_MATERIAL;
+        else if (ply >= maxPlies) end = END_PLY_CAP;
+        if (end >= 0)
+        {
+            game.termination = end;
+            if (end == END_CHECKMATE) result = white ? RESULT_BLACK_WINS : RESULT_WHITE_WINS;
+            else result = RESULT_DRAW;
+            break;
+        }
+
+        int side = white == game.firstIsWhite ? 0 : 1;
+        // the accumulators are rebuilt only when the side to move uses another network
+        if (pos.network != players[side].network) attachNetwork(pos, players[side].network);
+        SearchResult r = search(pos, players[side].config->limits, nullptr, nullptr,
+                                w.useTT ? &w.tt[side] : nullptr);
+        game.nodes += r.nodes;
+        if (r.bestMove == NO_MOVE)
+        {
+            game.termination = END_NO_MOVE;
+            break;
+        }
+        makeMove(pos, r.bestMove);
+        game.record.moves.push_back(r.bestMove);
+    }
+    game.record.result = result;
+}
+
+// the FEN after plies random legal moves from the start position, the same for every call
+// with the same pair; a line that runs into a finished game is drawn again
+static string randomOpening(Position& pos, uint64_t pair, int plies)
+{
+    mt19937_64 random(pair);
+    MoveList list;
+    for (;;)
+    {
+        setFromFen(pos, "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+        int ply = 0;
+        for (; ply < plies; ++ply)
+        {
+            generateLegalMoves(pos, list);
+            if (list.count == 0) break;
+            makeMove(pos, list.moves[random() % list.count]);
+        }
+        generateLegalMoves(pos, list);
+        if (ply == plies && list.count > 0) return toFen(pos);
+    }
+}
+
+static string describePlayer(const PlayerConfig& p)
+{
+    string text;
+    if (p.limits.depth) text += "depth " + to_string(p.limits.depth) + ", ";
+    if (p.limits.nodes) text += "nodes " + to_string(p.limits.nodes) + ", ";
+    if (p.limits.movetimeMs) text += to_string(p.limits.movetimeMs) + " ms, ";
+    return text + (p.nnuePath.empty() ? string("psqt") : p.nnuePath.substr(p.nnuePath.find_last_of('/') + 1));
+}
+
+// ---- output ----
+
+static string pgnText(const PlayedGame& game, const string& white, const string& black)
+{
+    ostringstream s;
+    const char* result = resultText(game.record.result);
+    s << "[Event \"Self-play\"]\n[Site \"chess-cli\"]\n[Round \"" << game.index + 1 << "\"]\n"
+      << "[White \"" << white << "\"]\n[Black \"" << black << "\"]\n[Result \"" << result << "\"]\n";
+    if (!game.record.startFen.empty()) s << "[SetUp \"1\"]\n[FEN \"" << game.record.startFen << "\"]\n";
+    s << "[PlyCount \"" << game.record.moves.size() << "\"]\n"
+      << "[Termination \"" << (game.termination == END_PLY_CAP ? "adjudication" : "normal") << "\"]\n\n";
+
+    unique_ptr<Position> pos(new Position());
+    startPosition(game.record, *pos);
+    string line;
+    auto emit = [&](const string& token) {
+        if (!line.empty() && line.size() + 1 + token.size() > 79)
+        {
+            s << line << "\n";
+            line.clear();
+        }
+        line += (line.empty() ? "" : " ") + token;
+    };
+    bool first = true;
+    for (Move m : game.record.moves)
+    {
+        if (pos->whiteToMove) emit(to_string(pos->fullmoveNumber) + ".");
+        else if (first) emit(to_string(pos->fullmoveNumber) + "...");
+        emit(moveToSan(*pos, m));
+        makeMove(*pos, m);
+        first = false;
+    }
+    emit("{" + string(terminationNames[game.termination]) + "}");
+    emit(result);
+    s << line << "\n\n";
+    return s.str();
+}
+
+// ---- the match ----
+
+int runTournament(const TournamentOptions& options, ostream& out)
+{
+    const PlayerConfig* configs[2] = { &options.first, &options.second };
+    NnueNetwork networks[2];
+    Player players[2];
+    string names[2];
+    for (int i = 0; i < 2; ++i)
+    {
+        const SearchLimits& l = configs[i]->limits;
+        if (!l.depth && !l.nodes && !l.movetimeMs)
+        {
+            out << "engine " << char('A' + i) << " needs a depth, node or time limit per move\n";
+            return 1;
+        }
+        if (!configs[i]->nnuePath.empty() && !networks[i].load(configs[i]->nnuePath))
+        {
+            out << "cannot load network " << configs[i]->nnuePath << "\n";
+            return 1;
+        }
+        players[i] = { configs[i], networks[i].isLoaded() ? &networks[i] : nullptr };
+        names[i] = configs[i]->name.empty() ? string(1, char('A' + i)) + " (" + describePlayer(*configs[i]) + ")"
+                                            : configs[i]->name;
+    }
+
+    GameWriter cgf;
+    ofstream pgn;
+    if (options.outputFormat == MATCH_OUTPUT_CGF && !cgf.open(options.outputPath))
+    {
+        out << "cannot write " << options.outputPath << "\n";
+        return 1;
+    }
+    if (options.outputFormat == MATCH_OUTPUT_PGN)
+    {
+        pgn.open(options.outputPath);
+        if (!pgn)
+        {
+            out << "cannot write " << options.outputPath << "\n";
+            return 1;
+        }
+    }
+
+    uint64_t total = (max<uint64_t>(options.games, 1) + 1) / 2 * 2;
+    int workerCount = max(1, options.workers);
+    // the search plays its own moves on top of the game's history
+    int maxPlies = min(max(options.maxPlies, 1), MAX_GAME_PLY - MAX_PLY - 1);
+    bool timed = options.first.limits.movetimeMs || options.second.limits.movetimeMs;
+    if (options.openings.empty() && options.randomPlies <= 0 && total > 2 && !timed)
+        out << "warning: without openings or random plies every pair of games repeats the first\n";
+    uint64_t reportEvery = options.reportEvery ? options.reportEvery : max<uint64_t>(total / 10, 1);
+    double lowerBound = log(options.beta / (1 - options.alpha));
+    double upperBound = log((1 - options.beta) / options.alpha);
+
+    // results are tallied and written in completion order under one lock; a game takes
+    // far longer than its bookkeeping, so the lock is never contended for long
+    mutex resultLock;
+    MatchScore score;
+    uint64_t endings[END_COUNT] = {};
+    uint64_t finished = 0, unfinished = 0;
+    bool outputFailed = false;
+    int verdict = 0; // SPRT: 1 = elo1 accepted, -1 = elo0 accepted
+
+    auto record = [&](const PlayedGame& game) {
+        lock_guard<mutex> guard(resultLock);
+        finished++;
+        endings[game.termination]++;
+        int r = game.record.result;
+        if (r == RESULT_UNKNOWN) unfinished++;
+        else if (r == RESULT_DRAW) score.draws++;
+        else if ((r == RESULT_WHITE_WINS) == game.firstIsWhite) score.wins++;
+        else score.losses++;
+
+        if (options.outputFormat == MATCH_OUTPUT_CGF && !cgf.add(game.record)) outputFailed = true;
+        if (options.outputFormat == MATCH_OUTPUT_PGN)
+        {
+            pgn << pgnText(game, names[game.firstIsWhite ? 0 : 1], names[game.firstIsWhite ? 1 : 0]) << flush;
+            if (!pgn) outputFailed = true;
+        }
+
+        double llr = sprtLogLikelihoodRatio(score, options.elo0, options.elo1);
+        if (options.sprt && !verdict && (llr >= upperBound || llr <= lowerBound))
+            verdict = llr >= upperBound ? 1 : -1;
+        if (finished % reportEvery == 0 || verdict)
+        {
+            char line[160];
+            snprintf(line, sizeof(line), "%8llu of %llu  +%llu =%llu -%llu  Elo %+.1f +/- %.1f  LLR %+.2f",
+                     (unsigned long long)finished, (unsigned long long)total, (unsigned long long)score.wins,
+                     (unsigned long long)score.draws, (unsigned long long)score.losses, eloDifference(score),
+                     eloMargin(score), llr);
+            out << line << "\n" << flush;
+        }
+        return verdict != 0;
+    };
+
+    WorkStealingPool pool(workerCount);
+    pool.deal(total);
+    vector<unique_ptr<Worker>> workers;
+    for (int i = 0; i < workerCount; ++i) workers.emplace_back(new Worker());
+
+    auto started = chrono::steady_clock::now();
+    auto secondsSince = [](chrono::steady_clock::time_point t) {
+        return chrono::duration<double>(chrono::steady_clock::now() - t).count();
+    };
+    auto runWorker = [&](int id) {
+        Worker& w = *workers[id];
+        // the worker touches its own tables first, so they land in its memory
+        w.useTT = options.hashMb > 0 && w.tt[0].resize(options.hashMb) && w.tt[1].resize(options.hashMb);
+        uint64_t task;
+        while (pool.next(id, task, w.steals))
+        {
+            auto gameStart = chrono::steady_clock::now();
+            PlayedGame game;
+            game.index = task;
+            game.firstIsWhite = task % 2 == 0;
+            if (!options.openings.empty()) game.record.startFen = options.openings[task / 2 % options.openings.size()];
+            else if (options.randomPlies > 0) game.record.startFen = randomOpening(*w.pos, task / 2, options.randomPlies);
+            playGame(w, players, maxPlies, game);
+            w.busySeconds += secondsSince(gameStart);
+            w.games++;
+            w.plies += game.record.moves.size();
+            w.nodes += game.nodes;
+            // the games in flight when the test decides still finish and count
+            if (record(game)) pool.cancel();
+        }
+        w.finishedAt = secondsSince(started);
+    };
+    vector<thread> threads;
+    for (int i = 0; i < workerCount; ++i) threads.emplace_back(runWorker, i);
+    for (thread& t : threads) t.join();
+    double seconds = secondsSince(started);
+    if (options.outputFormat == MATCH_OUTPUT_CGF && !cgf.close()) outputFailed = true;
+
+    uint64_t plies = 0, nodes = 0, steals = 0, fewest = UINT64_MAX, most = 0;
+    double busy = 0, tailIdle = 0;
+    for (const auto& w : workers)
+    {
+        plies += w->plies;
+        nodes += w->nodes;
+        steals += w->steals;
+        busy += w->busySeconds;
+        tailIdle += seconds - w->finishedAt;
+        fewest = min(fewest, w->games);
+        most = max(most, w->games);
+    }
+    double idle = max(0.0, seconds * workerCount - busy);
+
+    char buffer[256];
+    out << "Match:    " << names[0] << " vs " << names[1] << ", " << finished << " of " << total << " games"
+        << (!options.openings.empty() ? ", " + to_string(options.openings.size()) + " openings with colours reversed"
+            : options.randomPlies > 0 ? ", " + to_string(options.randomPlies) + " random plies per pair, colours reversed"
+                                      : string(" from the start position"))
+        << (finished < total ? ", stopped by SPRT" : "") << "\n";
+    snprintf(buffer, sizeof(buffer), "+%llu =%llu -%llu (%.1f%%)", (unsigned long long)score.wins,
+             (unsigned long long)score.draws, (unsigned long long)score.losses,
+             score.games() ? 100.0 * (score.wins + 0.5 * score.draws) / score.games() : 0.0);
+    out << "Score:    " << buffer << (unfinished ? ", " + to_string(unfinished) + " unfinished" : string()) << "\n";
+    snprintf(buffer, sizeof(buffer), "%+.1f +/- %.1f (95%%), LOS %.1f%%", eloDifference(score), eloMargin(score),
+             100 * likelihoodOfSuperiority(score));
+    out << "Elo:      " << buffer << "\n";
+    snprintf(buffer, sizeof(buffer), "LLR %+.2f in [%.2f, %.2f] for elo0 %g, elo1 %g (alpha %g, beta %g)",
+             sprtLogLikelihoodRatio(score, options.elo0, options.elo1), lowerBound, upperBound, options.elo0,
+             options.elo1, options.alpha, options.beta);
+    out << "SPRT:     " << buffer
+        << (verdict > 0 ? ": H1 accepted" : verdict < 0 ? ": H0 accepted" : options.sprt ? ": undecided" : "") << "\n";
+    out << "Endings:  ";
+    for (int e = 0, shown = 0; e < END_COUNT; ++e)
+        if (endings[e]) out << (shown++ ? ", " : "") << terminationNames[e] << " " << endings[e];
+    out << "\n";
+    snprintf(buffer, sizeof(buffer), "%.1f plies/game, %.0f nodes/move", finished ? double(plies) / finished : 0.0,
+             plies ? double(nodes) / plies : 0.0);
+    out << "Length:   " << buffer << "\n";
+    snprintf(buffer, sizeof(buffer), "%.1f s, %.0f games/hour per core over %d workers, %.0f plies/s", seconds,
+             seconds > 0 ? finished * 3600.0 / seconds / workerCount : 0.0, workerCount,
+             seconds > 0 ? plies / seconds : 0.0);
+    out << "Rate:     " << buffer << "\n";
+    snprintf(buffer, sizeof(buffer), "%.1f%% of worker time (%.2f s, %.2f s of it waiting for the last games), "
+             "%llu steals, %llu-%llu games per worker", seconds > 0 ? 100 * idle / (seconds * workerCount) : 0.0,
+             idle, tailIdle, (unsigned long long)steals, (unsigned long long)fewest, (unsigned long long)most);
+    out << "Idle:     " << buffer << "\n";
+    if (outputFailed) out << "writing " << options.outputPath << " failed\n";
+    return outputFailed ? 1 : 0;
+}
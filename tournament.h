@@ -0,0 +1,79 @@
+#pragma once
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include "search.h"
+
+// Self-play match: engine A (the candidate) against engine B (the baseline), every
+// opening played twice with colours reversed, on all cores.
+//
+// Games are the scheduler's tasks. Each worker owns a deque, dealt games round-robin up
+// front; it takes from the back of its own deque and, once that is empty, steals from
+// the front of the others', so a worker that drew short games picks up the rest of a
+// slower one's share instead of waiting. A worker only ever stops when every deque is
+// empty. The time a worker spends outside games (looking for work, or done while others
+// still play) is reported as scheduler idle time.
+//
+// Games end on checkmate or stalemate (isCheckmate / isStalemate), a threefold
+// repetition, the fifty-move rule, insufficient material, or the ply cap (a draw).
+// Finished games are streamed to the output in completion order.
+
+struct PlayerConfig
+{
+    std::string name;
+    SearchLimits limits;
+    std::string nnuePath; // empty: piece-square evaluation
+};
+
+enum MatchOutput { MATCH_OUTPUT_NONE, MATCH_OUTPUT_CGF, MATCH_OUTPUT_PGN };
+
+struct TournamentOptions
+{
+    PlayerConfig first;              // A: scores and Elo are from its side
+    PlayerConfig second;             // B
+    std::vector<std::string> openings; // start FENs; empty: the standard start position
+    // without openings, each pair of games starts after this many random legal plies from
+    // the start position (seeded by the pair, so a match can be replayed); the searches are
+    // deterministic under depth and node limits, so with 0 every pair would repeat the first
+    int randomPlies = 8;
+    uint64_t games = 100;            // rounded up to a whole number of pairs
+    int workers = 1;
+    size_t hashMb = 8;               // per engine per worker
+    int maxPlies = 400;              // longer games are adjudicated a draw
+    MatchOutput outputFormat = MATCH_OUTPUT_NONE;
+    std::string outputPath;
+    // sequential probability ratio test: elo1 against elo0; the match stops when it decides
+    bool sprt = false;
+    double elo0 = 0, elo1 = 5;
+    double alpha = 0.05, beta = 0.05;
+    uint64_t reportEvery = 0;        // games between progress lines; 0: about ten lines
+};
+
+// Plays the match, printing progress lines and then the score, Elo difference with its
+// 95% margin, likelihood of superiority, SPRT state, throughput (games/hour per core)
+// and the scheduler's idle time and steals. Non-zero on bad options or output errors.
+int runTournament(const TournamentOptions& options, std::ostream& out);
+
+// one FEN per line (EPD operations after the four position fields are ignored);
+// false if the file cannot be read, bad lines are skipped and counted
+bool readOpeningSuite(const std::string& path, std::vector<std::string>& fens, int* rejected = nullptr);
+
+// ---- match statistics, from the first player's side ----
+
+struct MatchScore
+{
+    uint64_t wins = 0, draws = 0, losses = 0;
+    uint64_t games() const { return wins + draws + losses; }
+};
+
+// logistic Elo difference implied by the score, and the half-width of its 95% interval
+double eloDifference(const MatchScore& score);
+double eloMargin(const MatchScore& score);
+// probability that A is the stronger engine (normal approximation, draws ignored)
+double likelihoodOfSuperiority(const MatchScore& score);
+// generalised SPRT log-likelihood ratio of elo1 against elo0 (trinomial, normal
+// approximation, half a game of each outcome added so a clean sweep still has a
+// variance); the test accepts elo1 above log((1 - beta) / alpha) and elo0 below
+// log(beta / (1 - alpha))
+double sprtLogLikelihoodRatio(const MatchScore& score, double elo0, double elo1);
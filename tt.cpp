@@ -0,0 +1,167 @@
+#include "tt.h"
+#include <cstdlib>
+#include <cstring>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+using namespace std;
+
+// data word layout: move (0-15), score (16-31, signed), depth (32-39), bound (40-41), age (42-47)
+static uint64_t packData(Move move, int score, int depth, int bound, uint8_t age)
+{
+    return uint64_t(move)
+         | uint64_t(uint16_t(int16_t(score))) << 16
+         | uint64_t(uint8_t(depth)) << 32
+         | uint64_t(bound & 3) << 40
+         | uint64_t(age & 63) << 42;
+}
+
+static int dataDepth(uint64_t d) { return int((d >> 32) & 0xFF); }
+static int dataBound(uint64_t d) { return int((d >> 40) & 3); }
+static uint8_t dataAge(uint64_t d) { return uint8_t((d >> 42) & 63); }
+
+TranspositionTable::~TranspositionTable()
+{
+    release();
+}
+
+void TranspositionTable::release()
+{
+    if (!clusters) return;
+#ifdef __linux__
+    if (mmapped) munmap(clusters, allocatedBytes);
+    else
+#endif
+        free(clusters);
+    clusters = nullptr;
+    clusterCount = 0;
+    allocatedBytes = 0;
+    mmapped = hugePageBacked = false;
+}
+
+bool TranspositionTable::resize(size_t sizeMb, bool hugePages)
+{
+    release();
+    if (sizeMb == 0) return false;
+
+    // power-of-two cluster count so the index is a mask of the key
+    size_t count = 1;
+    while (count * 2 * sizeof(Cluster) <= (sizeMb << 20)) count *= 2;
+    size_t bytes = count * sizeof(Cluster);
+    const size_t hugePageSize = 2 << 20;
+
+    void* memory = nullptr;
+#ifdef __linux__
+    if (hugePages && bytes >= hugePageSize)
+    {
+        // reserved huge pages first; falls through when none are configured
+        memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (memory == MAP_FAILED) memory = nullptr;
+        else mmapped = hugePageBacked = true;
+    }
+#endif
+    if (!memory)
+    {
+        size_t alignment = bytes >= hugePageSize ? hugePageSize : sizeof(Cluster);
+        memory = aligned_alloc(alignment, bytes);
+        if (!memory) return false;
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+        // transparent huge pages: the kernel may back the table with 2 MB pages on its own
+        if (hugePages && madvise(memory, bytes, MADV_HUGEPAGE) == 0) hugePageBacked = true;
+#endif
+    }
+
+    clusters = static_cast<Cluster*>(memory);
+    clusterCount = count;
+    allocatedBytes = bytes;
+    clear();
+    return true;
+}
+
+void TranspositionTable::clear()
+{
+    if (clusters) memset(static_cast<void*>(clusters), 0, allocatedBytes);
+    age = 0;
+    probeCount = hitCount = storeCount = 0;
+}
+
+void TranspositionTable::newSearch()
+{
+    age = (age + 1) & 63;
+}
+
+bool TranspositionTable::probe(uint64_t key, TTData& out) const
+{
+    if (!clusters) return false;
+    const Cluster* cluster = clusterFor(key);
+    for (const Entry& e : cluster->entries)
+    {
+        uint64_t data = e.data.load(memory_order_relaxed);
+        uint64_t check = e.check.load(memory_order_relaxed);
+        if ((check ^ data) != key || dataBound(data) == BOUND_NONE) continue;
+
+        out.move = Move(data & 0xFFFF);
+        out.score = int16_t((data >> 16) & 0xFFFF);
+        out.depth = dataDepth(data);
+        out.bound = dataBound(data);
+        return true;
+    }
+    return false;
+}
+
+void TranspositionTable::store(uint64_t key, int depth, int bound, int score, Move move)
+{
+    if (!clusters) return;
+    Cluster* cluster = clusterFor(key);
+
+    Entry* victim = nullptr;
+    int victimValue = INT32_MAX;
+    for (Entry& e : cluster->entries)
+    {
+        uint64_t data = e.data.load(memory_order_relaxed);
+        uint64_t check = e.check.load(memory_order_relaxed);
+        if ((check ^ data) == key && dataBound(data) != BOUND_NONE)
+        {
+            // same position: keep a clearly deeper result from this search unless the new one is exact
+            if (bound != BOUND_EXACT && dataAge(data) == age && depth < dataDepth(data) - 3) return;
+            if (move == NO_MOVE) move = Move(data & 0xFFFF);
+            victim = &e;
+            break;
+        }
+
+        // empty slots go first, then shallow and stale entries
+        int ageDiff = (age - dataAge(data)) & 63;
+        int value = dataBound(data) == BOUND_NONE ? INT32_MIN : dataDepth(data) - 8 * ageDiff;
+        if (value < victimValue)
+        {
+            victimValue = value;
+            victim = &e;
+        }
+    }
+
+    uint64_t data = packData(move, score, depth, bound, age);
+    victim->data.store(data, memory_order_relaxed);
+    victim->check.store(key ^ data, memory_order_relaxed);
+}
+
+void TranspositionTable::addStats(uint64_t probes, uint64_t hits, uint64_t stores)
+{
+    probeCount += probes;
+    hitCount += hits;
+    storeCount += stores;
+}
+
+int TranspositionTable::hashfull() const
+{
+    if (!clusters) return 0;
+    size_t sample = clusterCount < 250 ? clusterCount : 250;
+    int used = 0;
+    for (size_t i = 0; i < sample; ++i)
+        for (const Entry& e : clusters[i].entries)
+        {
+            uint64_t data = e.data.load(memory_order_relaxed);
+            if (dataBound(data) != BOUND_NONE && dataAge(data) == age) used++;
+        }
+    return int(used * 1000 / (sample * 4));
+}
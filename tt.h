@@ -0,0 +1,82 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "position.h"
+
+enum Bound { BOUND_NONE, BOUND_UPPER, BOUND_LOWER, BOUND_EXACT };
+
+// what a probe hands back; score is as stored (the search converts mate scores)
+struct TTData
+{
+    Move move;
+    int score;
+    int depth;
+    int bound;
+};
+
+// Shared transposition table keyed by Zobrist hash.
+//
+// Each entry is two 64-bit words: the packed data and key ^ data. Writers store the
+// data word first, readers accept an entry only if both words XOR back to the key,
+// so a torn read from a concurrent store is rejected instead of returning mixed
+// fields. No locks are taken on probe or store.
+//
+// Four entries make a 64-byte cluster (one cache line). On a store the slot to
+// overwrite is the same key if present, else the entry with the lowest
+// depth-minus-age score, so deep results from the current search survive longest.
+class TranspositionTable
+{
+public:
+    TranspositionTable() {}
+    ~TranspositionTable();
+    TranspositionTable(const TranspositionTable&) = delete;
+    TranspositionTable& operator=(const TranspositionTable&) = delete;
+
+    // (re)allocates sizeMb megabytes, rounded down to a power-of-two cluster count.
+    // hugePages asks Linux for 2 MB pages (explicit first, then transparent).
+    bool resize(size_t sizeMb, bool hugePages = false);
+    void clear();
+    // start of a new search: bumps the age so older entries are replaced first
+    void newSearch();
+
+    bool probe(uint64_t key, TTData& out) const;
+    void store(uint64_t key, int depth, int bound, int score, Move move);
+
+    // searches report their counts once finished (keeps probe/store free of shared counters)
+    void addStats(uint64_t probes, uint64_t hits, uint64_t stores);
+    uint64_t probes() const { return probeCount.load(); }
+    uint64_t hits() const { return hitCount.load(); }
+    uint64_t stores() const { return storeCount.load(); }
+    double hitRate() const { return probes() ? double(hits()) / probes() : 0.0; }
+    // permille of sampled entries written during the current search, like UCI "hashfull"
+    int hashfull() const;
+
+    size_t sizeMb() const { return clusterCount * sizeof(Cluster) >> 20; }
+    bool usingHugePages() const { return hugePageBacked; }
+
+private:
+    struct Entry
+    {
+        std::atomic<uint64_t> check; // key ^ data
+        std::atomic<uint64_t> data;
+    };
+    struct alignas(64) Cluster
+    {
+        Entry entries[4];
+    };
+
+    Cluster* clusterFor(uint64_t key) const { return &clusters[key & (clusterCount - 1)]; }
+    void release();
+
+    Cluster* clusters = nullptr;
+    size_t clusterCount = 0;
+    size_t allocatedBytes = 0;
+    bool mmapped = false;
+    bool hugePageBacked = false;
+    uint8_t age = 0;
+
+    std::atomic<uint64_t> probeCount{0};
+    std::atomic<uint64_t> hitCount{0};
+    std::atomic<uint64_t> storeCount{0};
+};
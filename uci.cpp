@@ -0,0 +1,282 @@
+#include "uci.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include "book.h"
+#include "movegen.h"
+#include "nnue.h"
+#include "rules.h"
+#include "search.h"
+#include "syzygy.h"
+#include "tt.h"
+
+using namespace std;
+
+const int DEFAULT_HASH_MB = 16;
+const int MAX_HASH_MB = 65536;
+const int MAX_THREADS = 512;
+
+// one engine instance behind the protocol: the current position, the table and
+// the worker thread that runs "go"
+class UciEngine
+{
+public:
+    explicit UciEngine(ostream& out) : out(out)
+    {
+        initializeBoard(pos);
+        tt.resize(DEFAULT_HASH_MB);
+    }
+    ~UciEngine() { stopSearch(); }
+
+    void handle(const string& line);
+    bool quitRequested() const { return quitting; }
+    // end of input: let a bounded search finish so piped batch jobs still get their bestmove
+    void finish();
+
+private:
+    void send(const string& line);
+    void setOption(istringstream& args);
+    void setPosition(istringstream& args);
+    void go(istringstream& args);
+    void stopSearch();
+
+    ostream& out;
+    mutex outMutex;
+    Position pos;
+    TranspositionTable tt;
+    Tablebases tablebases;
+    OpeningBook book;
+    NnueNetwork network;
+    bool bestBookMove = false; // otherwise weighted-random, so games do not all repeat
+    mt19937_64 random{random_device{}()};
+    int threads = 1;
+    bool quitting = false;
+
+    thread worker;
+    atomic<bool> stop{false};
+    // "go infinite" must not print bestmove before "stop", even if the search ends first
+    mutex waitMutex;
+    condition_variable stopped;
+    bool stopSignalled = false;
+    bool searchBounded = false; // has a depth, time or node limit, so it ends by itself
+};
+
+// the search thread and the command loop both write; whole lines must not interleave
+void UciEngine::send(const string& line)
+{
+    lock_guard<mutex> lock(outMutex);
+    out << line << endl;
+}
+
+void UciEngine::stopSearch()
+{
+    if (!worker.joinable()) return;
+    stop = true;
+    {
+        lock_guard<mutex> lock(waitMutex);
+        stopSignalled = true;
+    }
+    stopped.notify_all();
+    worker.join();
+}
+
+void UciEngine::finish()
+{
+    if (worker.joinable() && searchBounded) worker.join();
+    stopSearch();
+}
+
+void UciEngine::setOption(istringstream& args)
+{
+    // setoption name <id> value <x>; names are case-insensitive and may contain spaces
+    string token, name, value;
+    args >> token;
+    while (args >> token && token != "value") name += (name.empty() ? "" : " ") + token;
+    getline(args >> ws, value); // paths may contain spaces
+    transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+    if (name == "hash")
+    {
+        int mb = max(1, min(MAX_HASH_MB, atoi(value.c_str())));
+        if (!tt.resize(mb)) send("info string cannot allocate " + to_string(mb) + " MB hash");
+    }
+    else if (name == "threads")
+        threads = max(1, min(MAX_THREADS, atoi(value.c_str())));
+    else if (name == "clear hash")
+        tt.clear();
+    else if (name == "bookfile")
+    {
+        if (value == "<empty>" || value.empty()) book.close();
+        else if (book.open(value)) send("info string book " + value + ", " + to_string(book.entryCount()) + " entries");
+        else send("info string cannot open book " + value);
+    }
+    else if (name == "evalfile")
+    {
+        if (value == "<empty>" || value.empty()) network.close();
+        else if (network.load(value)) send(string("info string network ") + value + ", " + nnueKernelName(activeNnueKernel()) + " kernel");
+        else send("info string cannot load network " + value);
+    }
+    else if (name == "best book move")
+        bestBookMove = value == "true";
+    else if (name == "syzygypath")
+    {
+        int found = value == "<empty>" ? tablebases.init("") : tablebases.init(value);
+        send("info string " + to_string(found) + " Syzygy tables found, up to "
+             + to_string(tablebases.maxPieces()) + " pieces");
+    }
+    else
+        send("info string unknown option " + name);
+}
+
+void UciEngine::setPosition(istringstream& args)
+{
+    string token, fen;
+    args >> token;
+    if (token == "startpos")
+    {
+        fen = START_FEN;
+        args >> token; // "moves", if any
+    }
+    else if (token == "fen")
+    {
+        while (args >> token && token != "moves") fen += (fen.empty() ? "" : " ") + token;
+    }
+    else
+        return;
+
+    Position next;
+    if (!setFromFen(next, fen))
+    {
+        send("info string invalid fen " + fen);
+        return;
+    }
+    while (args >> token)
+    {
+        Move m = moveFromUci(next, token);
+        if (m == NO_MOVE)
+        {
+            send("info string illegal move " + token);
+            break;
+        }
+        makeMove(next, m);
+    }
+    pos = next;
+}
+
+static string pvToString(const vector<Move>& pv)
+{
+    string s;
+    for (Move m : pv) s += (s.empty() ? "" : " ") + moveToUci(m);
+    return s;
+}
+
+void UciEngine::go(istringstream& args)
+{
+    SearchLimits limits;
+    bool infinite = false;
+    int64_t time[2] = { 0, 0 }, inc[2] = { 0, 0 };
+    int movesToGo = 0;
+    string token;
+    while (args >> token)
+    {
+        if (token == "depth") args >> limits.depth;
+        else if (token == "movetime") args >> limits.movetimeMs;
+        else if (token == "nodes") args >> limits.nodes;
+        else if (token == "wtime") args >> time[WHITE];
+        else if (token == "btime") args >> time[BLACK];
+        else if (token == "winc") args >> inc[WHITE];
+        else if (token == "binc") args >> inc[BLACK];
+        else if (token == "movestogo") args >> movesToGo;
+        else if (token == "infinite") infinite = true;
+    }
+
+    // clock games: spend an even share of the remaining time plus most of the increment,
+    // keeping a margin so slow output never flags
+    int us = pos.whiteToMove ? WHITE : BLACK;
+    if (!limits.movetimeMs && time[us] > 0)
+    {
+        int64_t share = time[us] / (movesToGo > 0 ? movesToGo + 1 : 30) + inc[us] * 3 / 4;
+        limits.movetimeMs = max<int64_t>(1, min(share, time[us] - 50));
+    }
+    if (infinite) limits = SearchLimits();
+
+    // in book: answer at once, without a search
+    Move bookMove = infinite ? NO_MOVE : book.pick(pos, bestBookMove ? BOOK_BEST : BOOK_WEIGHTED, random());
+    if (bookMove != NO_MOVE)
+    {
+        send("info string book move");
+        send("bestmove " + moveToUci(bookMove));
+        return;
+    }
+
+    // the position was set up without the network; its accumulators are built once here
+    attachNetwork(pos, network.isLoaded() ? &network : nullptr);
+
+    stop = false;
+    stopSignalled = false;
+    searchBounded = limits.depth > 0 || limits.movetimeMs > 0 || limits.nodes > 0;
+    worker = thread([this, limits, infinite]() {
+        TranspositionTable* table = &tt;
+        SearchResult result = search(pos, limits, [this, table](const SearchReport& r) {
+            send("info depth " + to_string(r.depth) + " score " + formatScore(r.score)
+                 + " nodes " + to_string(r.nodes) + " time " + to_string(r.timeMs)
+                 + " nps " + to_string(r.timeMs > 0 ? r.nodes * 1000 / r.timeMs : r.nodes)
+                 + " hashfull " + to_string(table->hashfull()) + " pv " + pvToString(r.pv));
+        }, &stop, &tt, threads, tablebases.tableCount() ? &tablebases : nullptr);
+        if (result.tbProbes)
+            send("info string tbhits " + to_string(result.tbHits) + " of " + to_string(result.tbProbes) + " probes");
+
+        if (infinite)
+        {
+            unique_lock<mutex> lock(waitMutex);
+            stopped.wait(lock, [this]() { return stopSignalled; });
+        }
+        send("bestmove " + (result.bestMove ? moveToUci(result.bestMove) : string("0000")));
+    });
+}
+
+void UciEngine::handle(const string& line)
+{
+    istringstream args(line);
+    string command;
+    args >> command;
+
+    if (command == "uci")
+    {
+        send("id name chess");
+        send("id author chess contributors");
+        send("option name Hash type spin default " + to_string(DEFAULT_HASH_MB) + " min 1 max "
+             + to_string(MAX_HASH_MB));
+        send("option name Threads type spin default 1 min 1 max " + to_string(MAX_THREADS));
+        send("option name Clear Hash type button");
+        send("option name SyzygyPath type string default <empty>");
+        send("option name BookFile type string default <empty>");
+        send("option name EvalFile type string default <empty>");
+        send("option name Best Book Move type check default false");
+        send("uciok");
+    }
+    else if (command == "isready") send("readyok");
+    else if (command == "stop") stopSearch();
+    else if (command == "quit") { stopSearch(); quitting = true; }
+    else if (command == "ucinewgame") { stopSearch(); tt.clear(); }
+    else if (command == "setoption") { stopSearch(); setOption(args); }
+    else if (command == "position") { stopSearch(); setPosition(args); }
+    else if (command == "go") { stopSearch(); go(args); }
+    else if (!command.empty()) send("info string unknown command " + command);
+}
+
+int runUci(istream& in, ostream& out)
+{
+    UciEngine engine(out);
+    string line;
+    while (!engine.quitRequested() && getline(in, line))
+        engine.handle(line);
+    engine.finish();
+    return 0;
+}
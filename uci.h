@@ -0,0 +1,14 @@
+#pragma once
+#include <iosfwd>
+
+// Universal Chess Interface on a pair of streams (normally stdin/stdout).
+//
+// Supported: uci, isready, ucinewgame, setoption name Hash|Threads value n,
+// setoption name SyzygyPath value <dirs>, setoption name BookFile value <file.bin>,
+// setoption name EvalFile value <file.nnue>,
+// setoption name Best Book Move value true|false,
+// position startpos|fen <fen> [moves ...], go [depth n] [movetime ms] [nodes n]
+// [wtime/btime/winc/binc/movestogo] [infinite], stop, quit.
+// Searches run on a worker thread, so "stop" and "isready" are answered while
+// the engine is thinking. Returns when "quit" is read or the input ends.
+int runUci(std::istream& in, std::ostream& out);